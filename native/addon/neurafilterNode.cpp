@@ -0,0 +1,588 @@
+// Node binding for libneurafilter (N-API, so one build works across Node versions)
+//
+//   const { Engine } = require("native/build/neurafilter.node");
+//   const engine = new Engine({ rules, config });   // scoringRules() and defaultFilterConfig() literals
+//   engine.runLine(line, { now, channel, config, enforceRateLimit })  -> result, as harness runLine()
+//   engine.filterLine(line, options)                                   -> result, as processLine()
+//   engine.runBatch(lines, nows, options)                              -> results, or with
+//                                                   options.summary = true: {actions, rateLimited}
+//                                   options.threads (0: all cores) runs it on the engine's worker pool,
+//                                   with options.channels[i] as line i's channel and options.chunkLines
+//   engine.replayFile(path, options)                                   -> {lines, bytes, actions, reasons, rateLimited}
+//                                   a file's lines through runBatch() from a memory map, options.batchLines
+//                                   at a time, line i at options.now + i * options.intervalMs; options.output
+//                                   writes every line that is not suppressed there as NDJSON
+//   engine.maskSensitive(line), engine.templateOf(message, channel),
+//   engine.extractTimestamp(message, channel, now), engine.scoreLog(message, ageMs, config)
+//   engine.saveSnapshot(path) -> {channels, written, bytes, compacted}, engine.loadSnapshot(path) -> channels
+//   engine.stateSizes(), engine.reset()
+//
+// Results have the harness's shape: {action, reason, message, score,
+// timestamp}, plus queued, digest and rateLimited where the harness sets them.
+#include <node_api.h>
+
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "neurafilter/json.h"
+#include "neurafilter/mappedLines.h"
+#include "neurafilter/neurafilter.h"
+
+namespace {
+
+using neurafilter::Engine;
+using neurafilter::FilterConfig;
+using neurafilter::json::Value;
+
+#define NAPI_OK(call)                                                  \
+    do {                                                               \
+        if ((call) != napi_ok) {                                       \
+            napi_throw_error(env, nullptr, "N-API call failed: " #call); \
+            return nullptr;                                            \
+        }                                                              \
+    } while (0)
+
+struct Binding {
+    Engine engine;
+    Binding(neurafilter::ScoringRules rules, FilterConfig config) : engine(std::move(rules), config) {}
+};
+
+bool typeOf(napi_env env, napi_value value, napi_valuetype want) {
+    napi_valuetype type;
+    return napi_typeof(env, value, &type) == napi_ok && type == want;
+}
+
+std::string toString(napi_env env, napi_value value) {
+    size_t length = 0;
+    napi_get_value_string_utf8(env, value, nullptr, 0, &length);
+    std::string out(length, '\0');
+    napi_get_value_string_utf8(env, value, out.data(), length + 1, &length);
+    return out;
+}
+
+// Plain JS data (objects, arrays, numbers, strings, booleans) as a json::Value
+Value toJson(napi_env env, napi_value value, int depth = 0) {
+    napi_valuetype type;
+    napi_typeof(env, value, &type);
+    if (depth > 32) return Value();
+    switch (type) {
+        case napi_boolean: {
+            bool b;
+            napi_get_value_bool(env, value, &b);
+            return Value(b);
+        }
+        case napi_number: {
+            double n;
+            napi_get_value_double(env, value, &n);
+            return Value(n);
+        }
+        case napi_string: return Value(toString(env, value));
+        case napi_object: {
+            bool isArray = false;
+            napi_is_array(env, value, &isArray);
+            if (isArray) {
+                Value array = Value::array();
+                uint32_t length = 0;
+                napi_get_array_length(env, value, &length);
+                for (uint32_t i = 0; i < length; i++) {
+                    napi_value item;
+                    napi_get_element(env, value, i, &item);
+                    array.push(toJson(env, item, depth + 1));
+                }
+                return array;
+            }
+            Value object = Value::object();
+            napi_value names;
+            napi_get_property_names(env, value, &names);
+            uint32_t length = 0;
+            napi_get_array_length(env, names, &length);
+            for (uint32_t i = 0; i < length; i++) {
+                napi_value name, item;
+                napi_get_element(env, names, i, &name);
+                napi_get_property(env, value, name, &item);
+                object[toString(env, name)] = toJson(env, item, depth + 1);
+            }
+            return object;
+        }
+        default: return Value();
+    }
+}
+
+napi_value property(napi_env env, napi_value object, const char* name) {
+    if (!typeOf(env, object, napi_object)) return nullptr;
+    bool has = false;
+    napi_has_named_property(env, object, name, &has);
+    if (!has) return nullptr;
+    napi_value out;
+    napi_get_named_property(env, object, name, &out);
+    if (typeOf(env, out, napi_undefined) || typeOf(env, out, napi_null)) return nullptr;
+    return out;
+}
+
+void setString(napi_env env, napi_value object, const char* name, std::string_view text) {
+    napi_value value;
+    napi_create_string_utf8(env, text.data(), text.size(), &value);
+    napi_set_named_property(env, object, name, value);
+}
+
+void setNumber(napi_env env, napi_value object, const char* name, double number) {
+    napi_value value;
+    napi_create_double(env, number, &value);
+    napi_set_named_property(env, object, name, value);
+}
+
+void setBool(napi_env env, napi_value object, const char* name, bool flag) {
+    napi_value value;
+    napi_get_boolean(env, flag, &value);
+    napi_set_named_property(env, object, name, value);
+}
+
+napi_value queuedObject(napi_env env, const neurafilter::QueuedResult& queued) {
+    napi_value object;
+    napi_create_object(env, &object);
+    setString(env, object, "action", neurafilter::actionName(queued.action));
+    setString(env, object, "reason", neurafilter::reasonName(queued.reason));
+    setString(env, object, "message", queued.message);
+    setNumber(env, object, "score", queued.score);
+    setNumber(env, object, "timestamp", static_cast<double>(queued.timestamp));
+    return object;
+}
+
+napi_value resultObject(napi_env env, const neurafilter::Result& result) {
+    napi_value object;
+    napi_create_object(env, &object);
+    setString(env, object, "action", neurafilter::actionName(result.action));
+    setString(env, object, "reason", neurafilter::reasonName(result.reason));
+    setString(env, object, "message", result.message);
+    setNumber(env, object, "score", result.score);
+    if (result.hasTimestamp) setNumber(env, object, "timestamp", static_cast<double>(result.timestamp));
+    if (result.queued >= 0) setBool(env, object, "queued", result.queued == 1);
+    if (result.hasDigest) {
+        napi_value digest;
+        napi_create_array_with_length(env, result.digest.size(), &digest);
+        for (size_t i = 0; i < result.digest.size(); i++)
+            napi_set_element(env, digest, static_cast<uint32_t>(i), queuedObject(env, result.digest[i]));
+        napi_set_named_property(env, object, "digest", digest);
+    }
+    if (result.sampled > 0) {
+        napi_value sampling;
+        napi_create_object(env, &sampling);
+        setNumber(env, sampling, "sampled", static_cast<double>(result.sampled));
+        setNumber(env, sampling, "rate", result.sampleRate);
+        napi_set_named_property(env, object, "sampling", sampling);
+    }
+    if (result.rateLimited) setBool(env, object, "rateLimited", true);
+    return object;
+}
+
+// The per-call options object: {now, channel, config, enforceRateLimit}
+struct CallOptions {
+    neurafilter::RunOptions run;
+    std::string channel = "local";
+    FilterConfig config;
+    bool summary = false;
+    bool parallel = false;
+    neurafilter::ParallelOptions pool;
+    std::vector<std::string> channels;
+};
+
+void readOptions(napi_env env, Binding& binding, napi_value options, CallOptions& out) {
+    out.config = binding.engine.defaultConfig();
+    if (napi_value now = property(env, options, "now")) {
+        double value;
+        napi_get_value_double(env, now, &value);
+        out.run.now = static_cast<int64_t>(value);
+    } else {
+        out.run.now = std::chrono::duration_cast<std::chrono::milliseconds>(
+                          std::chrono::system_clock::now().time_since_epoch())
+                          .count();
+    }
+    if (napi_value channel = property(env, options, "channel")) out.channel = toString(env, channel);
+    if (napi_value config = property(env, options, "config"))
+        out.config = FilterConfig::fromJson(toJson(env, config), binding.engine.defaultConfig());
+    if (napi_value enforce = property(env, options, "enforceRateLimit")) napi_get_value_bool(env, enforce, &out.run.enforceRateLimit);
+    if (napi_value summary = property(env, options, "summary")) napi_get_value_bool(env, summary, &out.summary);
+    if (napi_value threads = property(env, options, "threads")) {
+        uint32_t value = 0;
+        napi_get_value_uint32(env, threads, &value);
+        out.parallel = true;
+        out.pool.threads = value;
+    }
+    if (napi_value chunk = property(env, options, "chunkLines")) {
+        uint32_t value = 0;
+        napi_get_value_uint32(env, chunk, &value);
+        if (value > 0) out.pool.chunkLines = value;
+    }
+    if (napi_value channels = property(env, options, "channels")) {
+        uint32_t length = 0;
+        napi_get_array_length(env, channels, &length);
+        for (uint32_t i = 0; i < length; i++) {
+            napi_value item;
+            napi_get_element(env, channels, i, &item);
+            out.channels.push_back(toString(env, item));
+        }
+    }
+    out.run.channel = out.channel;
+    out.run.config = &out.config;
+}
+
+Binding* unwrap(napi_env env, napi_callback_info info, size_t& argc, napi_value* argv) {
+    napi_value self;
+    if (napi_get_cb_info(env, info, &argc, argv, &self, nullptr) != napi_ok) return nullptr;
+    void* data = nullptr;
+    if (napi_unwrap(env, self, &data) != napi_ok) {
+        napi_throw_error(env, nullptr, "Engine method called on a non-Engine object");
+        return nullptr;
+    }
+    return static_cast<Binding*>(data);
+}
+
+bool requireString(napi_env env, napi_value value, const char* what) {
+    if (typeOf(env, value, napi_string)) return true;
+    napi_throw_type_error(env, nullptr, (std::string(what) + " must be a string").c_str());
+    return false;
+}
+
+napi_value Construct(napi_env env, napi_callback_info info) {
+    size_t argc = 1;
+    napi_value argv[1] = {nullptr}, self;
+    NAPI_OK(napi_get_cb_info(env, info, &argc, argv, &self, nullptr));
+    try {
+        neurafilter::ScoringRules rules = neurafilter::ScoringRules::defaults();
+        FilterConfig config;
+        if (argc > 0) {
+            if (napi_value value = property(env, argv[0], "rules")) rules = neurafilter::ScoringRules::fromJson(toJson(env, value));
+            if (napi_value value = property(env, argv[0], "config")) config = FilterConfig::fromJson(toJson(env, value));
+        }
+        auto* binding = new Binding(std::move(rules), config);
+        NAPI_OK(napi_wrap(env, self, binding, [](napi_env, void* data, void*) { delete static_cast<Binding*>(data); },
+                          nullptr, nullptr));
+    } catch (const std::exception& error) {
+        napi_throw_error(env, nullptr, error.what());
+        return nullptr;
+    }
+    return self;
+}
+
+template <bool kFilterOnly>
+napi_value RunLine(napi_env env, napi_callback_info info) {
+    size_t argc = 2;
+    napi_value argv[2] = {nullptr, nullptr};
+    Binding* binding = unwrap(env, info, argc, argv);
+    if (binding == nullptr || !requireString(env, argv[0], "line")) return nullptr;
+    CallOptions options;
+    readOptions(env, *binding, argv[1], options);
+    std::string line = toString(env, argv[0]);
+    neurafilter::Result result =
+        kFilterOnly ? binding->engine.filterLine(line, options.run) : binding->engine.runLine(line, options.run);
+    return resultObject(env, result);
+}
+
+napi_value RunBatch(napi_env env, napi_callback_info info) {
+    size_t argc = 3;
+    napi_value argv[3] = {nullptr, nullptr, nullptr};
+    Binding* binding = unwrap(env, info, argc, argv);
+    if (binding == nullptr) return nullptr;
+    bool isArray = false;
+    napi_is_array(env, argv[0], &isArray);
+    if (!isArray) {
+        napi_throw_type_error(env, nullptr, "lines must be an array");
+        return nullptr;
+    }
+    CallOptions options;
+    readOptions(env, *binding, argv[2], options);
+
+    uint32_t count = 0;
+    napi_get_array_length(env, argv[0], &count);
+    std::vector<std::string> storage(count);
+    std::vector<std::string_view> lines(count);
+    std::vector<int64_t> nows(count, options.run.now);
+    bool hasNows = false;
+    napi_is_array(env, argv[1], &hasNows);
+    for (uint32_t i = 0; i < count; i++) {
+        napi_value item;
+        napi_get_element(env, argv[0], i, &item);
+        storage[i] = toString(env, item);
+        lines[i] = storage[i];
+        if (hasNows) {
+            napi_value now;
+            double value;
+            napi_get_element(env, argv[1], i, &now);
+            napi_get_value_double(env, now, &value);
+            nows[i] = static_cast<int64_t>(value);
+        }
+    }
+
+    std::vector<neurafilter::Result> results;
+    if (options.parallel) {
+        std::vector<std::string_view> channels(options.channels.begin(), options.channels.end());
+        binding->engine.runParallel(lines, nows, channels, options.run, options.pool, results);
+    } else {
+        binding->engine.runBatch(lines, nows, options.run, results);
+    }
+
+    if (options.summary) {
+        uint32_t actions[3] = {0, 0, 0};
+        uint32_t rateLimited = 0;
+        for (const neurafilter::Result& result : results) {
+            actions[static_cast<size_t>(result.action)]++;
+            if (result.rateLimited) rateLimited++;
+        }
+        napi_value summary, counts;
+        napi_create_object(env, &summary);
+        napi_create_object(env, &counts);
+        for (size_t a = 0; a < 3; a++)
+            if (actions[a] > 0) setNumber(env, counts, neurafilter::actionName(static_cast<neurafilter::Action>(a)), actions[a]);
+        napi_set_named_property(env, summary, "actions", counts);
+        setNumber(env, summary, "rateLimited", rateLimited);
+        return summary;
+    }
+
+    napi_value out;
+    napi_create_array_with_length(env, results.size(), &out);
+    for (size_t i = 0; i < results.size(); i++) napi_set_element(env, out, static_cast<uint32_t>(i), resultObject(env, results[i]));
+    return out;
+}
+
+// Lines go from the mapping straight into the engine, and each batch's pages
+// are released once its results are counted, so memory stays flat for
+// archives of any size
+napi_value ReplayFile(napi_env env, napi_callback_info info) {
+    size_t argc = 2;
+    napi_value argv[2] = {nullptr, nullptr};
+    Binding* binding = unwrap(env, info, argc, argv);
+    if (binding == nullptr || !requireString(env, argv[0], "path")) return nullptr;
+    CallOptions options;
+    readOptions(env, *binding, argv[1], options);
+    double intervalMs = 0;
+    uint32_t batchLines = 4096;
+    std::string output;
+    if (napi_value interval = property(env, argv[1], "intervalMs")) napi_get_value_double(env, interval, &intervalMs);
+    if (napi_value batch = property(env, argv[1], "batchLines")) napi_get_value_uint32(env, batch, &batchLines);
+    if (napi_value file = property(env, argv[1], "output")) output = toString(env, file);
+    if (batchLines == 0) batchLines = 4096;
+
+    size_t total = 0, rateLimited = 0, bytes = 0;
+    size_t actions[3] = {0, 0, 0};
+    std::map<std::string, size_t> reasons;
+    try {
+        neurafilter::MappedLines file(toString(env, argv[0]));
+        std::unique_ptr<std::FILE, int (*)(std::FILE*)> out(nullptr, std::fclose);
+        if (!output.empty()) {
+            out.reset(std::fopen(output.c_str(), "w"));
+            if (out == nullptr) throw std::runtime_error("cannot open " + output);
+        }
+
+        std::vector<std::string_view> lines, channels;
+        std::vector<int64_t> nows;
+        std::vector<neurafilter::Result> results;
+        auto flush = [&] {
+            if (options.parallel) binding->engine.runParallel(lines, nows, channels, options.run, options.pool, results);
+            else binding->engine.runBatch(lines, nows, options.run, results);
+            for (size_t i = 0; i < results.size(); i++) {
+                const neurafilter::Result& result = results[i];
+                actions[static_cast<size_t>(result.action)]++;
+                reasons[neurafilter::reasonName(result.reason)]++;
+                if (result.rateLimited) rateLimited++;
+                if (out == nullptr || result.action == neurafilter::Action::Suppress) continue;
+                Value record = Value::object();
+                record["line"] = total + i + 1;
+                record["action"] = neurafilter::actionName(result.action);
+                record["reason"] = neurafilter::reasonName(result.reason);
+                record["message"] = result.message;
+                record["score"] = result.score;
+                if (result.hasTimestamp) record["timestamp"] = result.timestamp;
+                if (result.hasDigest && !result.digest.empty()) record["digest"] = result.digest.size();
+                std::string text = record.dump();
+                text += '\n';
+                std::fwrite(text.data(), 1, text.size(), out.get());
+            }
+            total += lines.size();
+            lines.clear();
+            nows.clear();
+            // Results may point into the lines, so only now can their pages go
+            file.release();
+        };
+
+        std::string_view line;
+        while (file.next(line)) {
+            lines.push_back(line);
+            nows.push_back(options.run.now + static_cast<int64_t>(static_cast<double>(total + lines.size() - 1) * intervalMs));
+            if (lines.size() == batchLines) flush();
+        }
+        if (!lines.empty()) flush();
+        bytes = file.size();
+        if (out != nullptr && std::fclose(out.release()) != 0) throw std::runtime_error("cannot write " + output);
+    } catch (const std::exception& error) {
+        napi_throw_error(env, nullptr, error.what());
+        return nullptr;
+    }
+
+    napi_value summary, counts, byReason;
+    napi_create_object(env, &summary);
+    napi_create_object(env, &counts);
+    napi_create_object(env, &byReason);
+    for (size_t a = 0; a < 3; a++)
+        if (actions[a] > 0) setNumber(env, counts, neurafilter::actionName(static_cast<neurafilter::Action>(a)), actions[a]);
+    for (const auto& [reason, n] : reasons) setNumber(env, byReason, reason.c_str(), n);
+    setNumber(env, summary, "lines", total);
+    setNumber(env, summary, "bytes", bytes);
+    napi_set_named_property(env, summary, "actions", counts);
+    napi_set_named_property(env, summary, "reasons", byReason);
+    setNumber(env, summary, "rateLimited", rateLimited);
+    return summary;
+}
+
+napi_value MaskSensitive(napi_env env, napi_callback_info info) {
+    size_t argc = 1;
+    napi_value argv[1] = {nullptr};
+    Binding* binding = unwrap(env, info, argc, argv);
+    if (binding == nullptr || !requireString(env, argv[0], "line")) return nullptr;
+    std::string masked = binding->engine.maskSensitive(toString(env, argv[0]));
+    napi_value out;
+    napi_create_string_utf8(env, masked.data(), masked.size(), &out);
+    return out;
+}
+
+napi_value TemplateOf(napi_env env, napi_callback_info info) {
+    size_t argc = 2;
+    napi_value argv[2] = {nullptr, nullptr};
+    Binding* binding = unwrap(env, info, argc, argv);
+    if (binding == nullptr || !requireString(env, argv[0], "message")) return nullptr;
+    std::string channel = argc > 1 && typeOf(env, argv[1], napi_string) ? toString(env, argv[1]) : "local";
+    std::string id = binding->engine.templateOf(toString(env, argv[0]), channel);
+    napi_value out;
+    napi_create_string_utf8(env, id.data(), id.size(), &out);
+    return out;
+}
+
+napi_value ExtractTimestamp(napi_env env, napi_callback_info info) {
+    size_t argc = 3;
+    napi_value argv[3] = {nullptr, nullptr, nullptr};
+    Binding* binding = unwrap(env, info, argc, argv);
+    if (binding == nullptr || !requireString(env, argv[0], "message")) return nullptr;
+    std::string channel = argc > 1 && typeOf(env, argv[1], napi_string) ? toString(env, argv[1]) : "local";
+    double now = 0;
+    if (argc > 2) napi_get_value_double(env, argv[2], &now);
+    int64_t timestamp;
+    napi_value out;
+    if (binding->engine.extractTimestamp(toString(env, argv[0]), channel, static_cast<int64_t>(now), timestamp))
+        napi_create_double(env, static_cast<double>(timestamp), &out);
+    else
+        napi_get_null(env, &out);
+    return out;
+}
+
+napi_value ScoreLog(napi_env env, napi_callback_info info) {
+    size_t argc = 3;
+    napi_value argv[3] = {nullptr, nullptr, nullptr};
+    Binding* binding = unwrap(env, info, argc, argv);
+    if (binding == nullptr || !requireString(env, argv[0], "message")) return nullptr;
+    double age = 0;
+    if (argc > 1) napi_get_value_double(env, argv[1], &age);
+    FilterConfig config = binding->engine.defaultConfig();
+    if (argc > 2 && typeOf(env, argv[2], napi_object)) config = FilterConfig::fromJson(toJson(env, argv[2]), config);
+    napi_value out;
+    napi_create_double(env, binding->engine.scoreLog(toString(env, argv[0]), static_cast<int64_t>(age), config), &out);
+    return out;
+}
+
+napi_value SaveSnapshot(napi_env env, napi_callback_info info) {
+    size_t argc = 1;
+    napi_value argv[1] = {nullptr};
+    Binding* binding = unwrap(env, info, argc, argv);
+    if (binding == nullptr || !requireString(env, argv[0], "path")) return nullptr;
+    neurafilter::SnapshotStats stats;
+    try {
+        stats = binding->engine.saveSnapshot(toString(env, argv[0]));
+    } catch (const std::exception& error) {
+        napi_throw_error(env, nullptr, error.what());
+        return nullptr;
+    }
+    napi_value out;
+    napi_create_object(env, &out);
+    setNumber(env, out, "channels", stats.channels);
+    setNumber(env, out, "written", stats.written);
+    setNumber(env, out, "bytes", static_cast<double>(stats.bytes));
+    setBool(env, out, "compacted", stats.compacted);
+    return out;
+}
+
+napi_value LoadSnapshot(napi_env env, napi_callback_info info) {
+    size_t argc = 1;
+    napi_value argv[1] = {nullptr};
+    Binding* binding = unwrap(env, info, argc, argv);
+    if (binding == nullptr || !requireString(env, argv[0], "path")) return nullptr;
+    size_t channels = 0;
+    try {
+        channels = binding->engine.loadSnapshot(toString(env, argv[0]));
+    } catch (const std::exception& error) {
+        napi_throw_error(env, nullptr, error.what());
+        return nullptr;
+    }
+    napi_value out;
+    napi_create_double(env, static_cast<double>(channels), &out);
+    return out;
+}
+
+napi_value StateSizes(napi_env env, napi_callback_info info) {
+    size_t argc = 0;
+    Binding* binding = unwrap(env, info, argc, nullptr);
+    if (binding == nullptr) return nullptr;
+    neurafilter::StateSizes sizes = binding->engine.stateSizes();
+    napi_value out;
+    napi_create_object(env, &out);
+    setNumber(env, out, "shards", sizes.shards);
+    setNumber(env, out, "entryMap", sizes.entryMap);
+    setNumber(env, out, "templateCache", sizes.templateCache);
+    setNumber(env, out, "templates", sizes.templates);
+    setNumber(env, out, "queued", sizes.queued);
+    setNumber(env, out, "counterDeltas", sizes.counterDeltas);
+    setNumber(env, out, "sketches", sizes.sketches);
+    return out;
+}
+
+napi_value Reset(napi_env env, napi_callback_info info) {
+    size_t argc = 0;
+    Binding* binding = unwrap(env, info, argc, nullptr);
+    if (binding == nullptr) return nullptr;
+    binding->engine.reset();
+    return nullptr;
+}
+
+napi_value Init(napi_env env, napi_value exports) {
+    napi_property_descriptor methods[] = {
+        {"runLine", nullptr, RunLine<false>, nullptr, nullptr, nullptr, napi_default, nullptr},
+        {"filterLine", nullptr, RunLine<true>, nullptr, nullptr, nullptr, napi_default, nullptr},
+        {"runBatch", nullptr, RunBatch, nullptr, nullptr, nullptr, napi_default, nullptr},
+        {"replayFile", nullptr, ReplayFile, nullptr, nullptr, nullptr, napi_default, nullptr},
+        {"maskSensitive", nullptr, MaskSensitive, nullptr, nullptr, nullptr, napi_default, nullptr},
+        {"templateOf", nullptr, TemplateOf, nullptr, nullptr, nullptr, napi_default, nullptr},
+        {"extractTimestamp", nullptr, ExtractTimestamp, nullptr, nullptr, nullptr, napi_default, nullptr},
+        {"scoreLog", nullptr, ScoreLog, nullptr, nullptr, nullptr, napi_default, nullptr},
+        {"saveSnapshot", nullptr, SaveSnapshot, nullptr, nullptr, nullptr, napi_default, nullptr},
+        {"loadSnapshot", nullptr, LoadSnapshot, nullptr, nullptr, nullptr, napi_default, nullptr},
+        {"stateSizes", nullptr, StateSizes, nullptr, nullptr, nullptr, napi_default, nullptr},
+        {"reset", nullptr, Reset, nullptr, nullptr, nullptr, napi_default, nullptr},
+    };
+    napi_value engine;
+    NAPI_OK(napi_define_class(env, "Engine", NAPI_AUTO_LENGTH, Construct, nullptr, sizeof methods / sizeof methods[0],
+                              methods, &engine));
+    NAPI_OK(napi_set_named_property(env, exports, "Engine", engine));
+    napi_value kernel;
+    NAPI_OK(napi_create_string_utf8(env, neurafilter::simdKernel(), NAPI_AUTO_LENGTH, &kernel));
+    NAPI_OK(napi_set_named_property(env, exports, "simdKernel", kernel));
+    return exports;
+}
+
+}  // namespace
+
+#ifndef NODE_GYP_MODULE_NAME
+#define NODE_GYP_MODULE_NAME neurafilter
+#endif
+NAPI_MODULE(NODE_GYP_MODULE_NAME, Init)
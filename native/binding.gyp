@@ -0,0 +1,35 @@
+{
+  "targets": [
+    {
+      "target_name": "neurafilter",
+      "sources": [
+        "addon/neurafilterNode.cpp",
+        "src/adaptiveSampler.cpp",
+        "src/byteScan.cpp",
+        "src/byteScanAvx2.cpp",
+        "src/byteScanNeon.cpp",
+        "src/byteScanSse42.cpp",
+        "src/engine.cpp",
+        "src/json.cpp",
+        "src/logFilter.cpp",
+        "src/logTemplate.cpp",
+        "src/logTimestamp.cpp",
+        "src/mappedLines.cpp",
+        "src/maskAutomaton.cpp",
+        "src/maskSensitive.cpp",
+        "src/md5.cpp",
+        "src/rateLimiter.cpp",
+        "src/scoringRules.cpp",
+        "src/snapshot.cpp",
+        "src/workPool.cpp"
+      ],
+      "include_dirs": ["include", "src"],
+      "cflags_cc": ["-std=c++20", "-O2"],
+      "cflags_cc!": ["-fno-exceptions", "-std=gnu++17"],
+      "xcode_settings": {
+        "CLANG_CXX_LANGUAGE_STANDARD": "c++20",
+        "GCC_ENABLE_CPP_EXCEPTIONS": "YES"
+      }
+    }
+  ]
+}
@@ -0,0 +1,87 @@
+// Minimal JSON values for configs, scoring rules and sidecar payloads
+// Usage: json::parse(text) -> Value (throws json::Error), value.dump() -> text
+//
+// Objects keep insertion order, like Deluge maps and JS objects, so dumped
+// results read the same as the harness's JSON.stringify output.
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace neurafilter::json {
+
+class Error : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+class Value {
+public:
+    enum class Type : uint8_t { Null, Bool, Number, String, Array, Object };
+    using Array = std::vector<Value>;
+    using Object = std::vector<std::pair<std::string, Value>>;
+
+    Value() = default;
+    Value(std::nullptr_t) {}
+    Value(bool b) : type_(Type::Bool), bool_(b) {}
+    Value(double n) : type_(Type::Number), number_(n) {}
+    Value(int n) : type_(Type::Number), number_(n) {}
+    Value(int64_t n) : type_(Type::Number), number_(static_cast<double>(n)) {}
+    Value(size_t n) : type_(Type::Number), number_(static_cast<double>(n)) {}
+    Value(const char* s) : type_(Type::String), string_(s) {}
+    Value(std::string s) : type_(Type::String), string_(std::move(s)) {}
+    Value(std::string_view s) : type_(Type::String), string_(s) {}
+
+    static Value array() {
+        Value v;
+        v.type_ = Type::Array;
+        return v;
+    }
+    static Value object() {
+        Value v;
+        v.type_ = Type::Object;
+        return v;
+    }
+
+    Type type() const { return type_; }
+    bool isNull() const { return type_ == Type::Null; }
+    bool isBool() const { return type_ == Type::Bool; }
+    bool isNumber() const { return type_ == Type::Number; }
+    bool isString() const { return type_ == Type::String; }
+    bool isArray() const { return type_ == Type::Array; }
+    bool isObject() const { return type_ == Type::Object; }
+
+    bool asBool() const { return bool_; }
+    double asNumber() const { return number_; }
+    const std::string& asString() const { return string_; }
+    const Array& items() const { return array_; }
+    Array& items() { return array_; }
+    const Object& members() const { return object_; }
+
+    // Object member or nullptr
+    const Value* find(std::string_view key) const;
+    // Object member, inserted as null if missing (turns null into an object)
+    Value& operator[](std::string_view key);
+    void push(Value item);
+
+    std::string dump() const;
+    void dumpTo(std::string& out) const;
+
+private:
+    Type type_ = Type::Null;
+    bool bool_ = false;
+    double number_ = 0;
+    std::string string_;
+    Array array_;
+    Object object_;
+};
+
+Value parse(std::string_view text);
+void appendQuoted(std::string& out, std::string_view text);
+void appendNumber(std::string& out, double number);
+
+}  // namespace neurafilter::json
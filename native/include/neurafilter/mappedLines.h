@@ -0,0 +1,45 @@
+// Line reader over a memory-mapped file, for replaying log archives
+//
+// Lines come back as views into the mapping, so reading one copies nothing
+// and allocates nothing; the kernel pages the file in as the reader moves
+// through it (MADV_SEQUENTIAL). Lines end at '\n', a trailing '\r' is
+// dropped, and a final '\n' does not start an empty last line.
+//
+// Mapped pages count towards the process's resident set until the kernel
+// reclaims them. release() hands the pages behind the reader back early, so
+// a replay that calls it after every batch stays at one batch's worth of the
+// file however large the file is.
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace neurafilter {
+
+class MappedLines {
+public:
+    // Throws std::runtime_error if the file cannot be opened or mapped
+    explicit MappedLines(const std::string& path);
+    ~MappedLines();
+    MappedLines(const MappedLines&) = delete;
+    MappedLines& operator=(const MappedLines&) = delete;
+
+    // false once the file is exhausted
+    bool next(std::string_view& line);
+
+    // Drops the mapped pages the reader has moved past; views returned so
+    // far (and results that point into them) must not be used afterwards
+    void release();
+
+    size_t size() const { return size_; }
+    size_t offset() const { return offset_; }
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    size_t offset_ = 0;
+    size_t released_ = 0;
+};
+
+}  // namespace neurafilter
@@ -0,0 +1,223 @@
+// libneurafilter: native port of the extension's filter pipeline
+//
+// Runs the same stages as runPipeline() in services/logPipeline.deluge and
+// runLine() in test/runLocalTest.js, with the same results:
+//   maskSensitive   (utils/maskSensitive.deluge)    src/maskSensitive.cpp
+//   templateOf      (services/logTemplate.deluge)   src/logTemplate.cpp
+//   extractTimestamp(utils/logTimestamp.deluge)     src/logTimestamp.cpp
+//   scoreMessage    (utils/scoringRules.deluge)     src/scoringRules.cpp
+//   filterLogWith   (services/logFilter.deluge)     src/logFilter.cpp
+//   checkRateLimit  (utils/rateLimiter.deluge)      src/rateLimiter.cpp
+//   samplerKeeps    (utils/adaptiveSampler.deluge)  src/adaptiveSampler.cpp
+// test/parityTest.js --native diffs it against the harness line by line.
+//
+// One Engine holds every channel's state and is not thread-safe; callers
+// serialize access (the Node addon runs on the JS thread, the sidecar on one
+// worker). runParallel() spreads one call over the engine's own worker pool.
+// Strings in a Result point into the engine's per-call arenas, or into the
+// caller's line when masking left it unchanged, and stay valid until the
+// next call into the engine while that line is alive.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace neurafilter {
+
+namespace json {
+class Value;
+}
+
+// A channel masking rule: matches of pattern become [REDACTED_<label>]
+struct MaskRule {
+    std::string label;
+    std::string pattern;   // ECMAScript syntax, as std::regex reads it
+
+    bool operator==(const MaskRule&) const = default;
+};
+
+// sample_mode of utils/adaptiveSampler.deluge
+enum class SampleMode : uint8_t { Off, Auto, On };
+
+// Resolved channel config, as returned by getChannelConfig()
+struct FilterConfig {
+    int64_t version = 0;
+    bool enabled = true;
+    bool rawWhenDisabled = false;  // disabled_mode == "raw"
+    int64_t dedupWindowMs = 60000;
+    double anomalyThreshold = 5;
+    double keywordBoost = 2;
+    int64_t recencyWindowMs = 300000;
+    double rateLimit = 20;
+    int64_t rateWindowMs = 60000;
+    double rateBurst = 10;
+    // Approximate mode: fixed-size sketches instead of per-template entries
+    // (sizes as resolved by utils/filterConfig.deluge)
+    bool approximate = false;
+    uint32_t sketchWidth = 2719;
+    uint32_t sketchDepth = 5;
+    uint32_t dedupBits = 95851;
+    uint32_t dedupHashes = 7;
+    uint32_t topK = 32;
+    // Adaptive sampling of low-score lines under load
+    SampleMode sampleMode = SampleMode::Off;
+    double sampleLatencyMs = 50;
+    double sampleMinScore = 2;
+    double sampleMinRate = 0.05;
+    // Channel masking rules, applied before the built-in ones (compiled once
+    // per version, see utils/maskSensitive.deluge)
+    std::vector<MaskRule> maskRules;
+
+    // base with the fields present in a resolved-config object; other keys
+    // (version, the digest_* posting options, ...) are ignored
+    static FilterConfig fromJson(const json::Value& value, const FilterConfig& base);
+    static FilterConfig fromJson(const json::Value& value);
+};
+
+// The rule set of utils/scoringRules.deluge
+struct ScoringRules {
+    struct Level {
+        std::string token;
+        double weight;
+    };
+    int64_t version = 1;
+    std::vector<Level> levels;
+    std::vector<std::string> keywords;
+    double recencyBoost = 1;
+
+    static ScoringRules defaults();
+    static ScoringRules fromJson(const json::Value& value);
+    // Reads the literal returned by scoringRules() in a .deluge file
+    static ScoringRules fromDelugeFile(const std::string& path);
+};
+
+enum class Action : uint8_t { Pass, Highlight, Suppress };
+enum class Reason : uint8_t { New, Anomaly, Duplicate, RateLimited, FilterOff, Sampled };
+
+const char* actionName(Action action);
+const char* reasonName(Reason reason);
+
+// A filter result held back by the limiter, owned by the channel's queue
+struct QueuedResult {
+    Action action;
+    Reason reason;
+    std::string message;
+    double score;
+    int64_t timestamp;
+};
+
+struct Result {
+    Action action = Action::Pass;
+    Reason reason = Reason::New;
+    std::string_view message;
+    double score = 0;
+    bool hasTimestamp = true;   // false for rate-limited lines
+    int64_t timestamp = 0;
+    int8_t queued = -1;         // -1 unset, else whether the line was queued
+    bool rateLimited = false;
+    bool hasDigest = false;     // set on lines that got a token
+    std::vector<QueuedResult> digest;
+    uint64_t sampled = 0;       // on lines that got a token: lines sampled out since the last report
+    double sampleRate = 0;      // the sampler's keep rate, with sampled
+};
+
+struct RunOptions {
+    int64_t now = 0;                        // ingest time, epoch ms
+    std::string_view channel = "local";
+    const FilterConfig* config = nullptr;   // nullptr: the engine default
+    bool enforceRateLimit = true;           // false: charge the limiter, keep denied lines
+};
+
+struct ParallelOptions {
+    unsigned threads = 0;       // workers, the calling thread included; 0: one per hardware thread
+    size_t chunkLines = 256;    // lines per task
+};
+
+struct StateSizes {
+    size_t shards = 0;
+    size_t entryMap = 0;
+    size_t templateCache = 0;
+    size_t templates = 0;
+    size_t queued = 0;
+    size_t counterDeltas = 0;   // live window and post records
+    size_t sketches = 0;        // channels in approximate mode
+};
+
+struct SnapshotStats {
+    size_t channels = 0;      // in the snapshot
+    size_t written = 0;       // sections this save wrote
+    uint64_t bytes = 0;       // file size
+    bool compacted = false;   // written whole rather than appended to
+};
+
+// Vector kernel picked for this CPU ("avx2", "sse4.2", "neon" or "scalar");
+// NEURAFILTER_SIMD in the environment forces a narrower one
+const char* simdKernel();
+
+class Engine {
+public:
+    explicit Engine(ScoringRules rules = ScoringRules::defaults(), FilterConfig config = FilterConfig());
+    ~Engine();
+    Engine(const Engine&) = delete;
+    Engine& operator=(const Engine&) = delete;
+
+    // Mask, filter, then the rate limit for lines that would be posted, as
+    // runLine() in the harness / runPipeline() in Deluge
+    Result runLine(std::string_view line, const RunOptions& options);
+
+    // Mask + filter only, as processLine() in services/logPipeline.deluge
+    // (used by webhook payloads, which spend one token per summary)
+    Result filterLine(std::string_view line, const RunOptions& options);
+
+    // Lines in order through runLine(); nows[i] is line i's ingest time.
+    // Results stay valid until the next call.
+    void runBatch(const std::vector<std::string_view>& lines, const std::vector<int64_t>& nows,
+                  const RunOptions& options, std::vector<Result>& out);
+
+    // runBatch() on a work-stealing pool, with the same results. channels[i]
+    // is line i's channel (options.channel when channels is shorter). Masking,
+    // template shapes, timestamp parsing and keyword scoring run on any
+    // worker; each channel's dedup, window, template and limiter updates run
+    // on one thread at a time, in input order, so they take no locks. Output
+    // order is input order.
+    void runParallel(const std::vector<std::string_view>& lines, const std::vector<int64_t>& nows,
+                     const std::vector<std::string_view>& channels, const RunOptions& options,
+                     const ParallelOptions& parallel, std::vector<Result>& out);
+
+    // The limiter on its own, for callers that post their own summaries
+    bool checkRateLimit(std::string_view channel, const FilterConfig& config, int64_t now);
+    bool queueOverflow(std::string_view channel, const Result& result);
+    std::vector<QueuedResult> drainOverflow(std::string_view channel);
+
+    // Single stages, for parity tests
+    std::string maskSensitive(std::string_view line);
+    std::string templateOf(std::string_view message, std::string_view channel);
+    bool extractTimestamp(std::string_view message, std::string_view channel, int64_t now, int64_t& timestamp);
+    // Only reads the rules, so unlike the rest it may run alongside other calls
+    double scoreLog(std::string_view message, int64_t ageMs, const FilterConfig& config) const;
+
+    // Channel state in a binary file (format in src/snapshot.h), so a restart
+    // keeps its dedup, window, template and limiter state. saveSnapshot()
+    // writes only the channels used since the last save or load of the same
+    // file; the others keep their sections. loadSnapshot() replaces all state
+    // and reads only the file's index: a channel's records are decoded on its
+    // first use, and one whose section is damaged starts empty. Both throw
+    // std::runtime_error for an unusable file. Rules, configs and the adaptive
+    // samplers (which start over idle) are not saved.
+    SnapshotStats saveSnapshot(const std::string& path);
+    size_t loadSnapshot(const std::string& path);   // channels in the file
+
+    const FilterConfig& defaultConfig() const;
+    StateSizes stateSizes() const;   // channels a snapshot has not decoded yet are not counted
+    void reset();
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+}  // namespace neurafilter
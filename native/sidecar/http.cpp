@@ -0,0 +1,237 @@
+#include "http.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include "neurafilter/json.h"
+
+namespace neurafilter::http {
+
+namespace {
+
+const char* statusText(int status) {
+    switch (status) {
+        case 200: return "OK";
+        case 202: return "Accepted";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 413: return "Payload Too Large";
+        case 501: return "Not Implemented";
+        case 503: return "Service Unavailable";
+        default: return "Internal Server Error";
+    }
+}
+
+bool sendAll(int fd, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool equalsFolded(const std::string& a, const char* b) {
+    size_t n = std::strlen(b);
+    if (a.size() != n) return false;
+    for (size_t i = 0; i < n; i++)
+        if (std::tolower(static_cast<unsigned char>(a[i])) != std::tolower(static_cast<unsigned char>(b[i]))) return false;
+    return true;
+}
+
+void writeResponse(int fd, const Response& response, bool keepAlive) {
+    std::string head = "HTTP/1.1 " + std::to_string(response.status) + " " + statusText(response.status) + "\r\n";
+    head += "Content-Type: " + response.contentType + "\r\n";
+    head += "Content-Length: " + std::to_string(response.body.size()) + "\r\n";
+    head += keepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+    sendAll(fd, head + response.body);
+}
+
+std::string errorBody(const std::string& message) {
+    json::Value body = json::Value::object();
+    body["error"] = message;
+    return body.dump();
+}
+
+}  // namespace
+
+Server::Server(const std::string& host, int port, size_t maxBodyBytes, size_t maxConnections)
+    : maxBodyBytes_(maxBodyBytes), maxConnections_(maxConnections) {
+    listenFd_ = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (listenFd_ < 0) throw std::runtime_error(std::string("socket: ") + std::strerror(errno));
+    int yes = 1;
+    ::setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof yes);
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    if (::inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1) throw std::runtime_error("bad host " + host);
+    if (::bind(listenFd_, reinterpret_cast<sockaddr*>(&address), sizeof address) < 0)
+        throw std::runtime_error(std::string("bind: ") + std::strerror(errno));
+    if (::listen(listenFd_, 128) < 0) throw std::runtime_error(std::string("listen: ") + std::strerror(errno));
+
+    socklen_t length = sizeof address;
+    ::getsockname(listenFd_, reinterpret_cast<sockaddr*>(&address), &length);
+    port_ = ntohs(address.sin_port);
+}
+
+Server::~Server() {
+    stop();
+    if (listenFd_ >= 0) ::close(listenFd_);
+}
+
+void Server::stop() {
+    running_ = false;
+    if (listenFd_ >= 0) ::shutdown(listenFd_, SHUT_RDWR);
+    std::list<Connection> open;
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        for (Connection& connection : connections_)
+            if (!connection.done) ::shutdown(connection.fd, SHUT_RDWR);
+        open.swap(connections_);
+    }
+    for (Connection& connection : open) connection.thread.join();
+}
+
+void Server::joinFinished() {
+    std::list<Connection> finished;
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        for (auto connection = connections_.begin(); connection != connections_.end();) {
+            auto next = std::next(connection);
+            if (connection->done) finished.splice(finished.end(), connections_, connection);
+            connection = next;
+        }
+    }
+    for (Connection& connection : finished) connection.thread.join();
+}
+
+void Server::serve(const Handler& handler) {
+    while (running_) {
+        int fd = ::accept(listenFd_, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            if (!running_) break;
+            continue;
+        }
+        int yes = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof yes);
+        joinFinished();
+
+        std::lock_guard<std::mutex> guard(mutex_);
+        if (!running_ || connections_.size() >= maxConnections_) {
+            writeResponse(fd, {503, "application/json", errorBody("too many connections")}, false);
+            ::close(fd);
+            continue;
+        }
+        // The thread finds its record by address (list nodes stay put) and
+        // closes the socket under the lock, so stop() never shuts down a
+        // descriptor that has been reused
+        Connection& connection = connections_.emplace_back();
+        connection.fd = fd;
+        connection.thread = std::thread([this, &connection, &handler] {
+            serveConnection(connection.fd, handler);
+            std::lock_guard<std::mutex> closing(mutex_);
+            ::close(connection.fd);
+            connection.done = true;
+        });
+    }
+}
+
+void Server::serveConnection(int fd, const Handler& handler) {
+    std::string buffer;
+    char chunk[16384];
+    for (;;) {
+        // Headers
+        size_t headerEnd;
+        while ((headerEnd = buffer.find("\r\n\r\n")) == std::string::npos) {
+            if (buffer.size() > 64 * 1024) {
+                writeResponse(fd, {400, "application/json", errorBody("headers too large")}, false);
+                return;
+            }
+            ssize_t n = ::recv(fd, chunk, sizeof chunk, 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                return;
+            }
+            buffer.append(chunk, static_cast<size_t>(n));
+        }
+
+        Request request;
+        size_t lineEnd = buffer.find("\r\n");
+        std::string requestLine = buffer.substr(0, lineEnd);
+        size_t space1 = requestLine.find(' ');
+        size_t space2 = requestLine.find(' ', space1 + 1);
+        if (space1 == std::string::npos || space2 == std::string::npos) {
+            writeResponse(fd, {400, "application/json", errorBody("bad request line")}, false);
+            return;
+        }
+        request.method = requestLine.substr(0, space1);
+        std::string target = requestLine.substr(space1 + 1, space2 - space1 - 1);
+        size_t question = target.find('?');
+        request.path = target.substr(0, question);
+        if (question != std::string::npos) request.query = target.substr(question + 1);
+        bool keepAlive = requestLine.compare(space2 + 1, std::string::npos, "HTTP/1.1") == 0;
+
+        size_t contentLength = 0;
+        bool transferEncoding = false;
+        for (size_t at = lineEnd + 2; at < headerEnd;) {
+            size_t end = buffer.find("\r\n", at);
+            std::string header = buffer.substr(at, end - at);
+            at = end + 2;
+            size_t colon = header.find(':');
+            if (colon == std::string::npos) continue;
+            std::string name = header.substr(0, colon);
+            std::string value = header.substr(colon + 1);
+            value.erase(0, value.find_first_not_of(" \t"));
+            if (equalsFolded(name, "content-length")) contentLength = std::strtoull(value.c_str(), nullptr, 10);
+            else if (equalsFolded(name, "connection")) keepAlive = !equalsFolded(value, "close");
+            else if (equalsFolded(name, "transfer-encoding")) transferEncoding = true;
+        }
+        // The body's length is unknown without decoding it, so the
+        // connection cannot be reused either
+        if (transferEncoding) {
+            writeResponse(fd, {501, "application/json", errorBody("Transfer-Encoding is not supported; send Content-Length")},
+                          false);
+            return;
+        }
+        if (contentLength > maxBodyBytes_) {
+            writeResponse(fd, {413, "application/json", errorBody("body too large")}, false);
+            return;
+        }
+
+        // Body
+        buffer.erase(0, headerEnd + 4);
+        while (buffer.size() < contentLength) {
+            ssize_t n = ::recv(fd, chunk, sizeof chunk, 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                return;
+            }
+            buffer.append(chunk, static_cast<size_t>(n));
+        }
+        request.body = buffer.substr(0, contentLength);
+        buffer.erase(0, contentLength);
+
+        Response response;
+        try {
+            response = handler(request);
+        } catch (const std::exception& error) {
+            response = {500, "application/json", errorBody(error.what())};
+        }
+        writeResponse(fd, response, keepAlive);
+        if (!keepAlive) return;
+    }
+}
+
+}  // namespace neurafilter::http
@@ -0,0 +1,67 @@
+// Small blocking HTTP/1.1 server for the sidecar (POSIX sockets)
+//
+// Enough of the protocol for JSON webhooks from Cliq and log shippers:
+// Content-Length bodies, keep-alive, one thread per connection up to a cap
+// (past it new connections get a 503). Anything else (chunked uploads, TLS)
+// belongs in a reverse proxy in front.
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace neurafilter::http {
+
+struct Request {
+    std::string method;
+    std::string path;    // without the query string
+    std::string query;
+    std::string body;
+};
+
+struct Response {
+    int status = 200;
+    std::string contentType = "application/json";
+    std::string body;
+};
+
+using Handler = std::function<Response(const Request&)>;
+
+class Server {
+public:
+    // Binds host:port (port 0 picks a free one); throws std::runtime_error
+    Server(const std::string& host, int port, size_t maxBodyBytes, size_t maxConnections);
+    ~Server();
+    Server(const Server&) = delete;
+    Server& operator=(const Server&) = delete;
+
+    int port() const { return port_; }
+    // Accepts connections until stop() is called
+    void serve(const Handler& handler);
+    // Stops accepting, shuts open connections down and joins their threads
+    void stop();
+
+private:
+    struct Connection {
+        int fd;
+        std::thread thread;
+        bool done = false;   // under mutex_; fd is closed by then
+    };
+
+    void serveConnection(int fd, const Handler& handler);
+    void joinFinished();
+
+    int listenFd_ = -1;
+    int port_ = 0;
+    size_t maxBodyBytes_;
+    size_t maxConnections_;
+    std::atomic<bool> running_{true};
+    std::mutex mutex_;
+    std::list<Connection> connections_;   // under mutex_
+};
+
+}  // namespace neurafilter::http
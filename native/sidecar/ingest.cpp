@@ -0,0 +1,334 @@
+#include "ingest.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <stdexcept>
+#include <unordered_map>
+
+#include <unistd.h>
+
+namespace neurafilter::sidecar {
+
+const char* overflowPolicyName(OverflowPolicy policy) {
+    switch (policy) {
+        case OverflowPolicy::DropLowest: return "drop-lowest";
+        case OverflowPolicy::Sample: return "sample";
+        case OverflowPolicy::Spill: return "spill";
+    }
+    return "drop-lowest";
+}
+
+bool parseOverflowPolicy(const std::string& name, OverflowPolicy& policy) {
+    for (OverflowPolicy candidate : {OverflowPolicy::DropLowest, OverflowPolicy::Sample, OverflowPolicy::Spill}) {
+        if (name == overflowPolicyName(candidate)) {
+            policy = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Where lines go while the ring is full. Only receivers that hit a full ring
+// and the consumer once the ring is empty touch it, so a plain mutex is fine.
+class OverflowStore {
+public:
+    virtual ~OverflowStore() = default;
+    // false if the item (or one it displaced) was dropped
+    virtual bool admit(IngestItem& item) = 0;
+    virtual bool take(IngestItem& item) = 0;
+    virtual size_t size() const = 0;
+    virtual size_t capacity() const = 0;
+
+protected:
+    mutable std::mutex lock_;
+};
+
+namespace {
+
+class DropLowestStore : public OverflowStore {
+public:
+    explicit DropLowestStore(size_t capacity) : capacity_(std::max<size_t>(1, capacity)) {}
+
+    bool admit(IngestItem& item) override {
+        std::lock_guard<std::mutex> guard(lock_);
+        if (items_.size() < capacity_) {
+            items_.emplace(item.score, std::move(item));
+            return true;
+        }
+        if (item.score <= items_.begin()->first) return false;
+        items_.erase(items_.begin());
+        items_.emplace(item.score, std::move(item));
+        return false;
+    }
+
+    // Highest score first
+    bool take(IngestItem& item) override {
+        std::lock_guard<std::mutex> guard(lock_);
+        if (items_.empty()) return false;
+        auto highest = std::prev(items_.end());
+        item = std::move(highest->second);
+        items_.erase(highest);
+        return true;
+    }
+
+    size_t size() const override {
+        std::lock_guard<std::mutex> guard(lock_);
+        return items_.size();
+    }
+    size_t capacity() const override { return capacity_; }
+
+private:
+    size_t capacity_;
+    std::multimap<double, IngestItem> items_;
+};
+
+class SampleStore : public OverflowStore {
+public:
+    SampleStore(size_t capacity, unsigned every) : capacity_(std::max<size_t>(1, capacity)), every_(std::max(1u, every)) {}
+
+    bool admit(IngestItem& item) override {
+        std::lock_guard<std::mutex> guard(lock_);
+        if (seen_++ % every_ != 0 || items_.size() >= capacity_) return false;
+        items_.push_back(std::move(item));
+        return true;
+    }
+
+    bool take(IngestItem& item) override {
+        std::lock_guard<std::mutex> guard(lock_);
+        if (items_.empty()) return false;
+        item = std::move(items_.front());
+        items_.pop_front();
+        return true;
+    }
+
+    size_t size() const override {
+        std::lock_guard<std::mutex> guard(lock_);
+        return items_.size();
+    }
+    size_t capacity() const override { return capacity_; }
+
+private:
+    size_t capacity_;
+    unsigned every_;
+    uint64_t seen_ = 0;
+    std::deque<IngestItem> items_;
+};
+
+// NDJSON records {channel_id, line, now, config}, read back in order. The
+// file is truncated each time the reader catches up, so it only holds one
+// flood. A record's config is a number standing for the config its line
+// was pushed with (0: the engine default); the configs themselves stay in
+// memory, one per request that brought one, until the file starts over.
+class SpillStore : public OverflowStore {
+public:
+    explicit SpillStore(const std::string& path) {
+        file_ = path.empty() ? std::tmpfile() : std::fopen(path.c_str(), "w+");
+        if (file_ == nullptr) throw std::runtime_error("cannot open spill file " + (path.empty() ? "(temporary)" : path));
+    }
+    ~SpillStore() override { std::fclose(file_); }
+
+    bool admit(IngestItem& item) override {
+        json::Value record = json::Value::object();
+        record["channel_id"] = item.channel;
+        record["line"] = item.line;
+        record["now"] = item.now;
+        std::lock_guard<std::mutex> guard(lock_);
+        record["config"] = static_cast<int64_t>(configId(item.config));
+        std::string text = record.dump();
+        text += '\n';
+        std::fseek(file_, 0, SEEK_END);
+        if (std::fwrite(text.data(), 1, text.size(), file_) != text.size()) return false;
+        std::fflush(file_);
+        written_++;
+        return true;
+    }
+
+    bool take(IngestItem& item) override {
+        std::lock_guard<std::mutex> guard(lock_);
+        if (read_ == written_) return false;
+        std::fseek(file_, readOffset_, SEEK_SET);
+        std::string text;
+        for (int c = std::fgetc(file_); c != EOF && c != '\n'; c = std::fgetc(file_)) text += static_cast<char>(c);
+        readOffset_ = std::ftell(file_);
+        read_++;
+        if (read_ == written_) {
+            // Caught up: start the file over
+            if (ftruncate(fileno(file_), 0) == 0) read_ = written_ = 0, readOffset_ = 0;
+        }
+        json::Value record = json::parse(text);
+        item.channel = record.find("channel_id")->asString();
+        item.line = record.find("line")->asString();
+        item.now = static_cast<int64_t>(record.find("now")->asNumber());
+        auto config = configs_.find(static_cast<uint64_t>(record.find("config")->asNumber()));
+        item.config = config != configs_.end() ? config->second : nullptr;
+        if (written_ == 0) {
+            configs_.clear();
+            configIds_.clear();
+        }
+        return true;
+    }
+
+    size_t size() const override {
+        std::lock_guard<std::mutex> guard(lock_);
+        return written_ - read_;
+    }
+    size_t capacity() const override { return 0; }  // bounded by the disk
+
+private:
+    uint64_t configId(const std::shared_ptr<const FilterConfig>& config) {
+        if (config == nullptr) return 0;
+        auto [found, added] = configIds_.emplace(config.get(), configIds_.size() + 1);
+        if (added) configs_.emplace(found->second, config);
+        return found->second;
+    }
+
+    std::FILE* file_;
+    size_t written_ = 0;
+    size_t read_ = 0;
+    long readOffset_ = 0;
+    std::unordered_map<const FilterConfig*, uint64_t> configIds_;
+    std::unordered_map<uint64_t, std::shared_ptr<const FilterConfig>> configs_;
+};
+
+std::unique_ptr<OverflowStore> makeStore(const IngestOptions& options) {
+    switch (options.policy) {
+        case OverflowPolicy::Sample: return std::make_unique<SampleStore>(options.overflowCapacity, options.sampleEvery);
+        case OverflowPolicy::Spill: return std::make_unique<SpillStore>(options.spillPath);
+        case OverflowPolicy::DropLowest: break;
+    }
+    return std::make_unique<DropLowestStore>(options.overflowCapacity);
+}
+
+}  // namespace
+
+Ingest::Ingest(Engine& engine, std::mutex& engineLock, IngestOptions options, Sink sink)
+    : engine_(engine),
+      engineLock_(engineLock),
+      options_(std::move(options)),
+      sink_(std::move(sink)),
+      ring_(options_.ringCapacity),
+      overflow_(makeStore(options_)),
+      consumer_([this] { consume(); }) {}
+
+Ingest::~Ingest() {
+    stopping_ = true;
+    pushes_.fetch_add(1);
+    pushes_.notify_one();
+    consumer_.join();
+}
+
+Admission Ingest::push(std::vector<IngestItem>& items) {
+    Admission admission;
+    for (IngestItem& item : items) {
+        if (ring_.tryPush(item)) {
+            admission.accepted++;
+            continue;
+        }
+        // Scoring only reads the rules, so it needs no engine lock
+        admission.overflowed++;
+        if (options_.policy == OverflowPolicy::DropLowest)
+            item.score = engine_.scoreLog(item.line, 0, item.config ? *item.config : engine_.defaultConfig());
+        if (!overflow_->admit(item)) admission.dropped++;
+    }
+    accepted_ += admission.accepted;
+    overflowed_ += admission.overflowed;
+    dropped_ += admission.dropped;
+
+    size_t used = ring_.size();
+    size_t peak = peak_.load();
+    while (used > peak && !peak_.compare_exchange_weak(peak, used)) continue;
+    size_t highWater = ring_.capacity() / 4 * 3;
+    if (used > highWater) {
+        double rate = drainPerMs_.load();
+        admission.retryAfterMs = rate > 0 ? static_cast<int64_t>(static_cast<double>(used - highWater) / rate) + 1 : 1000;
+    }
+
+    pushes_.fetch_add(1);
+    pushes_.notify_one();
+    return admission;
+}
+
+size_t Ingest::takeBatch(std::vector<IngestItem>& batch) {
+    batch.clear();
+    IngestItem item;
+    while (batch.size() < options_.batchLines && ring_.tryPop(item)) batch.push_back(std::move(item));
+    // Overflow lines only once the ring is empty
+    while (batch.empty() || (batch.size() < options_.batchLines && ring_.size() == 0)) {
+        if (!overflow_->take(item)) break;
+        batch.push_back(std::move(item));
+    }
+    return batch.size();
+}
+
+// Runs until stopping_ is set and the ring and overflow store are empty,
+// so lines accepted before shutdown still reach the engine and the sink
+void Ingest::consume() {
+    std::vector<IngestItem> batch;
+    for (;;) {
+        uint64_t seen = pushes_.load();
+        if (takeBatch(batch) == 0) {
+            if (stopping_) return;
+            pushes_.wait(seen);
+            continue;
+        }
+        auto started = std::chrono::steady_clock::now();
+        filterBatch(batch);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+        if (ms > 0) {
+            double rate = static_cast<double>(batch.size()) / ms;
+            double previous = drainPerMs_.load();
+            drainPerMs_.store(previous > 0 ? previous * 0.8 + rate * 0.2 : rate);
+        }
+        processed_ += batch.size();
+    }
+}
+
+void Ingest::filterBatch(std::vector<IngestItem>& batch) {
+    std::vector<std::string_view> lines, channels;
+    std::vector<int64_t> nows;
+    std::vector<Result> results;
+
+    std::lock_guard<std::mutex> guard(engineLock_);
+    // One runParallel() call per run of lines with the same config
+    for (size_t begin = 0; begin < batch.size();) {
+        size_t end = begin;
+        lines.clear();
+        channels.clear();
+        nows.clear();
+        while (end < batch.size() && batch[end].config == batch[begin].config) {
+            IngestItem& item = batch[end++];
+            int64_t& last = lastNow_[item.channel];
+            last = std::max(last, item.now);
+            lines.push_back(item.line);
+            channels.push_back(item.channel);
+            nows.push_back(last);
+        }
+        RunOptions options;
+        options.config = batch[begin].config.get();
+        engine_.runParallel(lines, nows, channels, options, options_.parallel, results);
+        for (size_t i = 0; i < results.size(); i++) sink_(batch[begin + i], results[i]);
+        begin = end;
+    }
+}
+
+json::Value Ingest::stats() const {
+    json::Value stats = json::Value::object();
+    stats["policy"] = overflowPolicyName(options_.policy);
+    stats["ring_capacity"] = ring_.capacity();
+    stats["ring_used"] = ring_.size();
+    stats["ring_peak"] = peak_.load();
+    stats["occupancy"] = static_cast<double>(ring_.size()) / static_cast<double>(ring_.capacity());
+    stats["overflow_used"] = overflow_->size();
+    stats["overflow_capacity"] = overflow_->capacity();
+    stats["accepted"] = static_cast<int64_t>(accepted_.load());
+    stats["overflowed"] = static_cast<int64_t>(overflowed_.load());
+    stats["dropped"] = static_cast<int64_t>(dropped_.load());
+    stats["processed"] = static_cast<int64_t>(processed_.load());
+    stats["drain_per_ms"] = drainPerMs_.load();
+    return stats;
+}
+
+}  // namespace neurafilter::sidecar
@@ -0,0 +1,110 @@
+// Asynchronous ingestion for the sidecar: POST /ingest hands lines to a ring
+// (ingestRing.h) and returns at once; one consumer thread drains the ring in
+// batches through Engine::runParallel() and hands every result to a sink.
+//
+// Receivers never wait on the filter: when the ring is full, a line goes to
+// the overflow policy instead:
+//   drop-lowest  keep the highest-scoring overflow lines (scored on arrival),
+//                dropping the lowest once the overflow store is full
+//   sample       keep every Nth overflow line, drop the rest
+//   spill        append overflow lines to a file and replay them once the
+//                ring has drained
+// Overflow lines are filtered after the ring is empty, so a line's ingest
+// time is clamped to the latest one its channel has already been filtered at.
+//
+// Backpressure: once the ring is past its high-water mark (3/4 full), push()
+// returns a retry-after hint, the time the consumer needs at its measured
+// drain rate to bring the ring back to the mark. Ring slots are the tokens
+// of an ingest bucket, refilled as fast as lines are filtered. The channel's
+// post limiter still applies to every line inside the engine.
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "ingestRing.h"
+#include "neurafilter/json.h"
+#include "neurafilter/neurafilter.h"
+
+namespace neurafilter::sidecar {
+
+enum class OverflowPolicy : uint8_t { DropLowest, Sample, Spill };
+
+const char* overflowPolicyName(OverflowPolicy policy);
+// false for an unknown name
+bool parseOverflowPolicy(const std::string& name, OverflowPolicy& policy);
+
+struct IngestOptions {
+    size_t ringCapacity = 65536;
+    OverflowPolicy policy = OverflowPolicy::DropLowest;
+    size_t overflowCapacity = 4096;   // drop-lowest and sample stores
+    unsigned sampleEvery = 10;
+    std::string spillPath;            // empty: an anonymous temporary file
+    size_t batchLines = 4096;         // lines per runParallel() call
+    ParallelOptions parallel{1, 256};
+};
+
+struct IngestItem {
+    std::string channel;
+    std::string line;
+    int64_t now = 0;
+    double score = 0;                                // set only when it overflows
+    std::shared_ptr<const FilterConfig> config;      // nullptr: the engine default
+};
+
+struct Admission {
+    size_t accepted = 0;      // into the ring
+    size_t overflowed = 0;    // handed to the overflow policy
+    size_t dropped = 0;       // of those, not kept
+    int64_t retryAfterMs = 0; // 0 below the high-water mark
+};
+
+class OverflowStore;
+
+class Ingest {
+public:
+    // Called on the consumer thread, with the engine lock held, for every
+    // result in input order
+    using Sink = std::function<void(const IngestItem& item, const Result& result)>;
+
+    // engineLock guards engine against the sidecar's other handlers
+    Ingest(Engine& engine, std::mutex& engineLock, IngestOptions options, Sink sink);
+    // Filters every line still queued (no push() may be running), then stops
+    ~Ingest();
+    Ingest(const Ingest&) = delete;
+    Ingest& operator=(const Ingest&) = delete;
+
+    // Never blocks on the consumer or the engine lock
+    Admission push(std::vector<IngestItem>& items);
+
+    json::Value stats() const;
+
+private:
+    void consume();
+    size_t takeBatch(std::vector<IngestItem>& batch);
+    void filterBatch(std::vector<IngestItem>& batch);
+
+    Engine& engine_;
+    std::mutex& engineLock_;
+    IngestOptions options_;
+    Sink sink_;
+    Ring<IngestItem> ring_;
+    std::unique_ptr<OverflowStore> overflow_;
+
+    std::atomic<uint64_t> pushes_{0};   // wakes the consumer
+    std::atomic<bool> stopping_{false};
+    std::atomic<size_t> peak_{0};
+    std::atomic<uint64_t> accepted_{0}, overflowed_{0}, dropped_{0}, processed_{0};
+    std::atomic<double> drainPerMs_{0};  // lines filtered per ms, smoothed
+    std::unordered_map<std::string, int64_t> lastNow_;  // consumer only
+    std::thread consumer_;
+};
+
+}  // namespace neurafilter::sidecar
@@ -0,0 +1,94 @@
+// Bounded lock-free queue between the sidecar's HTTP receivers and its
+// filter worker
+//
+// Vyukov's bounded array queue: every cell carries a sequence number saying
+// whether it is free for the push at its position or full for the pop there,
+// so pushers and poppers claim a position with one compare-and-swap and
+// never wait on each other or take a lock. A full ring fails the push
+// instead of blocking; the caller decides what happens to the item (see
+// OverflowPolicy in ingest.h). Safe for any number of pushers and poppers;
+// the sidecar has one receiver thread per connection and one consumer.
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace neurafilter::sidecar {
+
+template <typename T>
+class Ring {
+public:
+    // Capacity is rounded up to a power of two
+    explicit Ring(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) size *= 2;
+        cells_ = std::make_unique<Cell[]>(size);
+        mask_ = size - 1;
+        for (size_t i = 0; i < size; i++) cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    size_t capacity() const { return mask_ + 1; }
+
+    // Approximate while pushes and pops are in flight
+    size_t size() const {
+        size_t head = head_.load(std::memory_order_acquire);
+        size_t tail = tail_.load(std::memory_order_acquire);
+        return head > tail ? head - tail : 0;
+    }
+
+    // Moves from value only on success
+    bool tryPush(T& value) {
+        size_t position = head_.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells_[position & mask_];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t lag = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+            if (lag == 0) {
+                if (head_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    cell.value = std::move(value);
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (lag < 0) {
+                return false;  // the cell still holds the item from one lap ago
+            } else {
+                position = head_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool tryPop(T& out) {
+        size_t position = tail_.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells_[position & mask_];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t lag = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1);
+            if (lag == 0) {
+                if (tail_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    out = std::move(cell.value);
+                    cell.sequence.store(position + mask_ + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (lag < 0) {
+                return false;  // empty
+            } else {
+                position = tail_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    struct alignas(64) Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> cells_;
+    size_t mask_ = 0;
+    alignas(64) std::atomic<size_t> head_{0};  // next push
+    alignas(64) std::atomic<size_t> tail_{0};  // next pop
+};
+
+}  // namespace neurafilter::sidecar
@@ -0,0 +1,567 @@
+// neurafilter-sidecar: the native filter behind a small HTTP API
+//
+// Usage: neurafilter-sidecar [--host 127.0.0.1] [--port 8787] [--rules utils/scoringRules.deluge]
+//                            [--ring 65536] [--overflow drop-lowest|sample|spill]
+//                            [--overflow-capacity 4096] [--sample-every 10]
+//                            [--spill-file path] [--threads 1]
+//                            [--snapshot state.bin] [--snapshot-every-ms 60000]
+//
+//   GET  /health    {"status":"ok"}
+//   GET  /stats     request, line and action counts plus engine state sizes
+//   POST /filter    {"channel_id", "lines": [...], "now"?, "config"?, "pipeline"?}
+//                   -> {"results": [...]}; "pipeline": true also applies the
+//                   rate limit per line, as runPipeline() does
+//   POST /webhook   a handleWebhook() body (services/webhookHandler.deluge)
+//                   plus "now" and "config" -> the filtered stream: total,
+//                   suppressed (sampled of them by the adaptive sampler),
+//                   top_k, heap and levelCounts
+//   POST /ingest    {"channel_id", "lines" or "logs", "now"?, "config"?} -> 202
+//                   {accepted, overflowed, dropped, retry_after_ms?}; the lines
+//                   are queued and filtered in the background (ingest.h)
+//   POST /outbox    {"channel_id"} -> {"results", "dropped"}: ingested lines
+//                   that would be posted (each with its digest), and
+//                   suppressed ones carrying the overflow digest, oldest first
+//   POST /snapshot  {} -> {channels, written, bytes, compacted}: saves the
+//                   engine's state to the --snapshot file now
+//
+// /webhook does the per-log work of handleWebhook() (webhookLine, processLine,
+// topKPush) and leaves the rate limit, formatting and posting to the caller,
+// so the extension forwards large payloads here and posts the same summary it
+// would have built itself. Filter state for forwarded channels lives in the
+// sidecar. Requests are served on their own threads and share one engine
+// under a mutex. /ingest never takes it: receivers only touch the ingest
+// ring, whose consumer filters under the mutex.
+//
+// With --snapshot, filter state survives restarts: the file is loaded at
+// startup if it exists (only its index is read; channels decode on first
+// use) and saved every --snapshot-every-ms, each save appending just the
+// channels used since the last one (Engine::saveSnapshot()).
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include <unistd.h>
+
+#include "http.h"
+#include "ingest.h"
+#include "neurafilter/json.h"
+#include "neurafilter/neurafilter.h"
+
+using neurafilter::Action;
+using neurafilter::Engine;
+using neurafilter::FilterConfig;
+using neurafilter::Reason;
+using neurafilter::Result;
+using neurafilter::RunOptions;
+using neurafilter::json::Value;
+using neurafilter::sidecar::Admission;
+using neurafilter::sidecar::Ingest;
+using neurafilter::sidecar::IngestItem;
+using neurafilter::sidecar::IngestOptions;
+namespace http = neurafilter::http;
+
+namespace {
+
+constexpr size_t kMaxBodyBytes = 64 * 1024 * 1024;
+constexpr size_t kMaxConnections = 256;   // served at once; more get a 503
+constexpr size_t kOutboxLimit = 1000;  // per channel; the oldest go first
+constexpr size_t kMaxTopK = 65535;     // webhookMaxTopK in services/webhookHandler.deluge
+
+int64_t wallClock() {
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+}
+
+struct Outbox {
+    std::deque<Value> results;
+    uint64_t dropped = 0;
+};
+
+struct Sidecar {
+    Engine engine;
+    std::mutex lock;   // engine and the counts below
+    std::atomic<uint64_t> requests{0};
+    uint64_t lines = 0;
+    uint64_t actions[3] = {0, 0, 0};  // pass, highlight, suppress
+    uint64_t rateLimited = 0;
+
+    std::mutex outboxLock;
+    std::unordered_map<std::string, Outbox> outboxes;
+    std::unique_ptr<Ingest> ingest;
+
+    std::string snapshotPath;      // empty: no snapshots
+    uint64_t snapshotSaves = 0;    // under lock
+    Value lastSnapshot;
+
+    explicit Sidecar(neurafilter::ScoringRules rules) : engine(std::move(rules)) {}
+};
+
+Value resultJson(const Result& result) {
+    Value object = Value::object();
+    object["action"] = neurafilter::actionName(result.action);
+    object["reason"] = neurafilter::reasonName(result.reason);
+    object["message"] = result.message;
+    object["score"] = result.score;
+    if (result.hasTimestamp) object["timestamp"] = result.timestamp;
+    if (result.queued >= 0) object["queued"] = result.queued == 1;
+    if (result.hasDigest) {
+        Value digest = Value::array();
+        for (const auto& queued : result.digest) {
+            Value item = Value::object();
+            item["action"] = neurafilter::actionName(queued.action);
+            item["reason"] = neurafilter::reasonName(queued.reason);
+            item["message"] = queued.message;
+            item["score"] = queued.score;
+            item["timestamp"] = queued.timestamp;
+            digest.push(std::move(item));
+        }
+        object["digest"] = std::move(digest);
+    }
+    if (result.sampled > 0) {
+        Value sampling = Value::object();
+        sampling["sampled"] = result.sampled;
+        sampling["rate"] = result.sampleRate;
+        object["sampling"] = std::move(sampling);
+    }
+    return object;
+}
+
+// Deluge's toString() of a log field
+std::string fieldText(const Value& value) {
+    if (value.isString()) return value.asString();
+    if (value.isNumber()) {
+        std::string text;
+        neurafilter::json::appendNumber(text, value.asNumber());
+        return text;
+    }
+    return value.dump();
+}
+
+// webhookLine(): "LEVEL timestamp message"
+std::string webhookLine(const Value& log) {
+    std::string line;
+    const Value* level = log.find("level");
+    const Value* timestamp = log.find("timestamp");
+    const Value* message = log.find("message");
+    if (level != nullptr && !level->isNull()) line = fieldText(*level) + " ";
+    if (timestamp != nullptr && !timestamp->isNull()) line += fieldText(*timestamp) + " ";
+    line += message != nullptr ? fieldText(*message) : "null";
+    return line;
+}
+
+struct HeapItem {
+    Value result;
+    double score;
+};
+
+// topKPush(): min-heap on score, same sift order as the Deluge version
+void topKPush(std::vector<HeapItem>& heap, HeapItem item, size_t k) {
+    if (heap.size() < k) {
+        heap.push_back(std::move(item));
+        size_t i = heap.size() - 1;
+        while (i > 0) {
+            size_t parent = (i - 1) / 2;
+            if (!(heap[parent].score > heap[i].score)) break;
+            std::swap(heap[parent], heap[i]);
+            i = parent;
+        }
+        return;
+    }
+    if (item.score <= heap[0].score) return;
+    heap[0] = std::move(item);
+    size_t i = 0;
+    for (;;) {
+        size_t smallest = i;
+        size_t left = 2 * i + 1;
+        size_t right = left + 1;
+        if (left < k && heap[left].score < heap[smallest].score) smallest = left;
+        if (right < k && heap[right].score < heap[smallest].score) smallest = right;
+        if (smallest == i) break;
+        std::swap(heap[i], heap[smallest]);
+        i = smallest;
+    }
+}
+
+struct RequestContext {
+    std::string channel = "local";
+    int64_t now;
+    FilterConfig config;
+};
+
+RequestContext requestContext(const Value& body, const Engine& engine) {
+    RequestContext context;
+    if (const Value* channel = body.find("channel_id"); channel && channel->isString()) context.channel = channel->asString();
+    context.now = wallClock();
+    if (const Value* now = body.find("now"); now && now->isNumber()) context.now = static_cast<int64_t>(now->asNumber());
+    context.config = engine.defaultConfig();
+    if (const Value* config = body.find("config")) context.config = FilterConfig::fromJson(*config, context.config);
+    return context;
+}
+
+http::Response handleFilter(Sidecar& sidecar, const Value& body) {
+    const Value* lines = body.find("lines");
+    if (lines == nullptr || !lines->isArray()) return {400, "application/json", "{\"error\":\"lines must be an array\"}"};
+    const Value* mode = body.find("pipeline");
+    bool pipeline = mode != nullptr && mode->isBool() && mode->asBool();
+
+    std::lock_guard<std::mutex> guard(sidecar.lock);
+    RequestContext context = requestContext(body, sidecar.engine);
+    RunOptions options;
+    options.now = context.now;
+    options.channel = context.channel;
+    options.config = &context.config;
+
+    Value results = Value::array();
+    for (const Value& line : lines->items()) {
+        std::string text = fieldText(line);
+        Result result = pipeline ? sidecar.engine.runLine(text, options) : sidecar.engine.filterLine(text, options);
+        sidecar.actions[static_cast<int>(result.action)]++;
+        if (result.rateLimited) sidecar.rateLimited++;
+        results.push(resultJson(result));
+    }
+    sidecar.lines += lines->items().size();
+
+    Value response = Value::object();
+    response["results"] = std::move(results);
+    return {200, "application/json", response.dump()};
+}
+
+http::Response handleWebhook(Sidecar& sidecar, const Value& body) {
+    std::vector<Value> parsed;
+    const Value* items = body.find("logs");
+    if (items == nullptr || !items->isArray()) {
+        const Value* ndjson = body.find("ndjson");
+        if (ndjson == nullptr || !ndjson->isString())
+            return {400, "application/json", "{\"error\":\"logs or ndjson required\"}"};
+        const std::string& text = ndjson->asString();
+        for (size_t at = 0; at <= text.size();) {
+            size_t end = text.find('\n', at);
+            if (end == std::string::npos) end = text.size();
+            std::string_view line(text.data() + at, end - at);
+            size_t first = line.find_first_not_of(" \t\r");
+            // Blank lines keep their index so offsets match the Deluge handler
+            parsed.push_back(first == std::string_view::npos ? Value() : neurafilter::json::parse(line));
+            at = end + 1;
+        }
+    }
+    const std::vector<Value>& logs = items != nullptr && items->isArray() ? items->items() : parsed;
+
+    size_t k = 10;
+    if (const Value* topK = body.find("top_k"); topK && topK->isNumber() && topK->asNumber() > 0)
+        k = static_cast<size_t>(std::clamp<double>(topK->asNumber(), 1, kMaxTopK));
+    size_t offset = 0;
+    if (const Value* first = body.find("offset"); first && first->isNumber() && first->asNumber() > 0)
+        offset = static_cast<size_t>(first->asNumber());
+
+    std::vector<HeapItem> heap;
+    Value levelCounts = Value::object();
+    size_t total = 0;
+    size_t suppressed = 0;
+    size_t sampled = 0;
+    {
+        std::lock_guard<std::mutex> guard(sidecar.lock);
+        RequestContext context = requestContext(body, sidecar.engine);
+        RunOptions options;
+        options.now = context.now;
+        options.channel = context.channel;
+        options.config = &context.config;
+
+        for (size_t i = offset; i < logs.size(); i++) {
+            const Value& log = logs[i];
+            if (!log.isObject()) continue;
+            total++;
+            std::string line = webhookLine(log);
+            Result result = sidecar.engine.filterLine(line, options);
+            sidecar.actions[static_cast<int>(result.action)]++;
+            if (result.action == Action::Suppress) {
+                suppressed++;
+                if (result.reason == Reason::Sampled) sampled++;
+                continue;
+            }
+            const Value* level = log.find("level");
+            std::string levelKey = level != nullptr && !level->isNull() ? fieldText(*level) : "null";
+            Value item = resultJson(result);
+            item["level"] = level != nullptr ? *level : Value();
+            topKPush(heap, {std::move(item), result.score}, k);
+            Value& count = levelCounts[levelKey];
+            count = count.isNumber() ? count.asNumber() + 1 : 1.0;
+        }
+        sidecar.lines += total;
+    }
+
+    Value response = Value::object();
+    response["status"] = "done";
+    response["total"] = total;
+    response["suppressed"] = suppressed;
+    response["sampled"] = sampled;
+    response["top_k"] = k;
+    Value heapJson = Value::array();
+    for (HeapItem& item : heap) heapJson.push(std::move(item.result));
+    response["heap"] = std::move(heapJson);
+    response["levelCounts"] = std::move(levelCounts);
+    return {200, "application/json", response.dump()};
+}
+
+// Consumer side of /ingest, with sidecar.lock held
+void deliverIngested(Sidecar& sidecar, const IngestItem& item, const Result& result) {
+    sidecar.lines++;
+    sidecar.actions[static_cast<int>(result.action)]++;
+    if (result.rateLimited) sidecar.rateLimited++;
+    // Suppressed lines only when they carry the overflow queue out
+    if (result.action == Action::Suppress && result.digest.empty()) return;
+    Value json = resultJson(result);
+    std::lock_guard<std::mutex> guard(sidecar.outboxLock);
+    Outbox& outbox = sidecar.outboxes[item.channel];
+    outbox.results.push_back(std::move(json));
+    if (outbox.results.size() > kOutboxLimit) {
+        outbox.results.pop_front();
+        outbox.dropped++;
+    }
+}
+
+http::Response handleIngest(Sidecar& sidecar, const Value& body) {
+    const Value* lines = body.find("lines");
+    const Value* logs = body.find("logs");
+    if ((lines == nullptr || !lines->isArray()) && (logs == nullptr || !logs->isArray()))
+        return {400, "application/json", "{\"error\":\"lines or logs must be an array\"}"};
+    RequestContext context = requestContext(body, sidecar.engine);
+    std::shared_ptr<const FilterConfig> config;
+    if (body.find("config") != nullptr) config = std::make_shared<const FilterConfig>(context.config);
+
+    std::vector<IngestItem> items;
+    auto add = [&](std::string line) {
+        IngestItem item;
+        item.channel = context.channel;
+        item.line = std::move(line);
+        item.now = context.now;
+        item.config = config;
+        items.push_back(std::move(item));
+    };
+    if (lines != nullptr && lines->isArray()) {
+        for (const Value& line : lines->items()) add(fieldText(line));
+    } else {
+        for (const Value& log : logs->items())
+            if (log.isObject()) add(webhookLine(log));
+    }
+    Admission admission = sidecar.ingest->push(items);
+
+    Value response = Value::object();
+    response["status"] = "accepted";
+    response["accepted"] = admission.accepted;
+    response["overflowed"] = admission.overflowed;
+    response["dropped"] = admission.dropped;
+    if (admission.retryAfterMs > 0) response["retry_after_ms"] = admission.retryAfterMs;
+    return {202, "application/json", response.dump()};
+}
+
+http::Response handleOutbox(Sidecar& sidecar, const Value& body) {
+    std::string channel = "local";
+    if (const Value* id = body.find("channel_id"); id && id->isString()) channel = id->asString();
+    Outbox outbox;
+    {
+        std::lock_guard<std::mutex> guard(sidecar.outboxLock);
+        auto found = sidecar.outboxes.find(channel);
+        if (found != sidecar.outboxes.end()) {
+            outbox = std::move(found->second);
+            sidecar.outboxes.erase(found);
+        }
+    }
+    Value results = Value::array();
+    for (Value& result : outbox.results) results.push(std::move(result));
+    Value response = Value::object();
+    response["results"] = std::move(results);
+    response["dropped"] = static_cast<int64_t>(outbox.dropped);
+    return {200, "application/json", response.dump()};
+}
+
+// Caller holds sidecar.lock
+Value saveSnapshot(Sidecar& sidecar) {
+    neurafilter::SnapshotStats saved = sidecar.engine.saveSnapshot(sidecar.snapshotPath);
+    Value stats = Value::object();
+    stats["channels"] = saved.channels;
+    stats["written"] = saved.written;
+    stats["bytes"] = static_cast<int64_t>(saved.bytes);
+    stats["compacted"] = saved.compacted;
+    sidecar.snapshotSaves++;
+    sidecar.lastSnapshot = stats;
+    return stats;
+}
+
+http::Response handleSnapshot(Sidecar& sidecar) {
+    if (sidecar.snapshotPath.empty()) return {400, "application/json", "{\"error\":\"started without --snapshot\"}"};
+    std::lock_guard<std::mutex> guard(sidecar.lock);
+    try {
+        return {200, "application/json", saveSnapshot(sidecar).dump()};
+    } catch (const std::exception& error) {
+        Value message = Value::object();
+        message["error"] = error.what();
+        return {500, "application/json", message.dump()};
+    }
+}
+
+// Saves every interval until destroyed
+class SnapshotTimer {
+public:
+    SnapshotTimer(Sidecar& sidecar, std::chrono::milliseconds interval)
+        : sidecar_(sidecar), interval_(interval), thread_([this] { run(); }) {}
+    ~SnapshotTimer() {
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            stopping_ = true;
+        }
+        wake_.notify_one();
+        thread_.join();
+    }
+
+private:
+    void run() {
+        std::unique_lock<std::mutex> wait(lock_);
+        while (!wake_.wait_for(wait, interval_, [this] { return stopping_; })) {
+            std::lock_guard<std::mutex> guard(sidecar_.lock);
+            try {
+                saveSnapshot(sidecar_);
+            } catch (const std::exception& error) {
+                std::fprintf(stderr, "neurafilter-sidecar: snapshot: %s\n", error.what());
+            }
+        }
+    }
+
+    Sidecar& sidecar_;
+    std::chrono::milliseconds interval_;
+    std::mutex lock_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+    std::thread thread_;
+};
+
+http::Response handleStats(Sidecar& sidecar) {
+    std::lock_guard<std::mutex> guard(sidecar.lock);
+    neurafilter::StateSizes sizes = sidecar.engine.stateSizes();
+    Value stats = Value::object();
+    stats["requests"] = static_cast<int64_t>(sidecar.requests.load());
+    stats["lines"] = static_cast<int64_t>(sidecar.lines);
+    Value actions = Value::object();
+    actions["pass"] = static_cast<int64_t>(sidecar.actions[0]);
+    actions["highlight"] = static_cast<int64_t>(sidecar.actions[1]);
+    actions["suppress"] = static_cast<int64_t>(sidecar.actions[2]);
+    actions["rate_limited"] = static_cast<int64_t>(sidecar.rateLimited);
+    stats["actions"] = std::move(actions);
+    Value state = Value::object();
+    state["shards"] = sizes.shards;
+    state["entryMap"] = sizes.entryMap;
+    state["templateCache"] = sizes.templateCache;
+    state["templates"] = sizes.templates;
+    state["queued"] = sizes.queued;
+    state["counterDeltas"] = sizes.counterDeltas;
+    state["sketches"] = sizes.sketches;
+    stats["state"] = std::move(state);
+    stats["simd"] = neurafilter::simdKernel();
+    stats["ingest"] = sidecar.ingest->stats();
+    if (!sidecar.snapshotPath.empty()) {
+        Value snapshot = Value::object();
+        snapshot["path"] = sidecar.snapshotPath;
+        snapshot["saves"] = static_cast<int64_t>(sidecar.snapshotSaves);
+        snapshot["last"] = sidecar.lastSnapshot;
+        stats["snapshot"] = std::move(snapshot);
+    }
+    return {200, "application/json", stats.dump()};
+}
+
+http::Response route(Sidecar& sidecar, const http::Request& request) {
+    sidecar.requests++;
+    if (request.path == "/health") return {200, "application/json", "{\"status\":\"ok\"}"};
+    if (request.path == "/stats") return handleStats(sidecar);
+    if (request.path != "/filter" && request.path != "/webhook" && request.path != "/ingest" && request.path != "/outbox" &&
+        request.path != "/snapshot")
+        return {404, "application/json", "{\"error\":\"not found\"}"};
+    if (request.method != "POST") return {405, "application/json", "{\"error\":\"POST only\"}"};
+    if (request.path == "/snapshot") return handleSnapshot(sidecar);
+
+    Value body;
+    try {
+        body = neurafilter::json::parse(request.body);
+    } catch (const neurafilter::json::Error& error) {
+        Value message = Value::object();
+        message["error"] = std::string("bad json: ") + error.what();
+        return {400, "application/json", message.dump()};
+    }
+    if (!body.isObject()) return {400, "application/json", "{\"error\":\"body must be an object\"}"};
+    if (request.path == "/ingest") return handleIngest(sidecar, body);
+    if (request.path == "/outbox") return handleOutbox(sidecar, body);
+    return request.path == "/filter" ? handleFilter(sidecar, body) : handleWebhook(sidecar, body);
+}
+
+void usage() {
+    std::fprintf(stderr,
+                 "usage: neurafilter-sidecar [--host 127.0.0.1] [--port 8787] [--rules file.deluge]\n"
+                 "                           [--ring 65536] [--overflow drop-lowest|sample|spill]\n"
+                 "                           [--overflow-capacity 4096] [--sample-every 10]\n"
+                 "                           [--spill-file path] [--threads 1]\n"
+                 "                           [--snapshot state.bin] [--snapshot-every-ms 60000]\n");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    std::string host = "127.0.0.1";
+    int port = 8787;
+    std::string rulesPath;
+    IngestOptions ingestOptions;
+    std::string snapshotPath;
+    long snapshotEveryMs = 60000;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            usage();
+            return 2;
+        }
+        if (arg == "--host") host = argv[++i];
+        else if (arg == "--port") port = std::atoi(argv[++i]);
+        else if (arg == "--rules") rulesPath = argv[++i];
+        else if (arg == "--ring") ingestOptions.ringCapacity = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--overflow-capacity") ingestOptions.overflowCapacity = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--sample-every") ingestOptions.sampleEvery = static_cast<unsigned>(std::atoi(argv[++i]));
+        else if (arg == "--spill-file") ingestOptions.spillPath = argv[++i];
+        else if (arg == "--threads") ingestOptions.parallel.threads = static_cast<unsigned>(std::atoi(argv[++i]));
+        else if (arg == "--snapshot") snapshotPath = argv[++i];
+        else if (arg == "--snapshot-every-ms") snapshotEveryMs = std::atol(argv[++i]);
+        else if (arg != "--overflow" || !neurafilter::sidecar::parseOverflowPolicy(argv[++i], ingestOptions.policy)) {
+            usage();
+            return 2;
+        }
+    }
+
+    try {
+        neurafilter::ScoringRules rules =
+            rulesPath.empty() ? neurafilter::ScoringRules::defaults() : neurafilter::ScoringRules::fromDelugeFile(rulesPath);
+        Sidecar sidecar(std::move(rules));
+        sidecar.snapshotPath = snapshotPath;
+        if (!snapshotPath.empty() && ::access(snapshotPath.c_str(), F_OK) == 0) {
+            size_t channels = sidecar.engine.loadSnapshot(snapshotPath);
+            std::fprintf(stderr, "neurafilter-sidecar: loaded %zu channels from %s\n", channels, snapshotPath.c_str());
+        }
+        sidecar.ingest = std::make_unique<Ingest>(
+            sidecar.engine, sidecar.lock, ingestOptions,
+            [&sidecar](const IngestItem& item, const Result& result) { deliverIngested(sidecar, item, result); });
+        std::unique_ptr<SnapshotTimer> snapshots;
+        if (!snapshotPath.empty() && snapshotEveryMs > 0)
+            snapshots = std::make_unique<SnapshotTimer>(sidecar, std::chrono::milliseconds(snapshotEveryMs));
+        http::Server server(host, port, kMaxBodyBytes, kMaxConnections);
+        std::printf("listening on %d\n", server.port());
+        std::fflush(stdout);
+        server.serve([&sidecar](const http::Request& request) { return route(sidecar, request); });
+    } catch (const std::exception& error) {
+        std::fprintf(stderr, "neurafilter-sidecar: %s\n", error.what());
+        return 1;
+    }
+    return 0;
+}
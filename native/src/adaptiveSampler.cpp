@@ -0,0 +1,51 @@
+// Mirrors utils/adaptiveSampler.deluge (and the harness sampler): low-score
+// lines are kept at the sampler's rate while it is active, or always at
+// sample_min_rate with sample_mode on, by accruing the rate as credit.
+// ERROR, WARN and keyword lines are always kept.
+#include <algorithm>
+#include <string_view>
+
+#include "stages.h"
+
+namespace neurafilter {
+
+namespace {
+
+constexpr std::string_view kSamplerExemptLevels[] = {"ERROR", "WARN"};
+
+}  // namespace
+
+bool samplerKeeps(AdaptiveSampler& sampler, const LineMatch& match, const FilterConfig& config) {
+    if (config.sampleMode == SampleMode::On) sampler.rate = config.sampleMinRate;
+    else if (!sampler.active) return true;
+    if (match.keyword) return true;
+    for (std::string_view level : kSamplerExemptLevels)
+        if (match.level == level) return true;
+    if (match.score >= config.sampleMinScore) return true;
+
+    double credit = sampler.credit + sampler.rate;
+    if (credit >= 1) {
+        sampler.credit = credit - 1;
+        return true;
+    }
+    sampler.credit = credit;
+    sampler.sampled++;
+    return false;
+}
+
+void recordLineLatency(AdaptiveSampler& sampler, double elapsedMs, const FilterConfig& config) {
+    sampler.ewma += kSamplerSmoothing * (elapsedMs - sampler.ewma);
+    if (config.sampleMode != SampleMode::Auto) return;
+
+    double threshold = config.sampleLatencyMs;
+    if (!sampler.active && sampler.ewma > threshold) {
+        sampler.active = true;
+        sampler.credit = 0;
+    } else if (sampler.active && sampler.ewma < threshold * kSamplerExitRatio) {
+        sampler.active = false;
+    }
+    if (sampler.active)
+        sampler.rate = std::max(config.sampleMinRate, std::min(1.0, threshold * kSamplerExitRatio / sampler.ewma));
+}
+
+}  // namespace neurafilter
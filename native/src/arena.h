@@ -0,0 +1,115 @@
+// Bump allocator for per-call strings (masked lines, template shapes)
+//
+// Everything a call produces is released at once by reset(), which keeps the
+// first block, so a steady stream stops allocating after its first batch.
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace neurafilter {
+
+class Arena {
+public:
+    explicit Arena(size_t blockSize = 64 * 1024) : blockSize_(blockSize) {}
+
+    char* allocate(size_t size) {
+        if (blocks_.empty() || used_ + size > capacity_) grow(size);
+        char* out = blocks_[current_].get() + used_;
+        used_ += size;
+        return out;
+    }
+
+    std::string_view copy(std::string_view text) {
+        if (text.empty()) return {};
+        char* out = allocate(text.size());
+        std::memcpy(out, text.data(), text.size());
+        return {out, text.size()};
+    }
+
+    // Builds a string in place: append() as often as needed, then finish().
+    // Only one builder may be open at a time, and nothing else may allocate
+    // from the arena while it is.
+    class Builder {
+    public:
+        explicit Builder(Arena& arena) : arena_(arena) {}
+        void append(std::string_view text) {
+            reserve(text.size());
+            std::memcpy(data_ + size_, text.data(), text.size());
+            size_ += text.size();
+        }
+        void push(char c) {
+            reserve(1);
+            data_[size_++] = c;
+        }
+        size_t size() const { return size_; }
+        std::string_view finish() {
+            arena_.used_ += size_;
+            std::string_view out(data_, size_);
+            data_ = nullptr;
+            size_ = capacity_ = 0;
+            return out;
+        }
+
+    private:
+        void reserve(size_t extra) {
+            if (size_ + extra <= capacity_) return;
+            size_t want = (size_ + extra) * 2;
+            if (arena_.blocks_.empty() || arena_.used_ + want > arena_.capacity_) {
+                char* old = data_;
+                arena_.grow(want);
+                if (size_ > 0) std::memcpy(arena_.blocks_[arena_.current_].get() + arena_.used_, old, size_);
+            }
+            data_ = arena_.blocks_[arena_.current_].get() + arena_.used_;
+            capacity_ = arena_.capacity_ - arena_.used_;
+        }
+
+        Arena& arena_;
+        char* data_ = nullptr;
+        size_t size_ = 0;
+        size_t capacity_ = 0;
+    };
+
+    void reset() {
+        if (blocks_.size() > 1) {
+            // Keep one block, sized for the whole of the last call
+            size_t total = 0;
+            for (size_t size : sizes_) total += size;
+            blocks_.clear();
+            sizes_.clear();
+            blocks_.emplace_back(new char[total]);
+            sizes_.push_back(total);
+        }
+        current_ = 0;
+        used_ = 0;
+        capacity_ = sizes_.empty() ? 0 : sizes_[0];
+    }
+
+    size_t bytesReserved() const {
+        size_t total = 0;
+        for (size_t size : sizes_) total += size;
+        return total;
+    }
+
+private:
+    void grow(size_t atLeast) {
+        size_t size = atLeast > blockSize_ ? atLeast : blockSize_;
+        blocks_.emplace_back(new char[size]);
+        sizes_.push_back(size);
+        current_ = blocks_.size() - 1;
+        used_ = 0;
+        capacity_ = size;
+    }
+
+    size_t blockSize_;
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    std::vector<size_t> sizes_;
+    size_t current_ = 0;
+    size_t used_ = 0;
+    size_t capacity_ = 0;
+};
+
+}  // namespace neurafilter
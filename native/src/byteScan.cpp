@@ -0,0 +1,118 @@
+// byteScan.h: byte sets, the scalar kernel and runtime kernel selection
+#include <atomic>
+#include <cstdlib>
+
+#define NF_SCAN_TARGET
+#include "byteScanBlocks.h"
+
+namespace neurafilter {
+
+namespace {
+
+size_t scalarFindEntry(const ByteSetTables& set, const char* data, size_t size, size_t from) {
+    return scalarFind(set, data, size, from);
+}
+
+size_t scalarFindPairEntry(const PairSetTables& set, const char* data, size_t size, size_t from) {
+    return scalarFindPair(set, data, size, from);
+}
+
+MaskTriggers scalarTriggersEntry(const char* data, size_t size) {
+    MaskTriggers out;
+    scalarTriggers(data, size, 0, out);
+    return out;
+}
+
+const ByteScanKernel kScalar = {"scalar", scalarFindEntry, scalarFindPairEntry, scalarTriggersEntry};
+
+bool cpuHas(const ByteScanKernel* kernel) {
+    if (kernel == nullptr) return false;
+#if defined(__x86_64__) || defined(__i386__)
+    if (kernel == avx2ByteScan()) return __builtin_cpu_supports("avx2");
+    if (kernel == sse42ByteScan()) return __builtin_cpu_supports("sse4.2");
+#endif
+    return true;
+}
+
+const ByteScanKernel* byName(std::string_view name) {
+    for (const ByteScanKernel* kernel : {avx2ByteScan(), sse42ByteScan(), neonByteScan(), scalarByteScan()})
+        if (kernel != nullptr && name == kernel->name) return kernel;
+    return nullptr;
+}
+
+// Widest kernel the CPU runs, unless NEURAFILTER_SIMD names another
+const ByteScanKernel* detect() {
+    if (const char* forced = std::getenv("NEURAFILTER_SIMD")) {
+        const ByteScanKernel* kernel = byName(forced);
+        if (cpuHas(kernel)) return kernel;
+    }
+    for (const ByteScanKernel* kernel : {avx2ByteScan(), sse42ByteScan(), neonByteScan()})
+        if (cpuHas(kernel)) return kernel;
+    return scalarByteScan();
+}
+
+std::atomic<const ByteScanKernel*>& active() {
+    static std::atomic<const ByteScanKernel*> kernel{detect()};
+    return kernel;
+}
+
+inline const ByteScanKernel* current() { return active().load(std::memory_order_relaxed); }
+
+}  // namespace
+
+const ByteScanKernel* scalarByteScan() { return &kScalar; }
+
+ByteSet::ByteSet(std::string_view members) {
+    for (char c : members) add(static_cast<unsigned char>(c));
+}
+
+void ByteSet::add(unsigned char c) {
+    tables_.member[c] = true;
+    if (c >= 0x80) {
+        tables_.anyHigh = true;
+        return;
+    }
+    tables_.lo[c & 15] |= static_cast<uint8_t>(1u << (c >> 4));
+    tables_.hi[c >> 4] = static_cast<uint8_t>(1u << (c >> 4));
+}
+
+size_t ByteSet::find(std::string_view text, size_t from) const {
+    return current()->find(tables_, text.data(), text.size(), from);
+}
+
+void PairSet::add(unsigned char first, unsigned char second, unsigned bucket) {
+    uint8_t bit = static_cast<uint8_t>(1u << (bucket & 7));
+    tables_.lo0[first & 15] |= bit;
+    tables_.hi0[first >> 4] |= bit;
+    tables_.lo1[second & 15] |= bit;
+    tables_.hi1[second >> 4] |= bit;
+}
+
+void PairSet::addSingle(unsigned char first, unsigned bucket) {
+    uint8_t bit = static_cast<uint8_t>(1u << (bucket & 7));
+    tables_.lo0[first & 15] |= bit;
+    tables_.hi0[first >> 4] |= bit;
+    for (int nibble = 0; nibble < 16; nibble++) {
+        tables_.lo1[nibble] |= bit;
+        tables_.hi1[nibble] |= bit;
+    }
+}
+
+size_t PairSet::find(std::string_view text, size_t from) const {
+    return current()->findPair(tables_, text.data(), text.size(), from);
+}
+
+MaskTriggers scanMaskTriggers(std::string_view text) { return current()->maskTriggers(text.data(), text.size()); }
+
+const char* byteScanKernel() { return current()->name; }
+
+const char* simdKernel() { return byteScanKernel(); }
+
+bool selectByteScanKernel(std::string_view name) {
+    const ByteScanKernel* kernel = byName(name);
+    if (!cpuHas(kernel)) return false;
+    active().store(kernel, std::memory_order_relaxed);
+    return true;
+}
+
+}  // namespace neurafilter
@@ -0,0 +1,94 @@
+// Vectorized first-pass scans for the exact matchers
+//
+// Most lines carry nothing to mask and only a level word to score, so the
+// matchers in maskSensitive.cpp and scoringRules.cpp first find candidate
+// bytes 16 or 32 at a time and only look closely where there are some. The
+// kernel (AVX2, SSE4.2, NEON or scalar) is picked once at startup from what
+// the CPU supports, so one binary runs everywhere; NEURAFILTER_SIMD=scalar
+// (or sse4.2, avx2) forces a narrower one. Every kernel gives the same
+// answers as the scalar loops.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace neurafilter {
+
+// Nibble tables of a byte set, the form the vector kernels test against:
+// byte c is a member iff lo[c & 15] & hi[c >> 4], for c < 0x80. Members at
+// or above 0x80 are found through member[] (every such byte is a candidate).
+struct ByteSetTables {
+    alignas(16) uint8_t lo[16] = {};
+    alignas(16) uint8_t hi[16] = {};
+    bool member[256] = {};
+    bool anyHigh = false;
+};
+
+class ByteSet {
+public:
+    ByteSet() = default;
+    explicit ByteSet(std::string_view members);
+    void add(unsigned char c);
+
+    bool contains(unsigned char c) const { return tables_.member[c]; }
+    // First i >= from with text[i] in the set, or text.size()
+    size_t find(std::string_view text, size_t from = 0) const;
+
+private:
+    ByteSetTables tables_;
+};
+
+// Two-byte prefixes of patterns, in up to 8 buckets: position i is a
+// candidate iff bucket bits of s[i] in the first table and of s[i + 1] in
+// the second share a bit (nibble tables, so candidates are a superset)
+struct PairSetTables {
+    alignas(16) uint8_t lo0[16] = {};
+    alignas(16) uint8_t hi0[16] = {};
+    alignas(16) uint8_t lo1[16] = {};
+    alignas(16) uint8_t hi1[16] = {};
+};
+
+class PairSet {
+public:
+    // Prefix first, second in bucket (0-7); a one-byte pattern takes any second byte
+    void add(unsigned char first, unsigned char second, unsigned bucket);
+    void addSingle(unsigned char first, unsigned bucket);
+    // First candidate i >= from, or text.size(); the last byte of text is a
+    // candidate whenever it could start a prefix
+    size_t find(std::string_view text, size_t from = 0) const;
+
+private:
+    PairSetTables tables_;
+};
+
+// The pre-check of maskSensitive(): which rules can match at all
+struct MaskTriggers {
+    bool at = false;        // '@'
+    bool slash = false;     // '/'
+    bool digitDot = false;  // a digit, '.', a digit
+    bool token = false;     // "bearer" or "token", ASCII case-insensitive
+    bool any() const { return at || slash || digitDot || token; }
+};
+
+MaskTriggers scanMaskTriggers(std::string_view text);
+
+// Name of the kernel in use ("avx2", "sse4.2", "neon" or "scalar")
+const char* byteScanKernel();
+// Switch to a kernel by name if the CPU has it; false otherwise
+bool selectByteScanKernel(std::string_view name);
+
+// One kernel's entry points (byteScan*.cpp)
+struct ByteScanKernel {
+    const char* name;
+    size_t (*find)(const ByteSetTables& set, const char* data, size_t size, size_t from);
+    size_t (*findPair)(const PairSetTables& set, const char* data, size_t size, size_t from);
+    MaskTriggers (*maskTriggers)(const char* data, size_t size);
+};
+
+const ByteScanKernel* scalarByteScan();
+const ByteScanKernel* sse42ByteScan();  // nullptr when not built for x86
+const ByteScanKernel* avx2ByteScan();
+const ByteScanKernel* neonByteScan();   // nullptr when not built for ARM64
+
+}  // namespace neurafilter
@@ -0,0 +1,60 @@
+// byteScan kernel for x86 CPUs with AVX2 (32 bytes per block)
+#include "byteScan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+#define NF_SCAN_TARGET __attribute__((target("avx2")))
+#include "byteScanX86.h"
+
+namespace neurafilter {
+
+namespace {
+
+struct Avx2 {
+    using V = __m256i;
+    static constexpr size_t kWidth = 32;
+    static constexpr uint32_t kAll = 0xffffffff;
+    NF_SCAN_TARGET static V load(const char* p) { return _mm256_loadu_si256(reinterpret_cast<const V*>(p)); }
+    // PSHUFB looks up within each 128-bit lane, so both lanes get the table
+    NF_SCAN_TARGET static V table(const uint8_t* t) {
+        return _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(t)));
+    }
+    NF_SCAN_TARGET static V splat(int c) { return _mm256_set1_epi8(static_cast<char>(c)); }
+    NF_SCAN_TARGET static V lookup(V t, V index) { return _mm256_shuffle_epi8(t, index); }
+    NF_SCAN_TARGET static V shiftNibble(V v) { return _mm256_srli_epi16(v, 4); }
+    NF_SCAN_TARGET static V bitAnd(V a, V b) { return _mm256_and_si256(a, b); }
+    NF_SCAN_TARGET static V bitOr(V a, V b) { return _mm256_or_si256(a, b); }
+    NF_SCAN_TARGET static V equal(V a, V b) { return _mm256_cmpeq_epi8(a, b); }
+    NF_SCAN_TARGET static V greater(V a, V b) { return _mm256_cmpgt_epi8(a, b); }
+    NF_SCAN_TARGET static uint32_t mask(V v) { return static_cast<uint32_t>(_mm256_movemask_epi8(v)); }
+};
+
+using Block = X86Block<Avx2>;
+
+NF_SCAN_TARGET size_t find(const ByteSetTables& set, const char* data, size_t size, size_t from) {
+    return blockFind<Block>(set, data, size, from);
+}
+
+NF_SCAN_TARGET size_t findPair(const PairSetTables& set, const char* data, size_t size, size_t from) {
+    return blockFindPair<Block>(set, data, size, from);
+}
+
+NF_SCAN_TARGET MaskTriggers maskTriggers(const char* data, size_t size) { return blockTriggers<Block>(data, size); }
+
+const ByteScanKernel kAvx2 = {"avx2", find, findPair, maskTriggers};
+
+}  // namespace
+
+const ByteScanKernel* avx2ByteScan() { return &kAvx2; }
+
+}  // namespace neurafilter
+
+#else
+
+namespace neurafilter {
+const ByteScanKernel* avx2ByteScan() { return nullptr; }
+}  // namespace neurafilter
+
+#endif
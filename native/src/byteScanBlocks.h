@@ -0,0 +1,124 @@
+// Block loops shared by the byteScan kernels
+//
+// Included by each kernel's .cpp after it defines NF_SCAN_TARGET (its
+// target attribute) and a Block type with:
+//   kWidth                                   bytes per block (16 or 32)
+//   uint32_t members(const ByteSetTables&, const char* p)
+//   uint32_t pairs(const PairSetTables&, const char* p)   reads kWidth + 1 bytes
+//   void triggers(const char* p, Triggers& out)
+// Kernels get their ISA from a target attribute on each function rather than
+// from compiler flags, and everything here has internal linkage, so no code
+// built for a wider ISA (inline library code included) can be picked up by
+// callers on a CPU without it.
+#pragma once
+
+#include "byteScan.h"
+
+namespace neurafilter {
+namespace {
+
+inline bool scanIsDigit(unsigned char c) { return c >= '0' && c <= '9'; }
+inline unsigned char scanFold(unsigned char c) { return c >= 'A' && c <= 'Z' ? c + 32 : c; }
+
+// Bit masks of one block, bit i for byte i
+struct Triggers {
+    uint32_t at, slash, dot, digit, tokenStart;  // tokenStart: b/B or t/T
+};
+
+inline bool foldedAt(const char* data, size_t size, size_t i, const char* word, size_t length) {
+    if (i + length > size) return false;
+    for (size_t j = 0; j < length; j++)
+        if (scanFold(static_cast<unsigned char>(data[i + j])) != static_cast<unsigned char>(word[j])) return false;
+    return true;
+}
+
+inline bool tokenAt(const char* data, size_t size, size_t i) {
+    unsigned char c = scanFold(static_cast<unsigned char>(data[i]));
+    return c == 'b' ? foldedAt(data, size, i, "bearer", 6) : c == 't' && foldedAt(data, size, i, "token", 5);
+}
+
+inline size_t scalarFind(const ByteSetTables& set, const char* data, size_t size, size_t from) {
+    for (size_t i = from; i < size; i++)
+        if (set.member[static_cast<unsigned char>(data[i])]) return i;
+    return size;
+}
+
+inline uint8_t pairBits(const uint8_t* lo, const uint8_t* hi, unsigned char c) { return lo[c & 15] & hi[c >> 4]; }
+
+inline size_t scalarFindPair(const PairSetTables& set, const char* data, size_t size, size_t from) {
+    for (size_t i = from; i < size; i++) {
+        uint8_t first = pairBits(set.lo0, set.hi0, static_cast<unsigned char>(data[i]));
+        if (first == 0) continue;
+        if (i + 1 == size || (first & pairBits(set.lo1, set.hi1, static_cast<unsigned char>(data[i + 1]))) != 0) return i;
+    }
+    return size;
+}
+
+// Bytes [from, size) one at a time, looking back and ahead in data as needed
+inline void scalarTriggers(const char* data, size_t size, size_t from, MaskTriggers& out) {
+    for (size_t i = from; i < size; i++) {
+        unsigned char c = static_cast<unsigned char>(data[i]);
+        if (c == '@') out.at = true;
+        else if (c == '/') out.slash = true;
+        else if (c == '.' && !out.digitDot && i > 0 && i + 1 < size &&
+                 scanIsDigit(static_cast<unsigned char>(data[i - 1])) && scanIsDigit(static_cast<unsigned char>(data[i + 1])))
+            out.digitDot = true;
+        else if (!out.token && tokenAt(data, size, i)) out.token = true;
+    }
+}
+
+template <typename Block>
+NF_SCAN_TARGET size_t blockFind(const ByteSetTables& set, const char* data, size_t size, size_t from) {
+    size_t i = from;
+    for (; i + Block::kWidth <= size; i += Block::kWidth) {
+        uint32_t mask = Block::members(set, data + i);
+        while (mask != 0) {
+            unsigned bit = static_cast<unsigned>(__builtin_ctz(mask));
+            // Bytes >= 0x80 are all candidates when the set has any
+            if (!set.anyHigh || set.member[static_cast<unsigned char>(data[i + bit])]) return i + bit;
+            mask &= mask - 1;
+        }
+    }
+    return scalarFind(set, data, size, i);
+}
+
+template <typename Block>
+NF_SCAN_TARGET size_t blockFindPair(const PairSetTables& set, const char* data, size_t size, size_t from) {
+    size_t i = from;
+    for (; i + Block::kWidth < size; i += Block::kWidth)
+        if (uint32_t mask = Block::pairs(set, data + i)) return i + static_cast<unsigned>(__builtin_ctz(mask));
+    return scalarFindPair(set, data, size, i);
+}
+
+template <typename Block>
+NF_SCAN_TARGET MaskTriggers blockTriggers(const char* data, size_t size) {
+    constexpr unsigned kLast = Block::kWidth - 1;
+    MaskTriggers out;
+    size_t i = 0;
+    for (; i + Block::kWidth <= size; i += Block::kWidth) {
+        Triggers block;
+        Block::triggers(data + i, block);
+        out.at |= block.at != 0;
+        out.slash |= block.slash != 0;
+        if (!out.digitDot && block.dot != 0) {
+            uint32_t before = (block.digit << 1) | (i > 0 && scanIsDigit(static_cast<unsigned char>(data[i - 1])));
+            uint32_t after = (block.digit >> 1) |
+                             (static_cast<uint32_t>(i + Block::kWidth < size &&
+                                                    scanIsDigit(static_cast<unsigned char>(data[i + Block::kWidth])))
+                              << kLast);
+            out.digitDot = (block.dot & before & after) != 0;
+        }
+        for (uint32_t starts = out.token ? 0 : block.tokenStart; starts != 0; starts &= starts - 1) {
+            if (tokenAt(data, size, i + static_cast<unsigned>(__builtin_ctz(starts)))) {
+                out.token = true;
+                break;
+            }
+        }
+        if (out.at && out.slash && out.digitDot && out.token) return out;
+    }
+    scalarTriggers(data, size, i, out);
+    return out;
+}
+
+}  // namespace
+}  // namespace neurafilter
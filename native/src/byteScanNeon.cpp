@@ -0,0 +1,81 @@
+// byteScan kernel for ARM64 (NEON is part of the base ISA, 16 bytes per block)
+#include "byteScan.h"
+
+#if defined(__aarch64__)
+
+#include <arm_neon.h>
+
+#define NF_SCAN_TARGET
+#include "byteScanBlocks.h"
+
+namespace neurafilter {
+
+namespace {
+
+// One bit per byte lane, like x86 PMOVMSKB; lanes are 0x00 or 0xff
+inline uint32_t laneMask(uint8x16_t lanes) {
+    static const uint8_t kBits[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+    uint8x16_t bits = vandq_u8(lanes, vld1q_u8(kBits));
+    return vaddv_u8(vget_low_u8(bits)) | (static_cast<uint32_t>(vaddv_u8(vget_high_u8(bits))) << 8);
+}
+
+struct NeonBlock {
+    static constexpr size_t kWidth = 16;
+
+    static uint32_t members(const ByteSetTables& set, const char* p) {
+        uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t*>(p));
+        uint8x16_t nibble = vdupq_n_u8(0x0f);
+        uint8x16_t low = vqtbl1q_u8(vld1q_u8(set.lo), vandq_u8(v, nibble));
+        uint8x16_t high = vqtbl1q_u8(vld1q_u8(set.hi), vshrq_n_u8(v, 4));
+        uint32_t mask = laneMask(vtstq_u8(low, high));
+        if (set.anyHigh) mask |= laneMask(vtstq_u8(v, vdupq_n_u8(0x80)));
+        return mask;
+    }
+
+    static uint8x16_t buckets(const uint8_t* lo, const uint8_t* hi, uint8x16_t v) {
+        return vandq_u8(vqtbl1q_u8(vld1q_u8(lo), vandq_u8(v, vdupq_n_u8(0x0f))), vqtbl1q_u8(vld1q_u8(hi), vshrq_n_u8(v, 4)));
+    }
+
+    static uint32_t pairs(const PairSetTables& set, const char* p) {
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(p);
+        uint8x16_t first = buckets(set.lo0, set.hi0, vld1q_u8(bytes));
+        uint8x16_t second = buckets(set.lo1, set.hi1, vld1q_u8(bytes + 1));
+        return laneMask(vtstq_u8(first, second));
+    }
+
+    static void triggers(const char* p, Triggers& out) {
+        uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t*>(p));
+        uint8x16_t folded = vorrq_u8(v, vdupq_n_u8(0x20));
+        out.at = laneMask(vceqq_u8(v, vdupq_n_u8('@')));
+        out.slash = laneMask(vceqq_u8(v, vdupq_n_u8('/')));
+        out.dot = laneMask(vceqq_u8(v, vdupq_n_u8('.')));
+        out.digit = laneMask(vcleq_u8(vsubq_u8(v, vdupq_n_u8('0')), vdupq_n_u8(9)));
+        out.tokenStart = laneMask(vorrq_u8(vceqq_u8(folded, vdupq_n_u8('b')), vceqq_u8(folded, vdupq_n_u8('t'))));
+    }
+};
+
+size_t find(const ByteSetTables& set, const char* data, size_t size, size_t from) {
+    return blockFind<NeonBlock>(set, data, size, from);
+}
+
+size_t findPair(const PairSetTables& set, const char* data, size_t size, size_t from) {
+    return blockFindPair<NeonBlock>(set, data, size, from);
+}
+
+MaskTriggers maskTriggers(const char* data, size_t size) { return blockTriggers<NeonBlock>(data, size); }
+
+const ByteScanKernel kNeon = {"neon", find, findPair, maskTriggers};
+
+}  // namespace
+
+const ByteScanKernel* neonByteScan() { return &kNeon; }
+
+}  // namespace neurafilter
+
+#else
+
+namespace neurafilter {
+const ByteScanKernel* neonByteScan() { return nullptr; }
+}  // namespace neurafilter
+
+#endif
@@ -0,0 +1,60 @@
+// byteScan kernel for x86 CPUs with SSE4.2 (16 bytes per block)
+//
+// Set membership is two PSHUFB nibble lookups: exact for any set of ASCII
+// bytes, unlike PCMPESTRM, which is slower and stops at 16 members.
+#include "byteScan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+#define NF_SCAN_TARGET __attribute__((target("sse4.2")))
+#include "byteScanX86.h"
+
+namespace neurafilter {
+
+namespace {
+
+struct Sse42 {
+    using V = __m128i;
+    static constexpr size_t kWidth = 16;
+    static constexpr uint32_t kAll = 0xffff;
+    NF_SCAN_TARGET static V load(const char* p) { return _mm_loadu_si128(reinterpret_cast<const V*>(p)); }
+    NF_SCAN_TARGET static V table(const uint8_t* t) { return _mm_load_si128(reinterpret_cast<const V*>(t)); }
+    NF_SCAN_TARGET static V splat(int c) { return _mm_set1_epi8(static_cast<char>(c)); }
+    NF_SCAN_TARGET static V lookup(V t, V index) { return _mm_shuffle_epi8(t, index); }
+    NF_SCAN_TARGET static V shiftNibble(V v) { return _mm_srli_epi16(v, 4); }
+    NF_SCAN_TARGET static V bitAnd(V a, V b) { return _mm_and_si128(a, b); }
+    NF_SCAN_TARGET static V bitOr(V a, V b) { return _mm_or_si128(a, b); }
+    NF_SCAN_TARGET static V equal(V a, V b) { return _mm_cmpeq_epi8(a, b); }
+    NF_SCAN_TARGET static V greater(V a, V b) { return _mm_cmpgt_epi8(a, b); }
+    NF_SCAN_TARGET static uint32_t mask(V v) { return static_cast<uint32_t>(_mm_movemask_epi8(v)); }
+};
+
+using Block = X86Block<Sse42>;
+
+NF_SCAN_TARGET size_t find(const ByteSetTables& set, const char* data, size_t size, size_t from) {
+    return blockFind<Block>(set, data, size, from);
+}
+
+NF_SCAN_TARGET size_t findPair(const PairSetTables& set, const char* data, size_t size, size_t from) {
+    return blockFindPair<Block>(set, data, size, from);
+}
+
+NF_SCAN_TARGET MaskTriggers maskTriggers(const char* data, size_t size) { return blockTriggers<Block>(data, size); }
+
+const ByteScanKernel kSse42 = {"sse4.2", find, findPair, maskTriggers};
+
+}  // namespace
+
+const ByteScanKernel* sse42ByteScan() { return &kSse42; }
+
+}  // namespace neurafilter
+
+#else
+
+namespace neurafilter {
+const ByteScanKernel* sse42ByteScan() { return nullptr; }
+}  // namespace neurafilter
+
+#endif
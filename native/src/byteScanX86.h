@@ -0,0 +1,49 @@
+// 16- and 32-byte blocks for the x86 kernels (byteScanSse42.cpp and
+// byteScanAvx2.cpp); Vec wraps the register width's few operations
+#pragma once
+
+#include "byteScanBlocks.h"
+
+namespace neurafilter {
+namespace {
+
+template <typename Vec>
+struct X86Block {
+    static constexpr size_t kWidth = Vec::kWidth;
+
+    NF_SCAN_TARGET static uint32_t members(const ByteSetTables& set, const char* p) {
+        auto v = Vec::load(p);
+        auto nibble = Vec::splat(0x0f);
+        auto low = Vec::lookup(Vec::table(set.lo), Vec::bitAnd(v, nibble));
+        auto high = Vec::lookup(Vec::table(set.hi), Vec::bitAnd(Vec::shiftNibble(v), nibble));
+        uint32_t mask = ~Vec::mask(Vec::equal(Vec::bitAnd(low, high), Vec::splat(0))) & Vec::kAll;
+        if (set.anyHigh) mask |= Vec::mask(v);
+        return mask;
+    }
+
+    NF_SCAN_TARGET static auto buckets(const uint8_t* lo, const uint8_t* hi, decltype(Vec::splat(0)) v) {
+        auto nibble = Vec::splat(0x0f);
+        return Vec::bitAnd(Vec::lookup(Vec::table(lo), Vec::bitAnd(v, nibble)),
+                           Vec::lookup(Vec::table(hi), Vec::bitAnd(Vec::shiftNibble(v), nibble)));
+    }
+
+    NF_SCAN_TARGET static uint32_t pairs(const PairSetTables& set, const char* p) {
+        auto first = buckets(set.lo0, set.hi0, Vec::load(p));
+        auto second = buckets(set.lo1, set.hi1, Vec::load(p + 1));
+        return ~Vec::mask(Vec::equal(Vec::bitAnd(first, second), Vec::splat(0))) & Vec::kAll;
+    }
+
+    NF_SCAN_TARGET static void triggers(const char* p, Triggers& out) {
+        auto v = Vec::load(p);
+        auto folded = Vec::bitOr(v, Vec::splat(0x20));
+        out.at = Vec::mask(Vec::equal(v, Vec::splat('@')));
+        out.slash = Vec::mask(Vec::equal(v, Vec::splat('/')));
+        out.dot = Vec::mask(Vec::equal(v, Vec::splat('.')));
+        // Signed compares: bytes >= 0x80 are negative and never digits
+        out.digit = Vec::mask(Vec::bitAnd(Vec::greater(v, Vec::splat('0' - 1)), Vec::greater(Vec::splat('9' + 1), v)));
+        out.tokenStart = Vec::mask(Vec::bitOr(Vec::equal(folded, Vec::splat('b')), Vec::equal(folded, Vec::splat('t'))));
+    }
+};
+
+}  // namespace
+}  // namespace neurafilter
@@ -0,0 +1,546 @@
+// Engine: channel shards plus the runPipeline() / processLine() order of
+// services/logPipeline.deluge
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <type_traits>
+#include <unordered_set>
+
+#include "md5.h"
+#include "neurafilter/json.h"
+#include "snapshot.h"
+#include "stages.h"
+#include "workPool.h"
+
+namespace neurafilter {
+
+const char* actionName(Action action) {
+    switch (action) {
+        case Action::Pass: return "pass";
+        case Action::Highlight: return "highlight";
+        case Action::Suppress: return "suppress";
+    }
+    return "pass";
+}
+
+const char* reasonName(Reason reason) {
+    switch (reason) {
+        case Reason::New: return "new";
+        case Reason::Anomaly: return "anomaly";
+        case Reason::Duplicate: return "duplicate";
+        case Reason::RateLimited: return "rate_limited";
+        case Reason::FilterOff: return "filter_off";
+        case Reason::Sampled: return "sampled";
+    }
+    return "new";
+}
+
+FilterConfig FilterConfig::fromJson(const json::Value& value, const FilterConfig& base) {
+    FilterConfig config = base;
+    if (!value.isObject()) return config;
+    auto number = [&](std::string_view key, auto& field) {
+        if (const json::Value* v = value.find(key); v && v->isNumber())
+            field = static_cast<std::remove_reference_t<decltype(field)>>(v->asNumber());
+    };
+    number("version", config.version);
+    if (const json::Value* v = value.find("enabled"); v && v->isBool()) config.enabled = v->asBool();
+    if (const json::Value* v = value.find("disabled_mode"); v && v->isString())
+        config.rawWhenDisabled = v->asString() == "raw";
+    number("dedup_window_ms", config.dedupWindowMs);
+    number("anomaly_threshold", config.anomalyThreshold);
+    number("keyword_boost", config.keywordBoost);
+    number("recency_window_ms", config.recencyWindowMs);
+    number("rate_limit", config.rateLimit);
+    number("rate_window_ms", config.rateWindowMs);
+    number("rate_burst", config.rateBurst);
+    if (const json::Value* v = value.find("approximate"); v && v->isBool()) config.approximate = v->asBool();
+    number("sketch_width", config.sketchWidth);
+    number("sketch_depth", config.sketchDepth);
+    number("dedup_bits", config.dedupBits);
+    number("dedup_hashes", config.dedupHashes);
+    number("top_k", config.topK);
+    if (const json::Value* v = value.find("sample_mode"); v && v->isString())
+        config.sampleMode = v->asString() == "auto" ? SampleMode::Auto : v->asString() == "on" ? SampleMode::On : SampleMode::Off;
+    number("sample_latency_ms", config.sampleLatencyMs);
+    number("sample_min_score", config.sampleMinScore);
+    number("sample_min_rate", config.sampleMinRate);
+    // The limits resolveFilterConfig() applies, so a hand-written config
+    // cannot size a sketch at zero or past them
+    config.sketchWidth = std::clamp<uint32_t>(config.sketchWidth, 1, kSketchMaxWidth);
+    config.sketchDepth = std::clamp<uint32_t>(config.sketchDepth, 1, kSketchMaxRows);
+    config.dedupBits = std::clamp<uint32_t>(config.dedupBits, 1, kDedupMaxBits);
+    config.dedupHashes = std::clamp<uint32_t>(config.dedupHashes, 1, kSketchMaxRows);
+    config.topK = std::max<uint32_t>(config.topK, 1);
+    config.sampleMinScore = std::max(0.0, config.sampleMinScore);
+    if (const json::Value* rules = value.find("mask_rules"); rules && rules->isArray()) {
+        config.maskRules.clear();
+        for (const json::Value& rule : rules->items()) {
+            const json::Value* label = rule.find("label");
+            const json::Value* pattern = rule.find("pattern");
+            if (label && label->isString() && pattern && pattern->isString())
+                config.maskRules.push_back({label->asString(), pattern->asString()});
+        }
+    }
+    return config;
+}
+
+FilterConfig FilterConfig::fromJson(const json::Value& value) { return fromJson(value, FilterConfig()); }
+
+namespace {
+
+double millisSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+}  // namespace
+
+struct StringHash {
+    using is_transparent = void;
+    size_t operator()(std::string_view text) const { return std::hash<std::string_view>()(text); }
+};
+
+struct Engine::Impl {
+    Impl(const ScoringRules& rules, const FilterConfig& config) : scorer(rules), config(config) {}
+
+    ChannelShard& shard(std::string_view channel) {
+        if (lastShard != nullptr && channel == lastChannel) return *lastShard;
+        auto found = shards.find(channel);
+        if (found == shards.end()) {
+            found = shards.emplace(std::string(channel), loadShard(channel)).first;
+            found->second->lastSeen = clock;
+        }
+        lastChannel = found->first;
+        lastShard = found->second.get();
+        lastShard->dirty = true;
+        return *lastShard;
+    }
+
+    // A new channel's state: empty, or decoded from the loaded snapshot
+    std::unique_ptr<ChannelShard> loadShard(std::string_view channel) {
+        auto fresh = std::make_unique<ChannelShard>();
+        if (auto dropped = forgotten.find(channel); dropped != forgotten.end()) {
+            forgotten.erase(dropped);
+            return fresh;
+        }
+        const SnapshotSection* section = snapshot ? snapshot->find(channel) : nullptr;
+        if (section != nullptr && !decodeShard(snapshot->bytes(*section), section->checksum, *fresh))
+            fresh = std::make_unique<ChannelShard>();
+        return fresh;
+    }
+
+    // A line at now used the shard under channelConfig
+    void touch(ChannelShard& shard, int64_t now, const FilterConfig& channelConfig) {
+        shard.lastSeen = std::max(shard.lastSeen, now);
+        shard.idleAfter = counterHorizon(channelConfig);
+    }
+
+    // Drops the shards no line has used for longer than their counter
+    // horizon (all their entries and counters have expired by then) once per
+    // kSweepInterval of ingest time, and the least recently used eighth
+    // whenever more than kMaxShards are held. Shards with queued lines stay.
+    // Run only between lines: a batch holds shard pointers until it ends.
+    void sweepShards(int64_t now) {
+        clock = std::max(clock, now);
+        using Held = decltype(shards)::iterator;
+        std::vector<Held> drop;
+        if (shards.size() > kMaxShards) {
+            for (auto held = shards.begin(); held != shards.end(); ++held)
+                if (held->second->queue.empty()) drop.push_back(held);
+            auto cut = drop.begin() + static_cast<std::ptrdiff_t>(std::min(drop.size(), shards.size() / 8));
+            std::nth_element(drop.begin(), cut, drop.end(),
+                             [](Held a, Held b) { return a->second->lastSeen < b->second->lastSeen; });
+            drop.erase(cut, drop.end());
+        } else if (clock - lastShardSweep >= kSweepInterval) {
+            lastShardSweep = clock;
+            for (auto held = shards.begin(); held != shards.end(); ++held)
+                if (held->second->queue.empty() && clock - held->second->lastSeen > held->second->idleAfter)
+                    drop.push_back(held);
+        }
+        for (Held held : drop) {
+            // The loaded snapshot's copy is older still; it is not decoded
+            // again, and the next save leaves it out
+            if (snapshot != nullptr && snapshot->find(held->first) != nullptr) forgotten.insert(held->first);
+            if (held->second.get() == lastShard) {
+                lastShard = nullptr;
+                lastChannel = {};
+            }
+            shards.erase(held);
+        }
+    }
+
+    static Result filterOff(std::string_view message, int64_t now) {
+        Result result;
+        result.reason = Reason::FilterOff;
+        result.message = message;
+        result.timestamp = now;
+        return result;
+    }
+
+    // A line the adaptive sampler dropped, before any channel state was read
+    static Result sampledOut(std::string_view message, double score, int64_t now) {
+        Result result;
+        result.action = Action::Suppress;
+        result.reason = Reason::Sampled;
+        result.message = message;
+        result.score = score;
+        result.timestamp = now;
+        return result;
+    }
+
+    // The config's mask_rules, compiled on the first line that uses its
+    // version; the cache starts over once it holds kMaskRuleSets
+    const MaskRuleSet* maskRules(const FilterConfig& channelConfig) {
+        if (channelConfig.maskRules.empty()) return nullptr;
+        for (const auto& set : maskRuleSets)
+            if (set->compiledFrom(channelConfig)) return set.get();
+        if (maskRuleSets.size() >= kMaskRuleSets) maskRuleSets.clear();
+        return maskRuleSets.emplace_back(std::make_unique<MaskRuleSet>(channelConfig)).get();
+    }
+
+    // processLine(): mask + filter, or the passthrough for disabled channels.
+    // With sampling on, the sampler sees the line's level and keyword score
+    // first, and the mask + filter time of the lines it keeps.
+    Result filter(ChannelShard& channel, std::string_view line, int64_t now, const FilterConfig& channelConfig) {
+        openCounters(channel, now, counterHorizon(channelConfig));
+        const MaskRuleSet* rules = maskRules(channelConfig);
+        if (!channelConfig.enabled)
+            return filterOff(channelConfig.rawWhenDisabled ? line : neurafilter::maskSensitive(line, arena, rules), now);
+        if (channelConfig.sampleMode == SampleMode::Off)
+            return filterLogWith(channel, neurafilter::maskSensitive(line, arena, rules), now, channelConfig, scorer);
+
+        auto started = std::chrono::steady_clock::now();
+        std::string_view message = neurafilter::maskSensitive(line, arena, rules);
+        LineMatch match = scorer.match(message, channelConfig);
+        if (!samplerKeeps(channel.sampler, match, channelConfig)) return sampledOut(message, match.score, now);
+        Result result = filterLogWith(channel, message, now, channelConfig, scorer);
+        recordLineLatency(channel.sampler, millisSince(started), channelConfig);
+        return result;
+    }
+
+    Result run(std::string_view line, const RunOptions& options) {
+        const FilterConfig& channelConfig = options.config ? *options.config : config;
+        sweepShards(options.now);
+        ChannelShard& channel = shard(options.channel);
+        touch(channel, options.now, channelConfig);
+        return limit(channel, filter(channel, line, options.now, channelConfig), options.now, channelConfig,
+                     options.enforceRateLimit);
+    }
+
+    // The rate limit for a line that would be posted
+    Result limit(ChannelShard& channel, Result result, int64_t now, const FilterConfig& channelConfig,
+                 bool enforceRateLimit) {
+        if (result.action == Action::Suppress) {
+            // Not posted itself, the line still lets the queue out once the bucket has refilled
+            if (!channel.queue.empty() && neurafilter::checkRateLimit(channel, channelConfig, now)) {
+                result.hasDigest = true;
+                result.digest = neurafilter::drainOverflow(channel);
+            }
+            return result;
+        }
+
+        // Only outbound posts spend tokens; limited lines wait for the next digest
+        if (neurafilter::checkRateLimit(channel, channelConfig, now)) {
+            result.hasDigest = true;
+            if (!channel.queue.empty()) result.digest = neurafilter::drainOverflow(channel);
+            if (channelConfig.sampleMode != SampleMode::Off && channel.sampler.sampled > 0) {
+                result.sampled = channel.sampler.sampled;
+                result.sampleRate = channel.sampler.rate;
+                channel.sampler.sampled = 0;
+            }
+        } else if (!enforceRateLimit) {
+            result.hasDigest = true;
+            result.rateLimited = true;
+        } else {
+            bool queued = neurafilter::queueOverflow(channel, result);
+            Result limited;
+            limited.action = Action::Suppress;
+            limited.reason = Reason::RateLimited;
+            limited.message = result.message;
+            limited.score = result.score;
+            limited.hasTimestamp = false;
+            limited.queued = queued ? 1 : 0;
+            limited.rateLimited = true;
+            return limited;
+        }
+        return result;
+    }
+
+    WorkPool& workPool(unsigned threads) {
+        if (pool == nullptr || threads != poolThreads) {
+            pool = std::make_unique<WorkPool>(threads);
+            poolThreads = threads;
+            workerArenas.clear();
+            for (unsigned i = 0; i < pool->size(); i++) workerArenas.push_back(std::make_unique<Arena>());
+        }
+        return *pool;
+    }
+
+    Scorer scorer;
+    FilterConfig config;
+    Arena arena;
+    std::unique_ptr<WorkPool> pool;
+    unsigned poolThreads = 0;
+    std::vector<std::unique_ptr<Arena>> workerArenas;
+    std::vector<PreparedLine> prepared;
+    std::vector<std::unique_ptr<MaskRuleSet>> maskRuleSets;
+    std::unordered_map<std::string, std::unique_ptr<ChannelShard>, StringHash, std::equal_to<>> shards;
+    std::string_view lastChannel;
+    ChannelShard* lastShard = nullptr;
+    int64_t clock = 0;            // latest ingest time seen
+    int64_t lastShardSweep = 0;
+    std::unordered_set<std::string, StringHash, std::equal_to<>> forgotten;   // dropped, but in the loaded snapshot
+    std::unique_ptr<SnapshotFile> snapshot;   // last saved or loaded; channels not used since decode from it
+};
+
+Engine::Engine(ScoringRules rules, FilterConfig config) : impl_(std::make_unique<Impl>(rules, config)) {}
+Engine::~Engine() = default;
+
+Result Engine::runLine(std::string_view line, const RunOptions& options) {
+    impl_->arena.reset();
+    return impl_->run(line, options);
+}
+
+Result Engine::filterLine(std::string_view line, const RunOptions& options) {
+    impl_->arena.reset();
+    const FilterConfig& channelConfig = options.config ? *options.config : impl_->config;
+    impl_->sweepShards(options.now);
+    ChannelShard& shard = impl_->shard(options.channel);
+    impl_->touch(shard, options.now, channelConfig);
+    return impl_->filter(shard, line, options.now, channelConfig);
+}
+
+void Engine::runBatch(const std::vector<std::string_view>& lines, const std::vector<int64_t>& nows,
+                      const RunOptions& options, std::vector<Result>& out) {
+    impl_->arena.reset();
+    out.clear();
+    out.reserve(lines.size());
+    RunOptions lineOptions = options;
+    for (size_t i = 0; i < lines.size(); i++) {
+        if (i < nows.size()) lineOptions.now = nows[i];
+        out.push_back(impl_->run(lines[i], lineOptions));
+    }
+}
+
+namespace {
+
+// One channel's lines in a runParallel() call. Its chunks are prepared on any
+// worker, in any order, and applied to the channel state strictly in order by
+// whichever thread holds owned, so the state needs no lock.
+struct ChannelRun {
+    ChannelShard* shard;
+    std::vector<uint32_t> lines;   // input indices, in order
+    size_t chunks = 0;
+    std::unique_ptr<std::atomic<bool>[]> ready;
+    std::atomic<size_t> next{0};   // first chunk not applied yet
+    std::atomic<bool> owned{false};
+};
+
+struct Chunk {
+    uint32_t run;
+    uint32_t index;   // within the run
+};
+
+}  // namespace
+
+void Engine::runParallel(const std::vector<std::string_view>& lines, const std::vector<int64_t>& nows,
+                         const std::vector<std::string_view>& channels, const RunOptions& options,
+                         const ParallelOptions& parallel, std::vector<Result>& out) {
+    Impl& impl = *impl_;
+    impl.arena.reset();
+    WorkPool& pool = impl.workPool(parallel.threads);
+    for (auto& arena : impl.workerArenas) arena->reset();
+    const FilterConfig& channelConfig = options.config ? *options.config : impl.config;
+    const MaskRuleSet* rules = impl.maskRules(channelConfig);   // workers only read it
+    bool sampling = channelConfig.sampleMode != SampleMode::Off;
+    size_t chunkLines = std::max<size_t>(1, parallel.chunkLines);
+    auto nowOf = [&](size_t i) { return i < nows.size() ? nows[i] : options.now; };
+
+    out.clear();
+    out.resize(lines.size());
+    impl.prepared.resize(lines.size());
+
+    // Split by channel (shards are looked up here, before any worker starts)
+    std::vector<std::unique_ptr<ChannelRun>> runs;
+    std::unordered_map<ChannelShard*, uint32_t> runOf;
+    if (!lines.empty()) impl.sweepShards(nowOf(0));
+    for (size_t i = 0; i < lines.size(); i++) {
+        ChannelShard* shard = &impl.shard(i < channels.size() ? channels[i] : options.channel);
+        impl.touch(*shard, nowOf(i), channelConfig);
+        auto [found, added] = runOf.emplace(shard, static_cast<uint32_t>(runs.size()));
+        if (added) {
+            runs.push_back(std::make_unique<ChannelRun>());
+            runs.back()->shard = shard;
+        }
+        runs[found->second]->lines.push_back(static_cast<uint32_t>(i));
+    }
+    // Tasks in order of their first line, so chunks tend to be ready in the
+    // order their owner applies them
+    std::vector<Chunk> tasks;
+    for (uint32_t r = 0; r < runs.size(); r++) {
+        ChannelRun& run = *runs[r];
+        run.chunks = (run.lines.size() + chunkLines - 1) / chunkLines;
+        run.ready = std::make_unique<std::atomic<bool>[]>(run.chunks);
+        for (uint32_t c = 0; c < run.chunks; c++) tasks.push_back({r, c});
+    }
+    std::sort(tasks.begin(), tasks.end(), [&](const Chunk& a, const Chunk& b) {
+        return runs[a.run]->lines[a.index * chunkLines] < runs[b.run]->lines[b.index * chunkLines];
+    });
+
+    auto chunkLinesOf = [&](const ChannelRun& run, size_t chunk) {
+        size_t begin = chunk * chunkLines;
+        return std::pair<size_t, size_t>(begin, std::min(begin + chunkLines, run.lines.size()));
+    };
+    auto apply = [&](ChannelRun& run, size_t chunk) {
+        auto [begin, end] = chunkLinesOf(run, chunk);
+        for (size_t k = begin; k < end; k++) {
+            uint32_t i = run.lines[k];
+            int64_t now = nowOf(i);
+            const PreparedLine& line = impl.prepared[i];
+            openCounters(*run.shard, now, counterHorizon(channelConfig));
+            if (!channelConfig.enabled) {
+                out[i] = impl.limit(*run.shard, Impl::filterOff(line.message, now), now, channelConfig,
+                                    options.enforceRateLimit);
+                continue;
+            }
+            if (!sampling) {
+                out[i] = impl.limit(*run.shard, filterPrepared(*run.shard, line, now, channelConfig, impl.scorer), now,
+                                    channelConfig, options.enforceRateLimit);
+                continue;
+            }
+            // The sampler decides here, in channel order; a line it drops was
+            // still prepared, but costs the channel's thread nothing more
+            if (!samplerKeeps(run.shard->sampler, line.match, channelConfig)) {
+                out[i] = impl.limit(*run.shard, Impl::sampledOut(line.message, line.match.score, now), now,
+                                    channelConfig, options.enforceRateLimit);
+                continue;
+            }
+            auto started = std::chrono::steady_clock::now();
+            Result result = filterPrepared(*run.shard, line, now, channelConfig, impl.scorer);
+            recordLineLatency(run.shard->sampler, line.elapsedMs + millisSince(started), channelConfig);
+            out[i] = impl.limit(*run.shard, std::move(result), now, channelConfig, options.enforceRateLimit);
+        }
+    };
+
+    pool.run(tasks.size(), [&](size_t task, unsigned worker) {
+        ChannelRun& run = *runs[tasks[task].run];
+        size_t chunk = tasks[task].index;
+        Arena& arena = *impl.workerArenas[worker];
+        auto [begin, end] = chunkLinesOf(run, chunk);
+        for (size_t k = begin; k < end; k++) {
+            uint32_t i = run.lines[k];
+            PreparedLine& line = impl.prepared[i];
+            if (!channelConfig.enabled) {
+                line.message = channelConfig.rawWhenDisabled ? lines[i] : neurafilter::maskSensitive(lines[i], arena, rules);
+                continue;
+            }
+            if (!sampling) {
+                prepareLine(neurafilter::maskSensitive(lines[i], arena, rules), nowOf(i), channelConfig, impl.scorer, arena, line);
+                continue;
+            }
+            auto started = std::chrono::steady_clock::now();
+            prepareLine(neurafilter::maskSensitive(lines[i], arena, rules), nowOf(i), channelConfig, impl.scorer, arena, line);
+            line.elapsedMs = millisSince(started);
+        }
+        run.ready[chunk].store(true);
+
+        // Apply every ready chunk in order unless another thread already is.
+        // A chunk that becomes ready just as the owner lets go is caught by the
+        // re-check: either this thread sees it, or its preparer wins owned.
+        for (;;) {
+            if (run.owned.exchange(true)) return;
+            size_t next = run.next.load();
+            while (next < run.chunks && run.ready[next].load()) apply(run, next++);
+            run.next.store(next);
+            run.owned.store(false);
+            if (next == run.chunks || !run.ready[next].load()) return;
+        }
+    });
+}
+
+bool Engine::checkRateLimit(std::string_view channel, const FilterConfig& config, int64_t now) {
+    ChannelShard& shard = impl_->shard(channel);
+    openCounters(shard, now, counterHorizon(config));
+    return neurafilter::checkRateLimit(shard, config, now);
+}
+
+bool Engine::queueOverflow(std::string_view channel, const Result& result) {
+    return neurafilter::queueOverflow(impl_->shard(channel), result);
+}
+
+std::vector<QueuedResult> Engine::drainOverflow(std::string_view channel) {
+    return neurafilter::drainOverflow(impl_->shard(channel));
+}
+
+std::string Engine::maskSensitive(std::string_view line) {
+    impl_->arena.reset();
+    return std::string(neurafilter::maskSensitive(line, impl_->arena));
+}
+
+std::string Engine::templateOf(std::string_view message, std::string_view channel) {
+    return hexId(impl_->shard(channel).templates.templateOf(message, impl_->scorer.levelTokens()));
+}
+
+bool Engine::extractTimestamp(std::string_view message, std::string_view channel, int64_t now, int64_t& timestamp) {
+    return neurafilter::extractTimestamp(message, impl_->shard(channel).timestampFormat, now, timestamp);
+}
+
+double Engine::scoreLog(std::string_view message, int64_t ageMs, const FilterConfig& config) const {
+    return impl_->scorer.score(message, ageMs, config);
+}
+
+SnapshotStats Engine::saveSnapshot(const std::string& path) {
+    Impl& impl = *impl_;
+    // Into another file every used channel is written; its other channels
+    // are copied from the loaded snapshot
+    bool sameFile = impl.snapshot != nullptr && impl.snapshot->path() == path;
+    std::vector<std::pair<std::string_view, const ChannelShard*>> changed;
+    for (const auto& [channel, shard] : impl.shards)
+        if (shard->dirty || !sameFile) changed.emplace_back(channel, shard.get());
+    std::vector<std::string_view> dropped(impl.forgotten.begin(), impl.forgotten.end());
+    SnapshotStats stats = writeSnapshot(path, impl.snapshot.get(), changed, dropped);
+
+    impl.snapshot = std::make_unique<SnapshotFile>(path);
+    impl.forgotten.clear();
+    for (auto& [channel, shard] : impl.shards) shard->dirty = false;
+    impl.lastShard = nullptr;
+    return stats;
+}
+
+size_t Engine::loadSnapshot(const std::string& path) {
+    auto file = std::make_unique<SnapshotFile>(path);
+    reset();
+    impl_->snapshot = std::move(file);
+    return impl_->snapshot->channels();
+}
+
+const FilterConfig& Engine::defaultConfig() const { return impl_->config; }
+
+StateSizes Engine::stateSizes() const {
+    StateSizes sizes;
+    sizes.shards = impl_->shards.size();
+    for (const auto& [name, shard] : impl_->shards) {
+        sizes.entryMap += shard->entries.size();
+        sizes.templateCache += shard->templates.cacheSize();
+        sizes.templates += shard->templates.templateCount();
+        sizes.queued += shard->queue.size();
+        sizes.counterDeltas += shard->sightings.size();
+        if (shard->sketch) {
+            sizes.counterDeltas += shard->sketch->counts.sightings.size();
+            sizes.sketches++;
+        }
+    }
+    return sizes;
+}
+
+void Engine::reset() {
+    impl_->shards.clear();
+    impl_->forgotten.clear();
+    impl_->lastShard = nullptr;
+    impl_->lastChannel = {};
+    impl_->clock = 0;
+    impl_->lastShardSweep = 0;
+    impl_->arena.reset();
+    impl_->snapshot.reset();
+}
+
+}  // namespace neurafilter
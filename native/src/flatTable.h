@@ -0,0 +1,148 @@
+// Open-addressing hash table keyed by 64-bit ids (template ids, shape hashes)
+//
+// Linear probing over one contiguous slot array with a parallel array of
+// occupancy bytes, so a lookup is usually one or two cache lines, and
+// backward-shift deletion, so there are no tombstones to sweep. Keys are
+// already well mixed (MD5 prefixes, FNV hashes) and any value is allowed.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace neurafilter {
+
+template <typename V>
+class FlatTable {
+public:
+    struct Slot {
+        uint64_t key;
+        V value;
+    };
+
+    explicit FlatTable(size_t initialCapacity = 64) { rehash(roundUp(initialCapacity)); }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    V* find(uint64_t key) {
+        size_t i = home(key);
+        while (used_[i]) {
+            if (slots_[i].key == key) return &slots_[i].value;
+            i = (i + 1) & mask_;
+        }
+        return nullptr;
+    }
+    const V* find(uint64_t key) const { return const_cast<FlatTable*>(this)->find(key); }
+
+    // Value for key, default-constructed and flagged if it was missing
+    V& insert(uint64_t key, bool& inserted) {
+        if ((size_ + 1) * 10 > capacity() * 7) rehash(capacity() * 2);
+        size_t i = home(key);
+        while (used_[i]) {
+            if (slots_[i].key == key) {
+                inserted = false;
+                return slots_[i].value;
+            }
+            i = (i + 1) & mask_;
+        }
+        used_[i] = 1;
+        slots_[i].key = key;
+        slots_[i].value = V();
+        size_++;
+        inserted = true;
+        return slots_[i].value;
+    }
+
+    bool erase(uint64_t key) {
+        size_t i = home(key);
+        while (used_[i]) {
+            if (slots_[i].key == key) {
+                eraseSlot(i);
+                return true;
+            }
+            i = (i + 1) & mask_;
+        }
+        return false;
+    }
+
+    void clear() {
+        std::fill(used_.begin(), used_.end(), 0);
+        size_ = 0;
+    }
+
+    // fn(key, value) for every entry; fn returns true to erase the entry.
+    // Entries shifted back over an erased slot are visited exactly once.
+    template <typename Fn>
+    void eraseIf(Fn&& fn) {
+        // Start just past an empty slot so no probe run wraps into the scan
+        size_t start = 0;
+        while (used_[start]) start = (start + 1) & mask_;
+        size_t i = (start + 1) & mask_;
+        for (size_t visited = 0; visited < capacity();) {
+            if (used_[i] && fn(slots_[i].key, slots_[i].value)) {
+                eraseSlot(i);
+                continue;  // re-check i, which now holds a shifted entry or is empty
+            }
+            i = (i + 1) & mask_;
+            visited++;
+        }
+    }
+
+    template <typename Fn>
+    void forEach(Fn&& fn) const {
+        for (size_t i = 0; i < slots_.size(); i++)
+            if (used_[i]) fn(slots_[i].key, slots_[i].value);
+    }
+
+private:
+    static size_t roundUp(size_t n) {
+        size_t capacity = 16;
+        while (capacity < n) capacity *= 2;
+        return capacity;
+    }
+
+    size_t capacity() const { return slots_.size(); }
+    size_t home(uint64_t key) const { return static_cast<size_t>((key * 0x9e3779b97f4a7c15ull) >> 32) & mask_; }
+
+    void eraseSlot(size_t hole) {
+        size_t i = hole;
+        for (;;) {
+            i = (i + 1) & mask_;
+            if (!used_[i]) break;
+            // Move the entry back if the hole lies on its probe path
+            size_t want = home(slots_[i].key);
+            if (((i - want) & mask_) >= ((i - hole) & mask_)) {
+                slots_[hole] = std::move(slots_[i]);
+                hole = i;
+            }
+        }
+        used_[hole] = 0;
+        size_--;
+    }
+
+    void rehash(size_t capacity) {
+        std::vector<Slot> oldSlots(capacity);
+        std::vector<uint8_t> oldUsed(capacity, 0);
+        oldSlots.swap(slots_);
+        oldUsed.swap(used_);
+        mask_ = capacity - 1;
+        size_ = 0;
+        for (size_t i = 0; i < oldSlots.size(); i++) {
+            if (!oldUsed[i]) continue;
+            size_t j = home(oldSlots[i].key);
+            while (used_[j]) j = (j + 1) & mask_;
+            used_[j] = 1;
+            slots_[j] = std::move(oldSlots[i]);
+            size_++;
+        }
+    }
+
+    std::vector<Slot> slots_;
+    std::vector<uint8_t> used_;
+    size_t mask_ = 0;
+    size_t size_ = 0;
+};
+
+}  // namespace neurafilter
@@ -0,0 +1,293 @@
+#include "neurafilter/json.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+namespace neurafilter::json {
+
+const Value* Value::find(std::string_view key) const {
+    if (type_ != Type::Object) return nullptr;
+    for (const auto& [name, value] : object_)
+        if (name == key) return &value;
+    return nullptr;
+}
+
+Value& Value::operator[](std::string_view key) {
+    if (type_ == Type::Null) type_ = Type::Object;
+    for (auto& [name, value] : object_)
+        if (name == key) return value;
+    object_.emplace_back(std::string(key), Value());
+    return object_.back().second;
+}
+
+void Value::push(Value item) {
+    if (type_ == Type::Null) type_ = Type::Array;
+    array_.push_back(std::move(item));
+}
+
+// Integers print without a fraction, as JSON.stringify does
+void appendNumber(std::string& out, double number) {
+    if (!std::isfinite(number)) {
+        out += "null";
+        return;
+    }
+    char buffer[32];
+    if (number == std::trunc(number) && std::fabs(number) < 9007199254740992.0)
+        std::snprintf(buffer, sizeof buffer, "%lld", static_cast<long long>(number));
+    else
+        // Shortest form that reads back as the same double
+        for (int precision = 15; precision <= 17; precision++) {
+            std::snprintf(buffer, sizeof buffer, "%.*g", precision, number);
+            if (std::strtod(buffer, nullptr) == number) break;
+        }
+    out += buffer;
+}
+
+void appendQuoted(std::string& out, std::string_view text) {
+    out += '"';
+    for (char c : text) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char buffer[8];
+                    std::snprintf(buffer, sizeof buffer, "\\u%04x", c);
+                    out += buffer;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    out += '"';
+}
+
+void Value::dumpTo(std::string& out) const {
+    switch (type_) {
+        case Type::Null: out += "null"; break;
+        case Type::Bool: out += bool_ ? "true" : "false"; break;
+        case Type::Number: appendNumber(out, number_); break;
+        case Type::String: appendQuoted(out, string_); break;
+        case Type::Array:
+            out += '[';
+            for (size_t i = 0; i < array_.size(); i++) {
+                if (i > 0) out += ',';
+                array_[i].dumpTo(out);
+            }
+            out += ']';
+            break;
+        case Type::Object:
+            out += '{';
+            for (size_t i = 0; i < object_.size(); i++) {
+                if (i > 0) out += ',';
+                appendQuoted(out, object_[i].first);
+                out += ':';
+                object_[i].second.dumpTo(out);
+            }
+            out += '}';
+            break;
+    }
+}
+
+std::string Value::dump() const {
+    std::string out;
+    dumpTo(out);
+    return out;
+}
+
+namespace {
+
+class Parser {
+public:
+    explicit Parser(std::string_view text) : text_(text) {}
+
+    Value document() {
+        Value value = parseValue(0);
+        skipSpace();
+        if (pos_ != text_.size()) fail("trailing characters");
+        return value;
+    }
+
+private:
+    static constexpr int kMaxDepth = 64;
+
+    [[noreturn]] void fail(const char* what) const {
+        throw Error(std::string("JSON ") + what + " at offset " + std::to_string(pos_));
+    }
+
+    void skipSpace() {
+        while (pos_ < text_.size() && (text_[pos_] == ' ' || text_[pos_] == '\t' || text_[pos_] == '\n' || text_[pos_] == '\r'))
+            pos_++;
+    }
+
+    bool consume(std::string_view word) {
+        if (text_.substr(pos_, word.size()) != word) return false;
+        pos_ += word.size();
+        return true;
+    }
+
+    Value parseValue(int depth) {
+        if (depth > kMaxDepth) fail("nested too deeply");
+        skipSpace();
+        if (pos_ >= text_.size()) fail("unexpected end");
+        char c = text_[pos_];
+        if (c == '{') return parseObject(depth);
+        if (c == '[') return parseArray(depth);
+        if (c == '"') return Value(parseString());
+        if (consume("true")) return Value(true);
+        if (consume("false")) return Value(false);
+        if (consume("null")) return Value();
+        if (c == '-' || (c >= '0' && c <= '9')) return parseNumber();
+        fail("unexpected character");
+    }
+
+    Value parseObject(int depth) {
+        Value object = Value::object();
+        pos_++;
+        skipSpace();
+        if (pos_ < text_.size() && text_[pos_] == '}') {
+            pos_++;
+            return object;
+        }
+        for (;;) {
+            skipSpace();
+            if (pos_ >= text_.size() || text_[pos_] != '"') fail("expected key");
+            std::string key = parseString();
+            skipSpace();
+            if (pos_ >= text_.size() || text_[pos_] != ':') fail("expected ':'");
+            pos_++;
+            object[key] = parseValue(depth + 1);
+            skipSpace();
+            if (pos_ < text_.size() && text_[pos_] == ',') {
+                pos_++;
+                continue;
+            }
+            if (pos_ < text_.size() && text_[pos_] == '}') {
+                pos_++;
+                return object;
+            }
+            fail("expected ',' or '}'");
+        }
+    }
+
+    Value parseArray(int depth) {
+        Value array = Value::array();
+        pos_++;
+        skipSpace();
+        if (pos_ < text_.size() && text_[pos_] == ']') {
+            pos_++;
+            return array;
+        }
+        for (;;) {
+            array.push(parseValue(depth + 1));
+            skipSpace();
+            if (pos_ < text_.size() && text_[pos_] == ',') {
+                pos_++;
+                continue;
+            }
+            if (pos_ < text_.size() && text_[pos_] == ']') {
+                pos_++;
+                return array;
+            }
+            fail("expected ',' or ']'");
+        }
+    }
+
+    Value parseNumber() {
+        size_t start = pos_;
+        if (text_[pos_] == '-') pos_++;
+        while (pos_ < text_.size() && ((text_[pos_] >= '0' && text_[pos_] <= '9') || text_[pos_] == '.' ||
+                                       text_[pos_] == 'e' || text_[pos_] == 'E' || text_[pos_] == '+' || text_[pos_] == '-'))
+            pos_++;
+        std::string number(text_.substr(start, pos_ - start));
+        char* end = nullptr;
+        double value = std::strtod(number.c_str(), &end);
+        if (end != number.c_str() + number.size()) fail("bad number");
+        return Value(value);
+    }
+
+    unsigned hex4() {
+        if (pos_ + 4 > text_.size()) fail("bad escape");
+        unsigned code = 0;
+        for (int i = 0; i < 4; i++) {
+            char c = text_[pos_++];
+            code <<= 4;
+            if (c >= '0' && c <= '9') code |= c - '0';
+            else if (c >= 'a' && c <= 'f') code |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') code |= c - 'A' + 10;
+            else fail("bad escape");
+        }
+        return code;
+    }
+
+    static void appendUtf8(std::string& out, unsigned code) {
+        if (code < 0x80) {
+            out += static_cast<char>(code);
+        } else if (code < 0x800) {
+            out += static_cast<char>(0xc0 | (code >> 6));
+            out += static_cast<char>(0x80 | (code & 0x3f));
+        } else if (code < 0x10000) {
+            out += static_cast<char>(0xe0 | (code >> 12));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+            out += static_cast<char>(0x80 | (code & 0x3f));
+        } else {
+            out += static_cast<char>(0xf0 | (code >> 18));
+            out += static_cast<char>(0x80 | ((code >> 12) & 0x3f));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+            out += static_cast<char>(0x80 | (code & 0x3f));
+        }
+    }
+
+    std::string parseString() {
+        std::string out;
+        pos_++;
+        for (;;) {
+            if (pos_ >= text_.size()) fail("unterminated string");
+            char c = text_[pos_++];
+            if (c == '"') return out;
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (pos_ >= text_.size()) fail("bad escape");
+            char e = text_[pos_++];
+            switch (e) {
+                case '"': out += '"'; break;
+                case '\\': out += '\\'; break;
+                case '/': out += '/'; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'n': out += '\n'; break;
+                case 'r': out += '\r'; break;
+                case 't': out += '\t'; break;
+                case 'u': {
+                    unsigned code = hex4();
+                    if (code >= 0xd800 && code < 0xdc00 && text_.substr(pos_, 2) == "\\u") {
+                        pos_ += 2;
+                        unsigned low = hex4();
+                        if (low >= 0xdc00 && low < 0xe000) code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                        else appendUtf8(out, code), code = low;
+                    }
+                    appendUtf8(out, code);
+                    break;
+                }
+                default: fail("bad escape");
+            }
+        }
+    }
+
+    std::string_view text_;
+    size_t pos_ = 0;
+};
+
+}  // namespace
+
+Value parse(std::string_view text) { return Parser(text).document(); }
+
+}  // namespace neurafilter::json
@@ -0,0 +1,389 @@
+// Mirrors services/logFilter.deluge (and logFilter() in the harness):
+// bounded per-channel entries keyed by template id, dedup on event time,
+// and a 10-bucket sliding window of sightings per template kept as the
+// shared counters of utils/sharedCounters.deluge would merge them. In
+// approximate mode, a time-sliced Bloom filter, a Count-Min sketch and a
+// Space-Saving table take their place.
+#include <algorithm>
+#include <climits>
+
+#include "stages.h"
+
+namespace neurafilter {
+
+namespace {
+
+inline size_t ringIndex(int64_t slot) {
+    return static_cast<size_t>(((slot % int64_t(kRingSize)) + int64_t(kRingSize)) % int64_t(kRingSize));
+}
+
+void sweepExpired(ChannelShard& shard, int64_t now, int64_t ttl) {
+    shard.entries.eraseIf([&](uint64_t, const FilterEntry& entry) {
+        if (now - entry.lastAccess <= ttl) return false;
+        shard.evictedExpired++;
+        return true;
+    });
+    shard.lastSweep = now;
+}
+
+// Evict least recently used entries down to 90% of the cap. Like the
+// Deluge loop, entries at or below the cutoff go in insertion order.
+void evictLru(ChannelShard& shard) {
+    size_t overflow = shard.entries.size() - static_cast<size_t>(kMaxEntries * 0.9);
+    std::vector<int64_t> accessTimes;
+    accessTimes.reserve(shard.entries.size());
+    shard.entries.forEach([&](uint64_t, const FilterEntry& entry) { accessTimes.push_back(entry.lastAccess); });
+    std::nth_element(accessTimes.begin(), accessTimes.begin() + (overflow - 1), accessTimes.end());
+    int64_t cutoff = accessTimes[overflow - 1];
+
+    std::vector<std::pair<uint64_t, uint64_t>> candidates;  // (order, key)
+    shard.entries.forEach([&](uint64_t key, const FilterEntry& entry) {
+        if (entry.lastAccess <= cutoff) candidates.emplace_back(entry.order, key);
+    });
+    std::sort(candidates.begin(), candidates.end());
+    size_t evicted = std::min(overflow, candidates.size());
+    for (size_t i = 0; i < evicted; i++) shard.entries.erase(candidates[i].second);
+    shard.evictedLru += evicted;
+}
+
+// Count one sighting and return the template's window total: the live
+// sightings in the kBucketCount buckets ending at the newest one. A late
+// arrival is counted in the newest bucket.
+int64_t recordOccurrence(ChannelShard& shard, uint64_t key, int64_t time, int64_t now) {
+    int64_t epoch = time / kBucketSize;
+    bool inserted;
+    WindowCounter& counter = shard.windows.insert(key, inserted);
+    if (inserted) {
+        counter.live = 0;
+        std::fill(std::begin(counter.tags), std::end(counter.tags), INT64_MIN);
+        std::fill(std::begin(counter.counts), std::end(counter.counts), 0u);
+    } else if (counter.lastSlot > epoch) {
+        epoch = counter.lastSlot;
+    }
+
+    size_t cell = ringIndex(epoch);
+    if (counter.tags[cell] != epoch) {
+        counter.tags[cell] = epoch;
+        counter.counts[cell] = 0;
+    }
+    counter.counts[cell]++;
+    counter.live++;
+    counter.lastSlot = epoch;
+    shard.sightings.push_back({now, key, epoch});
+
+    int64_t windowCount = 0;
+    for (size_t i = 0; i < kRingSize; i++)
+        if (counter.tags[i] > epoch - kBucketCount && counter.tags[i] <= epoch) windowCount += counter.counts[i];
+    return windowCount;
+}
+
+// Approximate mode
+
+inline size_t sliceIndex(int64_t slot, int64_t ring) { return static_cast<size_t>(((slot % ring) + ring) % ring); }
+
+// Row / hash i of a template indexes (h1 + i * h2) % size, h1 and h2 being
+// the id's two 32-bit halves, as sketchHashes() in Deluge
+inline uint64_t sketchIndex(uint64_t key, uint32_t i, uint32_t size) {
+    return ((key >> 32) + uint64_t(i) * (key & 0xffffffffu)) % size;
+}
+
+// The channel's sketch, each part started over when the config resizes it
+FilterSketch& filterSketch(ChannelShard& shard, const FilterConfig& config) {
+    if (!shard.sketch) shard.sketch = std::make_unique<FilterSketch>();
+    FilterSketch& sketch = *shard.sketch;
+    DedupFilter& seen = sketch.seen;
+    int64_t sliceMs = std::max<int64_t>(1, config.dedupWindowMs / kDedupSlices);
+    if (seen.sliceMs != sliceMs || seen.bits != config.dedupBits || seen.hashes != config.dedupHashes ||
+        sketch.topK != config.topK) {
+        seen.sliceMs = sliceMs;
+        seen.bits = config.dedupBits;
+        seen.hashes = config.dedupHashes;
+        seen.hasSlice = false;
+        std::fill(std::begin(seen.tags), std::end(seen.tags), INT64_MIN);
+        seen.words.assign(kDedupSlices * ((seen.bits + 63) / 64), 0);
+        sketch.topK = config.topK;
+        sketch.heavy.clear();
+    }
+    // The Deluge counters are named by sketch size, so a resized sketch
+    // starts with none
+    CountMinSketch& counts = sketch.counts;
+    if (counts.depth != config.sketchDepth || counts.width != config.sketchWidth) {
+        counts.depth = config.sketchDepth;
+        counts.width = config.sketchWidth;
+        counts.live = 0;
+        std::fill(std::begin(counts.tags), std::end(counts.tags), INT64_MIN);
+        counts.cells.assign(size_t(kBucketCount) * counts.depth * counts.width, 0);
+        counts.sightings.clear();
+    }
+    return sketch;
+}
+
+// Count one sighting and return the estimated window total: the smallest
+// row sum over the kBucketCount buckets ending at the channel's newest
+int64_t recordSketchOccurrence(CountMinSketch& counts, uint64_t key, int64_t time, int64_t now) {
+    int64_t epoch = time / kBucketSize;
+    if (counts.live > 0 && counts.newestSlot > epoch) epoch = counts.newestSlot;
+    size_t slice = sliceIndex(epoch, kBucketCount);
+    size_t sliceCells = size_t(counts.depth) * counts.width;
+    if (counts.tags[slice] != epoch) {
+        counts.tags[slice] = epoch;
+        std::fill_n(counts.cells.begin() + slice * sliceCells, sliceCells, 0u);
+    }
+    counts.live++;
+    counts.newestSlot = epoch;
+    counts.sightings.push_back({now, key, epoch});
+
+    int64_t estimate = INT64_MAX;
+    for (uint32_t row = 0; row < counts.depth; row++) {
+        size_t cell = size_t(row) * counts.width + sketchIndex(key, row, counts.width);
+        counts.cells[slice * sliceCells + cell]++;
+        int64_t rowCount = 0;
+        for (size_t i = 0; i < size_t(kBucketCount); i++)
+            if (counts.tags[i] > epoch - kBucketCount && counts.tags[i] <= epoch) rowCount += counts.cells[i * sliceCells + cell];
+        estimate = std::min(estimate, rowCount);
+    }
+    return estimate;
+}
+
+// Space-Saving: count one sighting, replacing the least counted template
+// (the one that took its place first among equals) once the table is full,
+// and return the sightings the table guarantees (count - error)
+uint64_t trackHeavyHitter(FilterSketch& sketch, uint64_t key) {
+    HeavyHitter* hitter = sketch.heavy.find(key);
+    if (hitter == nullptr) {
+        uint64_t error = 0;
+        if (sketch.heavy.size() >= sketch.topK) {
+            uint64_t minKey = 0;
+            const HeavyHitter* least = nullptr;
+            sketch.heavy.forEach([&](uint64_t candidate, const HeavyHitter& entry) {
+                if (least == nullptr || entry.count < least->count ||
+                    (entry.count == least->count && entry.order < least->order)) {
+                    least = &entry;
+                    minKey = candidate;
+                }
+            });
+            error = least->count;
+            sketch.heavy.erase(minKey);
+        }
+        bool inserted;
+        hitter = &sketch.heavy.insert(key, inserted);
+        *hitter = HeavyHitter{error, error, sketch.nextOrder++};
+    }
+    hitter->count++;
+    return hitter->count - hitter->error;
+}
+
+// Deltas expire with their whole epoch, once its last millisecond is more
+// than horizon ms old (utils/sharedCounters.deluge compacts per epoch)
+bool expired(int64_t at, int64_t now, int64_t horizon) {
+    return now - ((at / kCounterEpochMs + 1) * kCounterEpochMs - 1) > horizon;
+}
+
+}  // namespace
+
+int64_t counterHorizon(const FilterConfig& config) { return std::max(kEntryTtl, config.rateWindowMs); }
+
+// Sightings of one template only become live in nondecreasing slot order
+// (each one lands in the newest live slot or later), so its newest live
+// slot is the last one recorded, and a counter with no live sightings left
+// is dropped. Times must be fed in nondecreasing order, as in the harness.
+void openCounters(ChannelShard& shard, int64_t now, int64_t horizon) {
+    while (!shard.sightings.empty() && expired(shard.sightings.front().at, now, horizon)) {
+        const Sighting& sighting = shard.sightings.front();
+        if (WindowCounter* counter = shard.windows.find(sighting.key)) {
+            size_t cell = ringIndex(sighting.slot);
+            if (counter->tags[cell] == sighting.slot) counter->counts[cell]--;
+            if (--counter->live == 0) shard.windows.erase(sighting.key);
+        }
+        shard.sightings.pop_front();
+    }
+    while (!shard.posts.empty() && expired(shard.posts.front().time, now, horizon)) shard.posts.pop_front();
+    if (!shard.sketch) return;
+    CountMinSketch& counts = shard.sketch->counts;
+    size_t sliceCells = size_t(counts.depth) * counts.width;
+    while (!counts.sightings.empty() && expired(counts.sightings.front().at, now, horizon)) {
+        const Sighting& sighting = counts.sightings.front();
+        size_t slice = sliceIndex(sighting.slot, kBucketCount);
+        if (counts.tags[slice] == sighting.slot)
+            for (uint32_t row = 0; row < counts.depth; row++)
+                counts.cells[slice * sliceCells + size_t(row) * counts.width + sketchIndex(sighting.key, row, counts.width)]--;
+        if (--counts.live == 0) std::fill(std::begin(counts.tags), std::end(counts.tags), INT64_MIN);
+        counts.sightings.pop_front();
+    }
+}
+
+namespace {
+
+// Where filterLine() gets a line's event time, template and score: worked
+// out on the spot, or read from what a batch worker prepared
+struct LiveLine {
+    std::string_view message;
+    int64_t now;
+    const Scorer& scorer;
+
+    bool timestamp(ChannelShard& shard, int64_t& parsed) const {
+        return extractTimestamp(message, shard.timestampFormat, now, parsed);
+    }
+    uint64_t templateId(ChannelShard& shard) const { return shard.templates.templateOf(message, scorer.levelTokens()); }
+    double score(int64_t ageMs, const FilterConfig& config) const { return scorer.score(message, ageMs, config); }
+};
+
+struct Prepared {
+    const PreparedLine& line;
+    const Scorer& scorer;
+
+    bool timestamp(ChannelShard& shard, int64_t& parsed) const {
+        return pickTimestamp(line.timestamps, shard.timestampFormat, parsed);
+    }
+    uint64_t templateId(ChannelShard& shard) const {
+        return shard.templates.templateOfShape(line.shape, line.shapeHash, scorer.levelTokens());
+    }
+    double score(int64_t ageMs, const FilterConfig& config) const {
+        return scorer.withRecency(line.match.score, ageMs, config);
+    }
+};
+
+template <typename Line>
+Result filterSketched(ChannelShard& shard, std::string_view message, const Line& line, uint64_t key, int64_t eventTime,
+                      int64_t now, const FilterConfig& config) {
+    FilterSketch& sketch = filterSketch(shard, config);
+    DedupFilter& seen = sketch.seen;
+
+    // The event's dedup slice; ring slices tagged further back than
+    // kDedupSlices have left the window
+    int64_t slice = eventTime / seen.sliceMs;
+    if (seen.hasSlice && seen.newestSlice > slice) slice = seen.newestSlice;
+    seen.hasSlice = true;
+    seen.newestSlice = slice;
+    size_t sliceWords = (seen.bits + 63) / 64;
+    uint64_t bits[kSketchMaxRows];
+    for (uint32_t i = 0; i < seen.hashes; i++) bits[i] = sketchIndex(key, i, seen.bits);
+    bool duplicate = false;
+    for (size_t s = 0; s < size_t(kDedupSlices) && !duplicate; s++) {
+        if (seen.tags[s] <= slice - kDedupSlices || seen.tags[s] > slice) continue;
+        const uint64_t* words = seen.words.data() + s * sliceWords;
+        duplicate = true;
+        for (uint32_t i = 0; i < seen.hashes && duplicate; i++) duplicate = (words[bits[i] / 64] >> (bits[i] % 64)) & 1;
+    }
+
+    // Every sighting (duplicates included) counts towards frequency
+    int64_t windowCount = recordSketchOccurrence(sketch.counts, key, eventTime, now);
+    uint64_t guaranteed = trackHeavyHitter(sketch, key);
+
+    Result result;
+    result.message = message;
+    result.timestamp = eventTime;
+    result.score = line.score(now - eventTime, config);
+    if (duplicate) {
+        result.action = Action::Suppress;
+        result.reason = Reason::Duplicate;
+        return result;
+    }
+
+    size_t ring = sliceIndex(slice, kDedupSlices);
+    uint64_t* words = seen.words.data() + ring * sliceWords;
+    if (seen.tags[ring] != slice) {
+        seen.tags[ring] = slice;
+        std::fill_n(words, sliceWords, 0);
+    }
+    for (uint32_t i = 0; i < seen.hashes; i++) words[bits[i] / 64] |= uint64_t(1) << (bits[i] % 64);
+
+    if (static_cast<double>(windowCount) >= config.anomalyThreshold &&
+        static_cast<double>(guaranteed) >= config.anomalyThreshold) {
+        result.action = Action::Highlight;
+        result.reason = Reason::Anomaly;
+    }
+    return result;
+}
+
+template <typename Line>
+Result filterLine(ChannelShard& shard, std::string_view message, const Line& line, int64_t now,
+                  const FilterConfig& config) {
+    int64_t ttl = std::max(kEntryTtl, config.dedupWindowMs);
+    if (!shard.hasMetrics) {
+        shard.hasMetrics = true;
+        shard.lastSweep = now;
+    }
+    if (now - shard.lastSweep > kSweepInterval) sweepExpired(shard, now, ttl);
+
+    int64_t eventTime = now;
+    int64_t parsed;
+    if (line.timestamp(shard, parsed)) eventTime = std::min(parsed, now);
+
+    uint64_t key = line.templateId(shard);
+    if (config.approximate) return filterSketched(shard, message, line, key, eventTime, now, config);
+
+    // Lazy expiry on access
+    FilterEntry* entry = shard.entries.find(key);
+    if (entry != nullptr && now - entry->lastAccess > ttl) {
+        shard.entries.erase(key);
+        shard.evictedExpired++;
+        entry = nullptr;
+    }
+
+    Result result;
+    result.message = message;
+    result.timestamp = eventTime;
+
+    // Dedup first; the sighting still counts towards frequency
+    if (entry != nullptr && eventTime - entry->lastSeen < config.dedupWindowMs) {
+        recordOccurrence(shard, key, eventTime, now);
+        entry->lastAccess = now;
+        result.action = Action::Suppress;
+        result.reason = Reason::Duplicate;
+        result.score = entry->score;
+        return result;
+    }
+
+    if (entry == nullptr) {
+        bool inserted;
+        entry = &shard.entries.insert(key, inserted);
+        *entry = FilterEntry{eventTime, now, 0, shard.nextOrder++};
+        if (shard.entries.size() > kMaxEntries) {
+            FilterEntry added = *entry;
+            evictLru(shard);
+            // Same-batch entries share a timestamp; never evict the one just
+            // added (re-added entries go to the back of the insertion order)
+            entry = &shard.entries.insert(key, inserted);
+            if (inserted) *entry = FilterEntry{added.lastSeen, added.lastAccess, added.score, shard.nextOrder++};
+        }
+    } else {
+        entry->lastSeen = eventTime;
+        entry->lastAccess = now;
+    }
+    int64_t windowCount = recordOccurrence(shard, key, eventTime, now);
+
+    double score = line.score(now - eventTime, config);
+    entry->score = score;
+    result.score = score;
+
+    if (static_cast<double>(windowCount) >= config.anomalyThreshold) {
+        result.action = Action::Highlight;
+        result.reason = Reason::Anomaly;
+    }
+    return result;
+}
+
+}  // namespace
+
+Result filterLogWith(ChannelShard& shard, std::string_view message, int64_t now, const FilterConfig& config,
+                     const Scorer& scorer) {
+    return filterLine(shard, message, LiveLine{message, now, scorer}, now, config);
+}
+
+void prepareLine(std::string_view message, int64_t now, const FilterConfig& config, const Scorer& scorer,
+                 Arena& arena, PreparedLine& out) {
+    thread_local std::string shape;
+    out.message = message;
+    out.shapeHash = TemplateIndex::shapeOf(message, shape);
+    out.shape = arena.copy(shape);
+    parseTimestampCandidates(message, now, out.timestamps);
+    out.match = scorer.match(message, config);
+}
+
+Result filterPrepared(ChannelShard& shard, const PreparedLine& line, int64_t now, const FilterConfig& config,
+                      const Scorer& scorer) {
+    return filterLine(shard, line.message, Prepared{line, scorer}, now, config);
+}
+
+}  // namespace neurafilter
@@ -0,0 +1,264 @@
+// Mirrors services/logTemplate.deluge (and templateOf() in the harness):
+// variable tokens are normalized, the normalized shape is looked up in a
+// bounded cache, and on a miss it joins the first similar template of its
+// (token count, leading token, level token) group with the same level token
+// at the same place, or starts a new one whose id is the fingerprint of the
+// shape.
+#include <cstring>
+
+#include "md5.h"
+#include "stages.h"
+
+namespace neurafilter {
+
+namespace {
+
+constexpr size_t kCacheLimit = 5000;
+constexpr size_t kGroupLimit = 20;
+constexpr double kSimilarity = 0.7;
+
+inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+inline bool isHex(char c) { return isDigit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F'); }
+inline bool isWord(char c) {
+    return isDigit(c) || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+bool digitsAt(std::string_view s, size_t p, size_t n) {
+    if (p + n > s.size()) return false;
+    for (size_t i = 0; i < n; i++)
+        if (!isDigit(s[p + i])) return false;
+    return true;
+}
+
+// Fraction ".\d+" at p: returns the position after it, or p if there is none
+size_t skipFraction(std::string_view s, size_t p) {
+    if (p + 1 < s.size() && s[p] == '.' && isDigit(s[p + 1])) {
+        p += 2;
+        while (p < s.size() && isDigit(s[p])) p++;
+    }
+    return p;
+}
+
+// ^\d{4}-\d{2}-\d{2}([T ]\d{2}:\d{2}(:\d{2}(\.\d+)?)?(Z|[+-]\d{2}:?\d{2})?)?$
+// or ^\d{2}:\d{2}:\d{2}(\.\d+)?$
+bool isTimestampToken(std::string_view s) {
+    if (digitsAt(s, 0, 2) && s.size() >= 8 && s[2] == ':' && digitsAt(s, 3, 2) && s[5] == ':' && digitsAt(s, 6, 2))
+        return skipFraction(s, 8) == s.size();
+
+    if (!(digitsAt(s, 0, 4) && s.size() >= 10 && s[4] == '-' && digitsAt(s, 5, 2) && s[7] == '-' && digitsAt(s, 8, 2)))
+        return false;
+    size_t p = 10;
+    if (p == s.size()) return true;
+    if (s[p] != 'T' && s[p] != ' ') return false;
+    if (!(digitsAt(s, p + 1, 2) && p + 3 < s.size() && s[p + 3] == ':' && digitsAt(s, p + 4, 2))) return false;
+    p += 6;
+    if (p < s.size() && s[p] == ':') {
+        if (!digitsAt(s, p + 1, 2)) return false;
+        p = skipFraction(s, p + 3);
+    }
+    if (p < s.size()) {
+        if (s[p] == 'Z') {
+            p++;
+        } else if (s[p] == '+' || s[p] == '-') {
+            if (!digitsAt(s, p + 1, 2)) return false;
+            p += 3;
+            if (p < s.size() && s[p] == ':') p++;
+            if (!digitsAt(s, p, 2)) return false;
+            p += 2;
+        }
+    }
+    return p == s.size();
+}
+
+bool isUuidAt(std::string_view s, size_t i) {
+    static constexpr size_t kDashes[] = {8, 13, 18, 23};
+    if (i + 36 > s.size()) return false;
+    for (size_t j = 0, dash = 0; j < 36; j++) {
+        if (dash < 4 && j == kDashes[dash]) {
+            if (s[i + j] != '-') return false;
+            dash++;
+        } else if (!isHex(s[i + j])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void replaceUuids(std::string_view s, std::string& out) {
+    out.clear();
+    for (size_t i = 0; i < s.size();) {
+        if (isUuidAt(s, i)) {
+            out += "<UUID>";
+            i += 36;
+        } else {
+            out += s[i++];
+        }
+    }
+}
+
+// \b(0x[0-9a-fA-F]+|[0-9a-fA-F]{6,})\b
+size_t hexEnd(std::string_view s, size_t i) {
+    if (!isHex(s[i]) || (i > 0 && isWord(s[i - 1]))) return 0;
+    auto boundedRun = [&](size_t from) {
+        size_t p = from;
+        while (p < s.size() && isHex(s[p])) p++;
+        return p;
+    };
+    if (s[i] == '0' && i + 1 < s.size() && s[i + 1] == 'x') {
+        size_t end = boundedRun(i + 2);
+        if (end > i + 2 && (end == s.size() || !isWord(s[end]))) return end;
+    }
+    size_t end = boundedRun(i);
+    if (end - i >= 6 && (end == s.size() || !isWord(s[end]))) return end;
+    return 0;
+}
+
+void replaceHex(std::string_view s, std::string& out) {
+    out.clear();
+    for (size_t i = 0; i < s.size();) {
+        size_t end = hexEnd(s, i);
+        if (end > 0) {
+            out += "<HEX>";
+            i = end;
+        } else {
+            out += s[i++];
+        }
+    }
+}
+
+// \d+(\.\d+)?
+void replaceNumbers(std::string_view s, std::string& out) {
+    for (size_t i = 0; i < s.size();) {
+        if (!isDigit(s[i])) {
+            out += s[i++];
+            continue;
+        }
+        while (i < s.size() && isDigit(s[i])) i++;
+        i = skipFraction(s, i);
+        out += "<NUM>";
+    }
+}
+
+uint64_t fnv1a(std::string_view text) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (char c : text) hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3ull;
+    return hash;
+}
+
+}  // namespace
+
+size_t TemplateIndex::templateCount() const {
+    size_t total = 0;
+    for (const auto& [key, group] : groups_) total += group.size();
+    return total;
+}
+
+uint64_t TemplateIndex::shapeOf(std::string_view message, std::string& shape) {
+    // Normalize every token into shape, ' '-separated (no normalized token
+    // contains a space)
+    thread_local std::string scratch, scratch2;
+    shape.clear();
+    size_t start = 0;
+    for (;;) {
+        size_t end = message.find(' ', start);
+        std::string_view word = message.substr(start, end == std::string_view::npos ? std::string_view::npos : end - start);
+        if (start > 0) shape += ' ';
+        bool hasDigit = false;
+        for (char c : word)
+            if (isDigit(c)) {
+                hasDigit = true;
+                break;
+            }
+        if (!hasDigit) shape += word;
+        else if (isTimestampToken(word)) shape += "<TS>";
+        else {
+            replaceUuids(word, scratch);
+            replaceHex(scratch, scratch2);
+            replaceNumbers(scratch2, shape);
+        }
+        if (end == std::string_view::npos) break;
+        start = end + 1;
+    }
+    return fnv1a(shape);
+}
+
+uint64_t TemplateIndex::templateOf(std::string_view message, const std::vector<std::string>& levels) {
+    uint64_t hash = shapeOf(message, shape_);
+    return templateOfShape(shape_, hash, levels);
+}
+
+uint64_t TemplateIndex::templateOfShape(std::string_view shape, uint64_t hash, const std::vector<std::string>& levels) {
+    if (const CachedShape* cached = cache_.find(hash); cached && cached->shape == shape) return cached->id;
+
+    tokenEnds_.clear();
+    for (size_t space = shape.find(' '); space != std::string_view::npos; space = shape.find(' ', space + 1))
+        tokenEnds_.push_back(space);
+    tokenEnds_.push_back(shape.size());
+    auto token = [&](size_t i) {
+        size_t begin = i == 0 ? 0 : tokenEnds_[i - 1] + 1;
+        return shape.substr(begin, tokenEnds_[i] - begin);
+    };
+    size_t count = tokenEnds_.size();
+
+    // The level token, which a matching template must have at the same place
+    size_t levelIndex = count;
+    for (size_t i = 0; i < count && levelIndex == count; i++)
+        for (const std::string& level : levels)
+            if (token(i).find(level) != std::string_view::npos) {
+                levelIndex = i;
+                break;
+            }
+    std::string_view level = levelIndex < count ? token(levelIndex) : std::string_view();
+
+    std::string_view leading = token(0);
+    groupKey_ = std::to_string(count);
+    groupKey_ += ':';
+    groupKey_ += !leading.empty() && leading[0] == '<' ? std::string_view("<*>") : leading;
+    groupKey_ += ':';
+    groupKey_ += level;
+    std::vector<Cluster>& group = groups_[groupKey_];
+
+    Cluster* match = nullptr;
+    for (Cluster& candidate : group) {
+        if (levelIndex < count && candidate.tokens[levelIndex] != level) continue;
+        size_t same = 0;
+        for (size_t i = 0; i < count; i++)
+            if (candidate.tokens[i] == token(i)) same++;
+        if (static_cast<double>(same) >= kSimilarity * static_cast<double>(count)) {
+            match = &candidate;
+            break;
+        }
+    }
+
+    uint64_t id;
+    if (match == nullptr) {
+        id = md5Prefix64(shape);
+        Cluster cluster{id, {}};
+        cluster.tokens.reserve(count);
+        for (size_t i = 0; i < count; i++) cluster.tokens.emplace_back(token(i));
+        group.push_back(std::move(cluster));
+        if (group.size() > kGroupLimit) group.erase(group.begin());
+    } else {
+        id = match->id;
+        for (size_t i = 0; i < count; i++)
+            if (match->tokens[i] != token(i)) match->tokens[i] = "<*>";
+    }
+
+    // A 64-bit hash collision leaves the newer shape uncached
+    if (cache_.size() >= kCacheLimit) cache_.clear();
+    bool inserted;
+    CachedShape& entry = cache_.insert(hash, inserted);
+    if (inserted) entry = CachedShape{std::string(shape), id};
+    return id;
+}
+
+void TemplateIndex::restoreCluster(std::string_view groupKey, uint64_t id, std::vector<std::string> tokens) {
+    groups_[std::string(groupKey)].push_back(Cluster{id, std::move(tokens)});
+}
+
+void TemplateIndex::restoreCached(uint64_t hash, std::string_view shape, uint64_t id) {
+    bool inserted;
+    cache_.insert(hash, inserted) = CachedShape{std::string(shape), id};
+}
+
+}  // namespace neurafilter
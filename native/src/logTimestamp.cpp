@@ -0,0 +1,198 @@
+// Mirrors utils/logTimestamp.deluge (and parseTimestamp() in the harness):
+// the first two tokens are tried as ISO-8601 date-times, yyyy-MM-dd dates
+// and epochs, the channel's cached format first. Local-time stamps use the
+// process time zone (TZ), as the harness does. Calendar values JavaScript
+// rejects (month 13, minute 60, ...) are not timestamps.
+#include <ctime>
+
+#include "stages.h"
+
+namespace neurafilter {
+
+namespace {
+
+inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+bool digitsAt(std::string_view s, size_t p, size_t n, int& value) {
+    if (p + n > s.size()) return false;
+    value = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (!isDigit(s[p + i])) return false;
+        value = value * 10 + (s[p + i] - '0');
+    }
+    return true;
+}
+
+// Days since 1970-01-01 of a proleptic Gregorian date (month may overflow)
+int64_t daysFromCivil(int64_t year, int64_t month, int64_t day) {
+    year += (month - 1) / 12;
+    month = (month - 1) % 12 + 1;
+    year -= month <= 2;
+    int64_t era = (year >= 0 ? year : year - 399) / 400;
+    int64_t yoe = year - era * 400;
+    int64_t doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+int64_t localMs(int year, int month, int day, int hour, int minute, int second) {
+    std::tm tm{};
+    tm.tm_year = year - 1900;
+    tm.tm_mon = month - 1;
+    tm.tm_mday = day;
+    tm.tm_hour = hour;
+    tm.tm_min = minute;
+    tm.tm_sec = second;
+    tm.tm_isdst = -1;
+    return static_cast<int64_t>(std::mktime(&tm)) * 1000;
+}
+
+// \d{4}-\d{2}-\d{2}T\d{2}:\d{2}:\d{2}(\.\d+)?(Z|[+-]\d{2}:?\d{2})?
+bool parseIso(std::string_view s, int64_t& timestamp) {
+    int year, month, day, hour, minute, second;
+    if (!(digitsAt(s, 0, 4, year) && s.size() >= 19 && s[4] == '-' && digitsAt(s, 5, 2, month) && s[7] == '-' &&
+          digitsAt(s, 8, 2, day) && s[10] == 'T' && digitsAt(s, 11, 2, hour) && s[13] == ':' &&
+          digitsAt(s, 14, 2, minute) && s[16] == ':' && digitsAt(s, 17, 2, second)))
+        return false;
+    size_t p = 19;
+    if (p + 1 < s.size() && s[p] == '.' && isDigit(s[p + 1])) {
+        p += 2;
+        while (p < s.size() && isDigit(s[p])) p++;
+    } else if (p < s.size() && s[p] == '.') {
+        return false;
+    }
+
+    bool zoned = false;
+    int offsetMinutes = 0;
+    if (p < s.size()) {
+        if (s[p] == 'Z') {
+            zoned = true;
+            p++;
+        } else if (s[p] == '+' || s[p] == '-') {
+            int sign = s[p] == '-' ? -1 : 1;
+            int hours, minutes;
+            if (!digitsAt(s, p + 1, 2, hours)) return false;
+            p += 3;
+            if (p < s.size() && s[p] == ':') p++;
+            if (!digitsAt(s, p, 2, minutes)) return false;
+            p += 2;
+            if (hours > 23 || minutes > 59) return false;
+            zoned = true;
+            offsetMinutes = sign * (hours * 60 + minutes);
+        }
+    }
+    if (p != s.size()) return false;
+
+    // Ranges Date accepts; day 29-31 roll over into the next month
+    if (month < 1 || month > 12 || day < 1 || day > 31 || hour > 24 || minute > 59 || second > 59) return false;
+    if (hour == 24 && (minute != 0 || second != 0)) return false;
+
+    if (!zoned) {
+        timestamp = localMs(year, month, day, hour, minute, second);
+        return true;
+    }
+    int64_t seconds = daysFromCivil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+    timestamp = (seconds - offsetMinutes * 60) * 1000;
+    return true;
+}
+
+// \d{4}-\d{2}-\d{2}: no time of day, so it resolves to now
+bool parseDate(std::string_view s, int64_t now, int64_t& timestamp) {
+    int year, month, day;
+    if (!(s.size() == 10 && digitsAt(s, 0, 4, year) && s[4] == '-' && digitsAt(s, 5, 2, month) && s[7] == '-' &&
+          digitsAt(s, 8, 2, day)))
+        return false;
+    timestamp = now;
+    return true;
+}
+
+bool parseEpoch(std::string_view s, int64_t& timestamp) {
+    if (s.size() != 13 && s.size() != 10) return false;
+    int64_t value = 0;
+    for (char c : s) {
+        if (!isDigit(c)) return false;
+        value = value * 10 + (c - '0');
+    }
+    timestamp = s.size() == 13 ? value : value * 1000;
+    return true;
+}
+
+constexpr TimestampFormat kFormats[] = {TimestampFormat::Iso, TimestampFormat::Date, TimestampFormat::Epoch};
+
+// The first two ' '-separated tokens; returns how many there are
+size_t leadingTokens(std::string_view message, std::string_view (&candidates)[2]) {
+    size_t count = 0;
+    size_t start = 0;
+    while (count < 2) {
+        size_t end = message.find(' ', start);
+        candidates[count++] = message.substr(start, end == std::string_view::npos ? std::string_view::npos : end - start);
+        if (end == std::string_view::npos) break;
+        start = end + 1;
+    }
+    return count;
+}
+
+// Formats in the order they are tried: the hint first
+size_t formatOrder(TimestampFormat hint, TimestampFormat (&order)[3]) {
+    size_t n = 0;
+    if (hint != TimestampFormat::None) order[n++] = hint;
+    for (TimestampFormat format : kFormats)
+        if (format != hint) order[n++] = format;
+    return n;
+}
+
+}  // namespace
+
+bool parseTimestamp(std::string_view value, TimestampFormat format, int64_t now, int64_t& timestamp) {
+    switch (format) {
+        case TimestampFormat::Iso: return parseIso(value, timestamp);
+        case TimestampFormat::Date: return parseDate(value, now, timestamp);
+        case TimestampFormat::Epoch: return parseEpoch(value, timestamp);
+        case TimestampFormat::None: break;
+    }
+    return false;
+}
+
+bool extractTimestamp(std::string_view message, TimestampFormat& hint, int64_t now, int64_t& timestamp) {
+    std::string_view candidates[2];
+    size_t count = leadingTokens(message, candidates);
+    TimestampFormat order[3];
+    size_t n = formatOrder(hint, order);
+
+    for (size_t f = 0; f < n; f++) {
+        for (size_t c = 0; c < count; c++) {
+            if (parseTimestamp(candidates[c], order[f], now, timestamp)) {
+                hint = order[f];
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void parseTimestampCandidates(std::string_view message, int64_t now, TimestampCandidates& out) {
+    std::string_view candidates[2];
+    size_t count = leadingTokens(message, candidates);
+    for (TimestampFormat format : kFormats) {
+        size_t f = static_cast<size_t>(format) - 1;
+        out.parsed[f] = false;
+        for (size_t c = 0; c < count && !out.parsed[f]; c++)
+            out.parsed[f] = parseTimestamp(candidates[c], format, now, out.value[f]);
+    }
+}
+
+bool pickTimestamp(const TimestampCandidates& candidates, TimestampFormat& hint, int64_t& timestamp) {
+    TimestampFormat order[3];
+    size_t n = formatOrder(hint, order);
+    for (size_t f = 0; f < n; f++) {
+        size_t index = static_cast<size_t>(order[f]) - 1;
+        if (candidates.parsed[index]) {
+            timestamp = candidates.value[index];
+            hint = order[f];
+            return true;
+        }
+    }
+    return false;
+}
+
+}  // namespace neurafilter
@@ -0,0 +1,62 @@
+#include "neurafilter/mappedLines.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace neurafilter {
+
+MappedLines::MappedLines(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("cannot open " + path + ": " + std::strerror(errno));
+    struct stat info;
+    if (::fstat(fd, &info) != 0) {
+        int error = errno;
+        ::close(fd);
+        throw std::runtime_error("cannot stat " + path + ": " + std::strerror(error));
+    }
+    size_ = static_cast<size_t>(info.st_size);
+    // mmap() rejects a zero length; an empty file simply has no lines
+    if (size_ > 0) {
+        void* mapping = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        int error = errno;
+        ::close(fd);
+        if (mapping == MAP_FAILED) throw std::runtime_error("cannot map " + path + ": " + std::strerror(error));
+        data_ = static_cast<const char*>(mapping);
+        ::madvise(mapping, size_, MADV_SEQUENTIAL);
+    } else {
+        ::close(fd);
+    }
+}
+
+MappedLines::~MappedLines() {
+    if (data_ != nullptr) ::munmap(const_cast<char*>(data_), size_);
+}
+
+bool MappedLines::next(std::string_view& line) {
+    if (offset_ >= size_) return false;
+    const char* begin = data_ + offset_;
+    const void* newline = std::memchr(begin, '\n', size_ - offset_);
+    size_t length = newline != nullptr ? static_cast<const char*>(newline) - begin : size_ - offset_;
+    offset_ += newline != nullptr ? length + 1 : length;
+    if (length > 0 && begin[length - 1] == '\r') length--;
+    line = std::string_view(begin, length);
+    return true;
+}
+
+void MappedLines::release() {
+    static const size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    size_t end = offset_ / page * page;
+    if (end <= released_) return;
+    // Read-only private pages: dropping them only means a later touch would
+    // fault them back in from the file
+    ::madvise(const_cast<char*>(data_) + released_, end - released_, MADV_DONTNEED);
+    released_ = end;
+}
+
+}  // namespace neurafilter
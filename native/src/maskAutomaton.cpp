@@ -0,0 +1,441 @@
+// Patterns -> syntax tree -> one Thompson NFA -> DFA by subset construction
+// (format and limits in maskAutomaton.h)
+#include "maskAutomaton.h"
+
+#include <algorithm>
+#include <bitset>
+#include <map>
+
+namespace neurafilter {
+
+namespace {
+
+using ByteBits = std::bitset<256>;
+
+constexpr size_t kMaxNfaStates = 20000;
+constexpr int kMaxRepeat = 1000;
+
+inline bool isWordByte(unsigned char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+ByteBits rangeBits(unsigned char first, unsigned char last) {
+    ByteBits bits;
+    for (unsigned c = first; c <= last; c++) bits.set(c);
+    return bits;
+}
+
+ByteBits digitBits() { return rangeBits('0', '9'); }
+ByteBits wordBits() { return rangeBits('0', '9') | rangeBits('a', 'z') | rangeBits('A', 'Z') | rangeBits('_', '_'); }
+ByteBits spaceBits() {
+    ByteBits bits;
+    for (unsigned char c : std::string_view(" \t\n\v\f\r")) bits.set(c);
+    return bits;
+}
+
+struct Node {
+    enum class Kind : uint8_t { Set, Boundary, Concat, Alt, Repeat } kind;
+    ByteBits bits;               // Set
+    bool boundary = true;        // Boundary: \b, or \B when false
+    std::vector<int> children;   // Concat, Alt; Repeat has one
+    int min = 0;
+    int max = -1;                // Repeat; -1 unbounded
+};
+
+// Recursive descent over the subset in maskAutomaton.h; ok turns false on
+// anything outside it
+class Parser {
+public:
+    Parser(std::string_view pattern, std::vector<Node>& nodes) : s_(pattern), nodes_(nodes) {}
+
+    int parse() {
+        int root = alternation();
+        if (i_ != s_.size()) ok_ = false;
+        return root;
+    }
+    bool ok() const { return ok_; }
+
+private:
+    int add(Node node) {
+        nodes_.push_back(std::move(node));
+        return static_cast<int>(nodes_.size() - 1);
+    }
+    int set(ByteBits bits) { return add({Node::Kind::Set, bits, true, {}, 0, -1}); }
+    bool more() const { return ok_ && i_ < s_.size(); }
+
+    int alternation() {
+        Node alt{Node::Kind::Alt, {}, true, {concatenation()}, 0, -1};
+        while (more() && s_[i_] == '|') {
+            i_++;
+            alt.children.push_back(concatenation());
+        }
+        return alt.children.size() == 1 ? alt.children[0] : add(std::move(alt));
+    }
+
+    int concatenation() {
+        Node concat{Node::Kind::Concat, {}, true, {}, 0, -1};
+        while (more() && s_[i_] != '|' && s_[i_] != ')') {
+            int atom = this->atom();
+            if (!ok_) break;
+            concat.children.push_back(quantified(atom));
+        }
+        return add(std::move(concat));
+    }
+
+    int quantified(int atom) {
+        if (!more()) return atom;
+        int min = 0, max = -1;
+        char c = s_[i_];
+        if (c == '*') {
+            i_++;
+        } else if (c == '+') {
+            min = 1;
+            i_++;
+        } else if (c == '?') {
+            max = 1;
+            i_++;
+        } else if (c == '{') {
+            i_++;
+            min = max = number();
+            if (more() && s_[i_] == ',') {
+                i_++;
+                max = more() && s_[i_] == '}' ? -1 : number();
+            }
+            if (!more() || s_[i_] != '}' || min < 0 || (max >= 0 && max < min) || std::max(min, max) > kMaxRepeat)
+                ok_ = false;
+            i_++;
+        } else {
+            return atom;
+        }
+        if (more() && s_[i_] == '?') i_++;   // lazy: the same strings match
+        if (nodes_[atom].kind == Node::Kind::Boundary) ok_ = false;
+        return add({Node::Kind::Repeat, {}, true, {atom}, min, max});
+    }
+
+    int number() {
+        size_t start = i_;
+        int value = 0;
+        while (i_ < s_.size() && s_[i_] >= '0' && s_[i_] <= '9' && value <= kMaxRepeat) value = value * 10 + (s_[i_++] - '0');
+        if (i_ == start) ok_ = false;
+        return value;
+    }
+
+    int atom() {
+        char c = s_[i_++];
+        switch (c) {
+            case '(': {
+                if (i_ < s_.size() && s_[i_] == '?') {
+                    if (i_ + 1 >= s_.size() || s_[i_ + 1] != ':') {
+                        ok_ = false;
+                        return 0;
+                    }
+                    i_ += 2;
+                }
+                int inner = alternation();
+                if (!more() || s_[i_] != ')') ok_ = false;
+                i_++;
+                return inner;
+            }
+            case '[':
+                return set(characterClass());
+            case '.':
+                return set(~(rangeBits('\n', '\n') | rangeBits('\r', '\r')));
+            case '\\': {
+                if (i_ >= s_.size()) {
+                    ok_ = false;
+                    return 0;
+                }
+                char e = s_[i_];
+                if (e == 'b' || e == 'B') {
+                    i_++;
+                    return add({Node::Kind::Boundary, {}, e == 'b', {}, 0, -1});
+                }
+                return set(escape());
+            }
+            case '^':
+            case '$':
+            case '*':
+            case '+':
+            case '?':
+            case '{':
+                ok_ = false;
+                return 0;
+            default:
+                return set(rangeBits(c, c));
+        }
+    }
+
+    // After the backslash: a set escape, a control escape or escaped punctuation
+    ByteBits escape() {
+        char e = s_[i_++];
+        switch (e) {
+            case 'd': return digitBits();
+            case 'D': return ~digitBits();
+            case 'w': return wordBits();
+            case 'W': return ~wordBits();
+            case 's': return spaceBits();
+            case 'S': return ~spaceBits();
+            case 't': return rangeBits('\t', '\t');
+            case 'n': return rangeBits('\n', '\n');
+            case 'r': return rangeBits('\r', '\r');
+            case 'f': return rangeBits('\f', '\f');
+            case 'v': return rangeBits('\v', '\v');
+            case 'x': {
+                unsigned value = 0;
+                for (int k = 0; k < 2; k++) {
+                    char h = i_ < s_.size() ? s_[i_++] : 0;
+                    int digit = h >= '0' && h <= '9' ? h - '0' : h >= 'a' && h <= 'f' ? h - 'a' + 10 : h >= 'A' && h <= 'F' ? h - 'A' + 10 : -1;
+                    if (digit < 0) ok_ = false;
+                    value = value * 16 + static_cast<unsigned>(std::max(digit, 0));
+                }
+                return rangeBits(static_cast<unsigned char>(value), static_cast<unsigned char>(value));
+            }
+            default:
+                // Letters and digits are escapes outside the subset (\p, \1, \u, ...)
+                if (isWordByte(static_cast<unsigned char>(e))) ok_ = false;
+                return rangeBits(static_cast<unsigned char>(e), static_cast<unsigned char>(e));
+        }
+    }
+
+    ByteBits characterClass() {
+        bool negate = i_ < s_.size() && s_[i_] == '^';
+        if (negate) i_++;
+        ByteBits bits;
+        while (more() && s_[i_] != ']') {
+            bool single = true;
+            ByteBits first = classAtom(single);
+            if (single && i_ + 1 < s_.size() && s_[i_] == '-' && s_[i_ + 1] != ']') {
+                i_++;
+                bool singleLast = true;
+                ByteBits last = classAtom(singleLast);
+                if (!singleLast) ok_ = false;
+                int lo = firstBit(first), hi = firstBit(last);
+                if (lo > hi) ok_ = false;
+                else bits |= rangeBits(static_cast<unsigned char>(lo), static_cast<unsigned char>(hi));
+            } else {
+                bits |= first;
+            }
+        }
+        if (!more()) ok_ = false;
+        i_++;
+        return negate ? ~bits : bits;
+    }
+
+    ByteBits classAtom(bool& single) {
+        char c = s_[i_++];
+        if (c != '\\') return rangeBits(c, c);
+        if (i_ >= s_.size()) {
+            ok_ = false;
+            return {};
+        }
+        char e = s_[i_];
+        if (e == 'b') {
+            i_++;
+            return rangeBits('\b', '\b');
+        }
+        single = std::string_view("dDwWsS").find(e) == std::string_view::npos;
+        return escape();
+    }
+
+    static int firstBit(const ByteBits& bits) {
+        for (int c = 0; c < 256; c++)
+            if (bits[c]) return c;
+        return 0;
+    }
+
+    std::string_view s_;
+    size_t i_ = 0;
+    bool ok_ = true;
+    std::vector<Node>& nodes_;
+};
+
+struct NfaState {
+    ByteBits bits;
+    int next = -1;               // on a byte in bits
+    std::vector<int> eps;
+    int boundaryNext = -1;       // when the boundary assertion holds
+    bool boundary = true;
+};
+
+class Nfa {
+public:
+    struct Fragment {
+        int in;
+        int out;   // has no edges yet
+    };
+
+    int add() {
+        states.emplace_back();
+        if (states.size() > kMaxNfaStates) tooBig = true;
+        return static_cast<int>(states.size() - 1);
+    }
+
+    Fragment build(const std::vector<Node>& nodes, int index) {
+        const Node& node = nodes[index];
+        if (tooBig) return empty();
+        switch (node.kind) {
+            case Node::Kind::Set: {
+                Fragment f{add(), add()};
+                states[f.in].bits = node.bits;
+                states[f.in].next = f.out;
+                return f;
+            }
+            case Node::Kind::Boundary: {
+                Fragment f{add(), add()};
+                states[f.in].boundaryNext = f.out;
+                states[f.in].boundary = node.boundary;
+                return f;
+            }
+            case Node::Kind::Concat: {
+                Fragment f = empty();
+                for (int child : node.children) f = concat(f, build(nodes, child));
+                return f;
+            }
+            case Node::Kind::Alt: {
+                Fragment f{add(), add()};
+                for (int child : node.children) {
+                    Fragment branch = build(nodes, child);
+                    states[f.in].eps.push_back(branch.in);
+                    states[branch.out].eps.push_back(f.out);
+                }
+                return f;
+            }
+            case Node::Kind::Repeat: {
+                Fragment f = empty();
+                for (int k = 0; k < node.min && !tooBig; k++) f = concat(f, build(nodes, node.children[0]));
+                if (node.max < 0) return concat(f, star(build(nodes, node.children[0])));
+                for (int k = node.min; k < node.max && !tooBig; k++) f = concat(f, optional(build(nodes, node.children[0])));
+                return f;
+            }
+        }
+        return empty();
+    }
+
+    Fragment empty() {
+        int s = add();
+        return {s, s};
+    }
+    Fragment concat(Fragment a, Fragment b) {
+        states[a.out].eps.push_back(b.in);
+        return {a.in, b.out};
+    }
+    Fragment star(Fragment f) {
+        Fragment loop{add(), add()};
+        states[loop.in].eps = {f.in, loop.out};
+        states[f.out].eps = {f.in, loop.out};
+        return loop;
+    }
+    Fragment optional(Fragment f) {
+        Fragment skip{add(), add()};
+        states[skip.in].eps = {f.in, skip.out};
+        states[f.out].eps.push_back(skip.out);
+        return skip;
+    }
+
+    // States reachable from raw (plus the start, as a match may begin
+    // anywhere) without reading a byte, between a byte of the given word-ness
+    // and the next; true as soon as that reaches the accepting state
+    bool closure(const std::vector<int>& raw, bool prevWord, bool nextWord, std::vector<int>& out) {
+        out.clear();
+        if (seen.size() != states.size()) seen.assign(states.size(), 0);
+        generation++;
+        stack.assign(raw.begin(), raw.end());
+        stack.push_back(start);
+        bool accepted = false;
+        while (!stack.empty()) {
+            int s = stack.back();
+            stack.pop_back();
+            if (seen[s] == generation) continue;
+            seen[s] = generation;
+            if (s == accept) accepted = true;
+            const NfaState& state = states[s];
+            if (state.next >= 0) out.push_back(s);
+            for (int e : state.eps) stack.push_back(e);
+            if (state.boundaryNext >= 0 && (prevWord != nextWord) == state.boundary) stack.push_back(state.boundaryNext);
+        }
+        return accepted;
+    }
+
+    std::vector<NfaState> states;
+    int start = -1;
+    int accept = -1;
+    bool tooBig = false;
+
+private:
+    std::vector<uint32_t> seen;
+    uint32_t generation = 0;
+    std::vector<int> stack;
+};
+
+}  // namespace
+
+std::optional<MaskAutomaton> MaskAutomaton::compile(const std::vector<std::string>& patterns) {
+    std::vector<Node> nodes;
+    Node top{Node::Kind::Alt, {}, true, {}, 0, -1};
+    for (const std::string& pattern : patterns) {
+        Parser parser(pattern, nodes);
+        int root = parser.parse();
+        if (!parser.ok()) return std::nullopt;
+        top.children.push_back(root);
+    }
+    nodes.push_back(std::move(top));
+
+    Nfa nfa;
+    Nfa::Fragment whole = nfa.build(nodes, static_cast<int>(nodes.size() - 1));
+    if (nfa.tooBig) return std::nullopt;
+    nfa.start = whole.in;
+    nfa.accept = whole.out;
+
+    // Byte classes: bytes every byte set and \b treat alike share a column
+    MaskAutomaton dfa;
+    std::vector<ByteBits> sets;
+    for (const NfaState& state : nfa.states)
+        if (state.next >= 0 && std::find(sets.begin(), sets.end(), state.bits) == sets.end()) sets.push_back(state.bits);
+    std::map<std::vector<bool>, uint8_t> classIds;
+    std::vector<unsigned char> representative;
+    for (unsigned c = 0; c < 256; c++) {
+        std::vector<bool> signature{isWordByte(static_cast<unsigned char>(c))};
+        for (const ByteBits& bits : sets) signature.push_back(bits[c]);
+        auto [found, added] = classIds.emplace(std::move(signature), static_cast<uint8_t>(classIds.size()));
+        if (added) representative.push_back(static_cast<unsigned char>(c));
+        dfa.classOf_[c] = found->second;
+    }
+    dfa.classes_ = static_cast<uint32_t>(representative.size());
+
+    // Subset construction. A DFA state is the NFA states waiting on a byte
+    // plus whether the byte before was a word byte; the start is always added
+    // during the closure, so an unmatched prefix never needs a state of its own.
+    using Key = std::pair<bool, std::vector<int>>;
+    std::map<Key, int32_t> ids;
+    std::vector<Key> pending{{false, {}}};
+    ids.emplace(pending.front(), 0);
+    std::vector<int> closed;
+    for (size_t id = 0; id < pending.size(); id++) {
+        Key key = pending[id];
+        dfa.acceptsAtEnd_.push_back(nfa.closure(key.second, key.first, false, closed));
+        dfa.table_.resize((id + 1) * dfa.classes_);
+        for (uint32_t k = 0; k < dfa.classes_; k++) {
+            unsigned char c = representative[k];
+            bool word = isWordByte(c);
+            int32_t& cell = dfa.table_[id * dfa.classes_ + k];
+            if (nfa.closure(key.second, key.first, word, closed)) {
+                cell = -1;
+                continue;
+            }
+            Key next{word, {}};
+            for (int s : closed)
+                if (nfa.states[s].bits[c]) next.second.push_back(nfa.states[s].next);
+            std::sort(next.second.begin(), next.second.end());
+            next.second.erase(std::unique(next.second.begin(), next.second.end()), next.second.end());
+            auto [found, added] = ids.emplace(next, static_cast<int32_t>(pending.size()));
+            if (added) {
+                if (pending.size() >= kMaskDfaStates) return std::nullopt;
+                pending.push_back(std::move(next));
+            }
+            cell = found->second;
+        }
+    }
+    return dfa;
+}
+
+}  // namespace neurafilter
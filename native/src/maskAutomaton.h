@@ -0,0 +1,55 @@
+// One DFA for a channel's masking rules (the pre-check of MaskRuleSet)
+//
+// Most lines match none of a channel's rules, so the question asked of every
+// line is only "does any pattern match anywhere in it". The patterns are
+// compiled together (parsed, turned into one NFA, then determinized up front)
+// into a table with one row per state and one column per byte class, so
+// answering it is one table load per byte however many rules there are;
+// std::regex then does the replacements on the lines it says yes to. \b and
+// \B are resolved by keeping whether the previous byte was a word byte in the
+// state. The DFA is built whole at compile time, so any number of threads may
+// search it at once.
+//
+// The syntax understood is the subset the rules are written in (see
+// utils/maskSensitive.deluge): literals and escapes, ., \d \w \s and their
+// negations, classes, groups and (?:...), alternation, greedy or lazy
+// quantifiers, \b and \B. compile() returns nullopt for anything else
+// (anchors, lookaround, backreferences) or past kMaskDfaStates states, and the
+// caller searches with std::regex instead.
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace neurafilter {
+
+constexpr size_t kMaskDfaStates = 4096;
+
+class MaskAutomaton {
+public:
+    static std::optional<MaskAutomaton> compile(const std::vector<std::string>& patterns);
+
+    // Whether any of the patterns matches somewhere in text
+    bool search(std::string_view text) const {
+        uint32_t state = 0;
+        for (unsigned char c : text) {
+            int32_t next = table_[state * classes_ + classOf_[c]];
+            if (next < 0) return true;
+            state = static_cast<uint32_t>(next);
+        }
+        return acceptsAtEnd_[state];
+    }
+
+    size_t states() const { return acceptsAtEnd_.size(); }
+
+private:
+    uint8_t classOf_[256] = {};
+    uint32_t classes_ = 0;
+    std::vector<int32_t> table_;       // state * classes_ + class -> state, or -1 on a match
+    std::vector<bool> acceptsAtEnd_;   // a match that ends with the text
+};
+
+}  // namespace neurafilter
@@ -0,0 +1,247 @@
+// Mirrors utils/maskSensitive.deluge (and maskSensitive() in the harness):
+// the same trigger pre-check, the same per-word rules in the same order.
+// Each rule is a hand-written matcher for its regex with the regex's
+// leftmost-longest result, so masked text is byte-identical:
+//   token  (Bearer|Token)\s+[A-Za-z0-9\-\._]+   case-insensitive, whole line
+//   email  [A-Za-z0-9._%+-]+@[A-Za-z0-9.-]+\.[A-Za-z]{2,}
+//   ip     \b(?:\d{1,3}\.){3}\d{1,3}\b
+//   url    https?:\/\/[^\s]+
+//   path   (\/[\w\-.]+)+
+// Character classes are ASCII, as in the regexes; \s is ASCII whitespace.
+//
+// The pre-check is one vectorized pass (byteScan.h), and only the words
+// around '@', '.' and '/' bytes reach the per-word rules; the rest of the
+// line is copied through in runs.
+//
+// A channel's own rules (MaskRuleSet) run before all of this. They are
+// arbitrary patterns, compiled once per config version: every line gets one
+// pass of the rules' combined DFA (maskAutomaton.h), and only the lines it
+// finds something in get a std::regex replacement pass per rule.
+#include <iterator>
+
+#include "byteScan.h"
+#include "stages.h"
+
+namespace neurafilter {
+
+namespace {
+
+inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+inline bool isAlpha(char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); }
+inline bool isWord(char c) { return isDigit(c) || isAlpha(c) || c == '_'; }
+inline bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f'; }
+inline char lower(char c) { return c >= 'A' && c <= 'Z' ? static_cast<char>(c + 32) : c; }
+inline bool isTokenChar(char c) { return isDigit(c) || isAlpha(c) || c == '-' || c == '.' || c == '_'; }
+inline bool isLocalChar(char c) {
+    return isDigit(c) || isAlpha(c) || c == '.' || c == '_' || c == '%' || c == '+' || c == '-';
+}
+inline bool isDomainChar(char c) { return isDigit(c) || isAlpha(c) || c == '.' || c == '-'; }
+inline bool isPathChar(char c) { return isWord(c) || c == '-' || c == '.'; }
+
+// A matcher returns the end of the match starting at i, or npos
+constexpr size_t npos = std::string_view::npos;
+
+size_t matchToken(std::string_view s, size_t i) {
+    static constexpr std::string_view kWords[] = {"bearer", "token"};
+    for (std::string_view word : kWords) {
+        if (i + word.size() > s.size()) continue;
+        size_t j = 0;
+        while (j < word.size() && lower(s[i + j]) == word[j]) j++;
+        if (j < word.size()) continue;
+        size_t p = i + word.size();
+        size_t spaces = p;
+        while (p < s.size() && isSpace(s[p])) p++;
+        if (p == spaces) return npos;
+        size_t value = p;
+        while (p < s.size() && isTokenChar(s[p])) p++;
+        return p > value ? p : npos;
+    }
+    return npos;
+}
+
+// Email matches are found from their '@': the local part is the run of
+// local-part characters before it (leftmost start, but not before the end of
+// the previous match), the domain the longest run after it that still ends
+// in ".<2+ letters>"
+size_t emailDomainEnd(std::string_view s, size_t domain) {
+    size_t end = domain;
+    while (end < s.size() && isDomainChar(s[end])) end++;
+    for (size_t dot = end; dot-- > domain + 1;) {
+        if (s[dot] != '.') continue;
+        size_t letters = dot + 1;
+        while (letters < end && isAlpha(s[letters])) letters++;
+        if (letters - dot - 1 >= 2) return letters;
+    }
+    return npos;
+}
+
+bool replaceEmails(std::string_view s, std::string& out) {
+    size_t copied = 0;
+    bool any = false;
+    for (size_t at = s.find('@'); at != npos; at = s.find('@', at + 1)) {
+        size_t begin = at;
+        while (begin > copied && isLocalChar(s[begin - 1])) begin--;
+        if (begin == at) continue;
+        size_t end = emailDomainEnd(s, at + 1);
+        if (end == npos) continue;
+        if (!any) out.clear(), any = true;
+        out.append(s.data() + copied, begin - copied);
+        out.append("[REDACTED_EMAIL]");
+        copied = end;
+        at = end - 1;
+    }
+    if (any) out.append(s.data() + copied, s.size() - copied);
+    return any;
+}
+
+bool boundary(std::string_view s, size_t p) {
+    bool before = p > 0 && isWord(s[p - 1]);
+    bool after = p < s.size() && isWord(s[p]);
+    return before != after;
+}
+
+size_t matchOctets(std::string_view s, size_t p, int group) {
+    size_t run = 0;
+    while (run < 3 && p + run < s.size() && isDigit(s[p + run])) run++;
+    for (size_t length = run; length >= 1; length--) {
+        size_t q = p + length;
+        if (group < 3) {
+            if (q < s.size() && s[q] == '.') {
+                size_t end = matchOctets(s, q + 1, group + 1);
+                if (end != npos) return end;
+            }
+        } else if (boundary(s, q)) {
+            return q;
+        }
+    }
+    return npos;
+}
+
+size_t matchIp(std::string_view s, size_t i) {
+    if (!isDigit(s[i]) || !boundary(s, i)) return npos;
+    return matchOctets(s, i, 0);
+}
+
+size_t matchUrl(std::string_view s, size_t i) {
+    if (s.compare(i, 4, "http") != 0) return npos;
+    size_t p = i + 4;
+    if (p < s.size() && s[p] == 's') p++;
+    if (s.compare(p, 3, "://") != 0) return npos;
+    p += 3;
+    size_t rest = p;
+    while (p < s.size() && !isSpace(s[p])) p++;
+    return p > rest ? p : npos;
+}
+
+size_t matchPath(std::string_view s, size_t i) {
+    size_t end = npos;
+    size_t p = i;
+    while (p < s.size() && s[p] == '/') {
+        size_t q = p + 1;
+        while (q < s.size() && isPathChar(s[q])) q++;
+        if (q == p + 1) break;
+        end = p = q;
+    }
+    return end;
+}
+
+// Global replace of one rule's matches into out; false if nothing matched
+template <typename Match>
+bool replaceAll(std::string_view s, Match match, std::string_view mask, std::string& out) {
+    size_t copied = 0;
+    bool any = false;
+    for (size_t i = 0; i < s.size();) {
+        size_t end = match(s, i);
+        if (end == npos) {
+            i++;
+            continue;
+        }
+        if (!any) out.clear(), any = true;
+        out.append(s.data() + copied, i - copied);
+        out.append(mask);
+        copied = i = end;
+    }
+    if (any) out.append(s.data() + copied, s.size() - copied);
+    return any;
+}
+
+// One rule on a word held in word (swapping with scratch when it matches)
+template <typename Match>
+void applyRule(std::string& word, std::string& scratch, Match match, std::string_view mask) {
+    if (replaceAll(word, match, mask, scratch)) word.swap(scratch);
+}
+
+}  // namespace
+
+MaskRuleSet::MaskRuleSet(const FilterConfig& config) : version_(config.version), source_(config.maskRules) {
+    constexpr auto kSyntax = std::regex::ECMAScript | std::regex::optimize;
+    std::vector<std::string> patterns;
+    std::string alternatives;
+    for (const MaskRule& rule : source_) {
+        // /configFilter rejects patterns that do not compile; one written
+        // into the config by hand, or valid only in Deluge's dialect, is
+        // dropped here so the set is still cached
+        try {
+            rules_.emplace_back(std::regex(rule.pattern, kSyntax), "[REDACTED_" + rule.label + "]");
+        } catch (const std::regex_error&) {
+            continue;
+        }
+        if (!alternatives.empty()) alternatives += '|';
+        alternatives += "(?:" + rule.pattern + ")";
+        patterns.push_back(rule.pattern);
+    }
+    if (rules_.empty()) return;
+    automaton_ = MaskAutomaton::compile(patterns);
+    if (!automaton_) trigger_ = std::regex(alternatives, kSyntax);
+}
+
+bool MaskRuleSet::apply(std::string_view log, std::string& out) const {
+    if (rules_.empty()) return false;
+    bool hit = automaton_ ? automaton_->search(log) : std::regex_search(log.begin(), log.end(), trigger_);
+    if (!hit) return false;
+    out.assign(log);
+    std::string replaced;
+    for (const auto& [pattern, replacement] : rules_) {
+        replaced.clear();
+        std::regex_replace(std::back_inserter(replaced), out.begin(), out.end(), pattern, replacement);
+        out.swap(replaced);
+    }
+    return true;
+}
+
+std::string_view maskSensitive(std::string_view log, Arena& arena, const MaskRuleSet* rules) {
+    thread_local std::string ruled, line, word, scratch;
+    bool rewritten = rules != nullptr && rules->apply(log, ruled);
+    if (rewritten) log = ruled;
+
+    MaskTriggers triggers = scanMaskTriggers(log);
+    if (!triggers.any()) return rewritten ? arena.copy(log) : log;
+
+    if (triggers.token && replaceAll(log, matchToken, "[REDACTED_TOKEN]", line)) log = line;
+    if (!triggers.at && !triggers.slash && !triggers.digitDot) return arena.copy(log);
+
+    // Same as masking every ' '-separated word: words without one of these
+    // bytes come out unchanged
+    static const ByteSet kWordTriggers("@./");
+    Arena::Builder out(arena);
+    size_t copied = 0;
+    for (size_t hit = kWordTriggers.find(log); hit < log.size(); hit = kWordTriggers.find(log, copied)) {
+        size_t begin = hit;
+        while (begin > copied && log[begin - 1] != ' ') begin--;
+        size_t end = log.find(' ', hit);
+        if (end == npos) end = log.size();
+        out.append(log.substr(copied, begin - copied));
+
+        word.assign(log.substr(begin, end - begin));
+        if (word.find('@') != npos && replaceEmails(word, scratch)) word.swap(scratch);
+        if (word.find('.') != npos) applyRule(word, scratch, matchIp, "[REDACTED_IP]");
+        if (word.find("://") != npos) applyRule(word, scratch, matchUrl, "[REDACTED_URL]");
+        if (word.find('/') != npos) applyRule(word, scratch, matchPath, "[REDACTED_PATH]");
+        out.append(word);
+        copied = end;
+    }
+    out.append(log.substr(copied));
+    return out.finish();
+}
+
+}  // namespace neurafilter
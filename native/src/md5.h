@@ -0,0 +1,17 @@
+// MD5, for template ids that match zoho.encryption.md5() in the services
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace neurafilter {
+
+// First 64 bits of MD5(text), big-endian, i.e. the value of the first 16
+// hex digits that fingerprint() in services/logFilter.deluge keeps
+uint64_t md5Prefix64(std::string_view text);
+
+// 16 lowercase hex digits for a 64-bit id
+std::string hexId(uint64_t id);
+
+}  // namespace neurafilter
@@ -0,0 +1,61 @@
+// Mirrors utils/rateLimiter.deluge (and the harness limiter): the token
+// bucket is replayed from the channel's posts in the last rate_window_ms,
+// starting full, and lines denied a token wait in a bounded queue that goes
+// out as a digest with the next post.
+#include <algorithm>
+
+#include "stages.h"
+
+namespace neurafilter {
+
+bool checkRateLimit(ChannelShard& shard, const FilterConfig& config, int64_t now) {
+    shard.hasBucket = true;
+    double rate = config.rateLimit;
+    double window = static_cast<double>(config.rateWindowMs);
+    double burst = config.rateBurst;
+
+    // Posts are kept in time order, one record per distinct time
+    double tokens = burst;
+    int64_t last = now - config.rateWindowMs;
+    for (const PostCount& post : shard.posts) {
+        if (post.time <= now - config.rateWindowMs) continue;
+        tokens = std::min(burst, tokens + static_cast<double>(post.time - last) * rate / window) - post.n;
+        last = post.time;
+    }
+    tokens = std::min(burst, tokens + static_cast<double>(now - last) * rate / window);
+    if (tokens < 1) return false;
+
+    if (!shard.posts.empty() && shard.posts.back().time == now) shard.posts.back().n++;
+    else shard.posts.push_back({now, 1});
+    return true;
+}
+
+bool queueOverflow(ChannelShard& shard, const Result& result) {
+    QueuedResult queued{result.action, result.reason, std::string(result.message), result.score, result.timestamp};
+    if (shard.queue.size() < kMaxQueue) {
+        shard.queue.push_back(std::move(queued));
+        return true;
+    }
+
+    // Full: pre-empt the lowest-score queued line if this one ranks higher
+    size_t lowest = 0;
+    for (size_t i = 1; i < shard.queue.size(); i++)
+        if (shard.queue[i].score < shard.queue[lowest].score) lowest = i;
+    shard.dropped++;
+    if (queued.score > shard.queue[lowest].score) {
+        shard.queue[lowest] = std::move(queued);
+        return true;
+    }
+    return false;
+}
+
+// Highest score first; equal scores keep their queue order
+std::vector<QueuedResult> drainOverflow(ChannelShard& shard) {
+    std::vector<QueuedResult> drained;
+    drained.swap(shard.queue);
+    std::stable_sort(drained.begin(), drained.end(),
+                     [](const QueuedResult& a, const QueuedResult& b) { return a.score > b.score; });
+    return drained;
+}
+
+}  // namespace neurafilter
@@ -0,0 +1,198 @@
+// Mirrors scoreMessage() in utils/scoringRules.deluge, compiled the way
+// compileScoringRules() in the harness does it: every level token and
+// keyword in one Aho-Corasick automaton over ASCII-lowercased bytes, so a
+// line is scanned once. Keywords match case-insensitively; level tokens are
+// case-sensitive and are verified against the original bytes on a hit.
+// While the automaton is at its root, the scan jumps ahead to the next byte
+// that starts a pattern (byteScan.h).
+#include <fstream>
+#include <queue>
+#include <sstream>
+#include <stdexcept>
+
+#include "neurafilter/json.h"
+#include "stages.h"
+
+namespace neurafilter {
+
+namespace {
+
+inline unsigned char fold(unsigned char c) { return c >= 'A' && c <= 'Z' ? c + 32 : c; }
+
+double number(const json::Value& object, std::string_view key, double fallback) {
+    const json::Value* value = object.find(key);
+    return value && value->isNumber() ? value->asNumber() : fallback;
+}
+
+}  // namespace
+
+ScoringRules ScoringRules::defaults() {
+    ScoringRules rules;
+    rules.version = 1;
+    rules.levels = {{"ERROR", 3}, {"WARN", 2}, {"INFO", 1}};
+    rules.keywords = {"exception", "fail", "timeout", "crash"};
+    rules.recencyBoost = 1;
+    return rules;
+}
+
+ScoringRules ScoringRules::fromJson(const json::Value& value) {
+    if (!value.isObject()) throw std::runtime_error("scoring rules must be an object");
+    ScoringRules rules;
+    rules.version = static_cast<int64_t>(number(value, "version", 1));
+    if (const json::Value* levels = value.find("levels"))
+        for (const json::Value& level : levels->items()) {
+            const json::Value* token = level.find("token");
+            if (!token || !token->isString()) throw std::runtime_error("scoring level without a token");
+            rules.levels.push_back({token->asString(), number(level, "weight", 0)});
+        }
+    if (const json::Value* keywords = value.find("keywords"))
+        for (const json::Value& keyword : keywords->items())
+            if (keyword.isString()) rules.keywords.push_back(keyword.asString());
+    rules.recencyBoost = number(value, "recency_boost", 0);
+    return rules;
+}
+
+// The literal returned by scoringRules(), located the way the harness's
+// readDelugeLiteral() does it
+ScoringRules ScoringRules::fromDelugeFile(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) throw std::runtime_error("cannot read " + path);
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    std::string source = buffer.str();
+
+    size_t head = source.find("scoringRules = () =>");
+    size_t open = head == std::string::npos ? head : source.find("return {", head);
+    if (open == std::string::npos) throw std::runtime_error("no scoringRules() literal in " + path);
+    open += 7;
+    int depth = 0;
+    bool quoted = false;
+    for (size_t i = open; i < source.size(); i++) {
+        char c = source[i];
+        if (quoted) {
+            if (c == '\\') i++;
+            else if (c == '"') quoted = false;
+        } else if (c == '"') {
+            quoted = true;
+        } else if (c == '{') {
+            depth++;
+        } else if (c == '}' && --depth == 0) {
+            return fromJson(json::parse(std::string_view(source).substr(open, i + 1 - open)));
+        }
+    }
+    throw std::runtime_error("unterminated scoringRules() literal in " + path);
+}
+
+// Both cases of the first two bytes of token, for the root skip
+void Scorer::addPrefix(std::string_view token, unsigned bucket) {
+    if (token.empty()) return;
+    auto cases = [](unsigned char c) {
+        unsigned char folded = fold(c);
+        return std::pair<unsigned char, unsigned char>(folded, folded >= 'a' && folded <= 'z' ? folded - 32 : folded);
+    };
+    auto [first, firstUpper] = cases(static_cast<unsigned char>(token[0]));
+    if (token.size() == 1) {
+        prefixes_.addSingle(first, bucket);
+        prefixes_.addSingle(firstUpper, bucket);
+        return;
+    }
+    auto [second, secondUpper] = cases(static_cast<unsigned char>(token[1]));
+    // Nibble tables take the union, so all four case pairs are in
+    prefixes_.add(first, second, bucket);
+    prefixes_.add(firstUpper, secondUpper, bucket);
+}
+
+Scorer::Scorer(const ScoringRules& rules) : recencyBoost_(rules.recencyBoost) {
+    for (size_t i = 0; i < rules.levels.size(); i++) {
+        patterns_.push_back({rules.levels[i].token, true, i, rules.levels[i].weight});
+        levelTokens_.push_back(rules.levels[i].token);
+    }
+    for (const std::string& keyword : rules.keywords) patterns_.push_back({keyword, false, 0, 0});
+
+    // Trie over folded bytes, -1 for a missing edge
+    next_.assign(256, -1);
+    out_.emplace_back();
+    for (size_t index = 0; index < patterns_.size(); index++) {
+        int32_t node = 0;
+        for (unsigned char c : patterns_[index].token) {
+            int32_t& edge = next_[node * 256 + fold(c)];
+            if (edge < 0) {
+                edge = static_cast<int32_t>(out_.size());
+                out_.emplace_back();
+                next_.resize(next_.size() + 256, -1);
+            }
+            node = next_[node * 256 + fold(c)];
+        }
+        out_[node].push_back(static_cast<uint16_t>(index));
+        addPrefix(patterns_[index].token, static_cast<unsigned>(index % 8));
+    }
+    skipAtRoot_ = out_[0].empty();
+
+    // Breadth-first fail links, completing every node into a full DFA row
+    std::vector<int32_t> fail(out_.size(), 0);
+    std::queue<int32_t> pending;
+    for (int c = 0; c < 256; c++) {
+        int32_t& edge = next_[c];
+        if (edge < 0) edge = 0;
+        else pending.push(edge);
+    }
+    while (!pending.empty()) {
+        int32_t node = pending.front();
+        pending.pop();
+        for (uint16_t index : out_[fail[node]]) out_[node].push_back(index);
+        for (int c = 0; c < 256; c++) {
+            int32_t& edge = next_[node * 256 + c];
+            int32_t viaFail = next_[fail[node] * 256 + c];
+            if (edge < 0) {
+                edge = viaFail;
+            } else {
+                fail[edge] = viaFail;
+                pending.push(edge);
+            }
+        }
+    }
+}
+
+double Scorer::score(std::string_view message, int64_t ageMs, const FilterConfig& config) const {
+    return withRecency(matchScore(message, config), ageMs, config);
+}
+
+LineMatch Scorer::match(std::string_view message, const FilterConfig& config) const {
+    const Pattern* best = nullptr;
+    bool keyword = false;
+    int32_t node = 0;
+    for (size_t i = 0; i < message.size(); i++) {
+        // At the root, a byte that starts no two-byte prefix with the next
+        // one leaves the automaton where skipping it would
+        if (node == 0 && skipAtRoot_) {
+            i = prefixes_.find(message, i);
+            if (i == message.size()) break;
+        }
+        node = next_[node * 256 + fold(static_cast<unsigned char>(message[i]))];
+        for (uint16_t index : out_[node]) {
+            const Pattern& pattern = patterns_[index];
+            if (!pattern.level) {
+                keyword = true;
+            } else if ((best == nullptr || pattern.order < best->order) &&
+                       message.compare(i + 1 - pattern.token.size(), pattern.token.size(), pattern.token) == 0) {
+                best = &pattern;
+            }
+        }
+        if (keyword && best != nullptr && best->order == 0) break;
+    }
+
+    LineMatch match;
+    if (best) {
+        match.score = best->weight;
+        match.level = best->token;
+    }
+    match.keyword = keyword;
+    if (keyword) match.score += config.keywordBoost;
+    return match;
+}
+
+double Scorer::withRecency(double matched, int64_t ageMs, const FilterConfig& config) const {
+    return ageMs < config.recencyWindowMs ? matched + recencyBoost_ : matched;
+}
+
+}  // namespace neurafilter
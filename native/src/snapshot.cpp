@@ -0,0 +1,664 @@
+#include "snapshot.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_set>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace neurafilter {
+
+namespace {
+
+constexpr char kMagic[8] = {'N', 'F', 'S', 'N', 'A', 'P', 0, 0};
+constexpr uint32_t kByteOrder = 0x01020304;
+
+// Every record spells out its padding, so a record initialized with {}
+// writes no stray bytes
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t indexOffset;
+    uint64_t indexBytes;
+    uint64_t liveBytes;
+    uint64_t channels;
+    uint64_t indexChecksum;
+    uint64_t reserved;
+};
+
+struct IndexRecord {
+    uint64_t offset;
+    uint64_t bytes;
+    uint64_t checksum;
+    uint32_t nameOffset;   // into the names after the records
+    uint32_t nameLength;
+};
+
+struct StringRef {
+    uint32_t offset;       // into the section's strings
+    uint32_t length;
+};
+
+struct ShardHeader {
+    uint64_t nextOrder;
+    int64_t lastSweep;
+    uint64_t evictedExpired;
+    uint64_t evictedLru;
+    uint64_t dropped;
+    uint32_t entries, windows, cells, sightings, posts, queued, clusters, cached, stringBytes;
+    uint8_t hasMetrics, hasBucket, timestampFormat, hasSketch;
+};
+
+struct EntryRecord {
+    uint64_t key;
+    int64_t lastSeen;
+    int64_t lastAccess;
+    double score;
+    uint64_t order;
+};
+
+// A window counter's ring cells with sightings in them follow in cells;
+// the empty ones read back untagged, which counts the same
+struct WindowRecord {
+    uint64_t key;
+    int64_t lastSlot;
+    uint32_t live;
+    uint32_t cells;
+};
+
+struct CellRecord {
+    int64_t tag;
+    uint32_t count;
+    uint32_t index;
+};
+
+struct SightingRecord {
+    int64_t at;
+    uint64_t key;
+    int64_t slot;
+};
+
+struct PostRecord {
+    int64_t time;
+    uint32_t n, pad;
+};
+
+struct QueuedRecord {
+    double score;
+    int64_t timestamp;
+    StringRef message;
+    uint8_t action, reason, pad[6];
+};
+
+struct ClusterRecord {
+    uint64_t id;
+    StringRef group;
+    StringRef tokens;      // joined with ' ', which no normalized token contains
+    uint32_t tokenCount, pad;
+};
+
+struct CachedRecord {
+    uint64_t hash;
+    uint64_t id;
+    StringRef shape;
+};
+
+// Approximate mode state, after the strings: this record, the Count-Min
+// slice tags and dedup slice tags, the counts (padded to 8 bytes), the
+// dedup filter words, then heavy hitters and the sketch's sightings
+struct SketchRecord {
+    int64_t newestSlot;
+    uint64_t live;
+    int64_t sliceMs;
+    int64_t newestSlice;
+    uint64_t nextOrder;
+    uint32_t depth, width, bits, hashes, topK, heavy, sightings;
+    uint8_t hasSlice, pad[3];
+};
+
+struct HeavyRecord {
+    uint64_t key;
+    uint64_t count;
+    uint64_t error;
+    uint64_t order;
+};
+
+static_assert(sizeof(SketchRecord) == 72 && sizeof(HeavyRecord) == 32);
+static_assert(sizeof(FileHeader) == 64 && sizeof(IndexRecord) == 32 && sizeof(ShardHeader) == 80);
+static_assert(sizeof(EntryRecord) == 40 && sizeof(WindowRecord) == 24 && sizeof(SightingRecord) == 24);
+static_assert(sizeof(PostRecord) == 16 && sizeof(QueuedRecord) == 32 && sizeof(ClusterRecord) == 32);
+static_assert(sizeof(CellRecord) == 16 && sizeof(CachedRecord) == 24);
+
+// FNV-1a over 8-byte words: cheap enough to run on every decode, and only
+// meant to catch damage
+uint64_t checksum(std::string_view bytes) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    size_t i = 0;
+    for (; i + 8 <= bytes.size(); i += 8) {
+        uint64_t word;
+        std::memcpy(&word, bytes.data() + i, 8);
+        hash = (hash ^ word) * 0x100000001b3ull;
+    }
+    for (; i < bytes.size(); i++) hash = (hash ^ static_cast<uint8_t>(bytes[i])) * 0x100000001b3ull;
+    return hash;
+}
+
+uint64_t alignUp(uint64_t n) { return (n + 7) & ~uint64_t(7); }
+
+std::runtime_error systemError(const char* what, const std::string& path) {
+    return std::runtime_error(std::string(what) + " " + path + ": " + std::strerror(errno));
+}
+
+template <typename T>
+void append(std::string& out, const T& record) {
+    out.append(reinterpret_cast<const char*>(&record), sizeof record);
+}
+
+template <typename T>
+void appendAll(std::string& out, const std::vector<T>& records) {
+    out.append(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(T));
+}
+
+void encodeSketch(const FilterSketch& sketch, std::string& out) {
+    const CountMinSketch& counts = sketch.counts;
+    const DedupFilter& seen = sketch.seen;
+    SketchRecord record{};
+    record.newestSlot = counts.newestSlot;
+    record.live = counts.live;
+    record.sliceMs = seen.sliceMs;
+    record.newestSlice = seen.newestSlice;
+    record.nextOrder = sketch.nextOrder;
+    record.depth = counts.depth;
+    record.width = counts.width;
+    record.bits = seen.bits;
+    record.hashes = seen.hashes;
+    record.topK = sketch.topK;
+    record.heavy = static_cast<uint32_t>(sketch.heavy.size());
+    record.sightings = static_cast<uint32_t>(counts.sightings.size());
+    record.hasSlice = seen.hasSlice;
+    append(out, record);
+    append(out, counts.tags);
+    append(out, seen.tags);
+    appendAll(out, counts.cells);
+    out.resize(alignUp(out.size()), '\0');
+    appendAll(out, seen.words);
+    sketch.heavy.forEach([&](uint64_t key, const HeavyHitter& hitter) {
+        append(out, HeavyRecord{key, hitter.count, hitter.error, hitter.order});
+    });
+    for (const Sighting& sighting : counts.sightings) append(out, SightingRecord{sighting.at, sighting.key, sighting.slot});
+}
+
+void encodeShard(const ChannelShard& shard, std::string& out) {
+    std::string strings;
+    auto text = [&](std::string_view value) {
+        StringRef ref{static_cast<uint32_t>(strings.size()), static_cast<uint32_t>(value.size())};
+        strings += value;
+        return ref;
+    };
+
+    std::vector<EntryRecord> entries;
+    entries.reserve(shard.entries.size());
+    shard.entries.forEach([&](uint64_t key, const FilterEntry& entry) {
+        entries.push_back({key, entry.lastSeen, entry.lastAccess, entry.score, entry.order});
+    });
+    std::vector<WindowRecord> windows;
+    std::vector<CellRecord> cells;
+    windows.reserve(shard.windows.size());
+    shard.windows.forEach([&](uint64_t key, const WindowCounter& counter) {
+        WindowRecord record{key, counter.lastSlot, counter.live, 0};
+        for (uint32_t i = 0; i < kRingSize; i++) {
+            if (counter.counts[i] == 0) continue;
+            cells.push_back({counter.tags[i], counter.counts[i], i});
+            record.cells++;
+        }
+        windows.push_back(record);
+    });
+    std::vector<QueuedRecord> queued;
+    for (const QueuedResult& line : shard.queue) {
+        QueuedRecord record{};
+        record.score = line.score;
+        record.timestamp = line.timestamp;
+        record.message = text(line.message);
+        record.action = static_cast<uint8_t>(line.action);
+        record.reason = static_cast<uint8_t>(line.reason);
+        queued.push_back(record);
+    }
+    std::vector<ClusterRecord> clusters;
+    std::string joined;
+    shard.templates.forEachCluster([&](std::string_view group, uint64_t id, const std::vector<std::string>& tokens) {
+        joined.clear();
+        for (size_t i = 0; i < tokens.size(); i++) {
+            if (i > 0) joined += ' ';
+            joined += tokens[i];
+        }
+        ClusterRecord record{};
+        record.id = id;
+        record.group = text(group);
+        record.tokens = text(joined);
+        record.tokenCount = static_cast<uint32_t>(tokens.size());
+        clusters.push_back(record);
+    });
+    std::vector<CachedRecord> cached;
+    shard.templates.forEachCached([&](uint64_t hash, std::string_view shape, uint64_t id) {
+        cached.push_back({hash, id, text(shape)});
+    });
+
+    ShardHeader header{};
+    header.nextOrder = shard.nextOrder;
+    header.lastSweep = shard.lastSweep;
+    header.evictedExpired = shard.evictedExpired;
+    header.evictedLru = shard.evictedLru;
+    header.dropped = shard.dropped;
+    header.entries = static_cast<uint32_t>(entries.size());
+    header.windows = static_cast<uint32_t>(windows.size());
+    header.cells = static_cast<uint32_t>(cells.size());
+    header.sightings = static_cast<uint32_t>(shard.sightings.size());
+    header.posts = static_cast<uint32_t>(shard.posts.size());
+    header.queued = static_cast<uint32_t>(queued.size());
+    header.clusters = static_cast<uint32_t>(clusters.size());
+    header.cached = static_cast<uint32_t>(cached.size());
+    header.stringBytes = static_cast<uint32_t>(strings.size());
+    header.hasMetrics = shard.hasMetrics;
+    header.hasBucket = shard.hasBucket;
+    header.timestampFormat = static_cast<uint8_t>(shard.timestampFormat);
+    header.hasSketch = shard.sketch != nullptr;
+
+    out.clear();
+    append(out, header);
+    appendAll(out, entries);
+    appendAll(out, windows);
+    appendAll(out, cells);
+    for (const Sighting& sighting : shard.sightings) append(out, SightingRecord{sighting.at, sighting.key, sighting.slot});
+    for (const PostCount& post : shard.posts) append(out, PostRecord{post.time, post.n, 0});
+    appendAll(out, queued);
+    appendAll(out, clusters);
+    appendAll(out, cached);
+    out += strings;
+    out.resize(alignUp(out.size()), '\0');
+    if (shard.sketch) encodeSketch(*shard.sketch, out);
+}
+
+// Sequential reads of fixed-width records, failing once past the end
+class Reader {
+public:
+    explicit Reader(std::string_view bytes) : bytes_(bytes) {}
+
+    template <typename T>
+    bool read(T& record) {
+        if (bytes_.size() - at_ < sizeof record) return false;
+        std::memcpy(&record, bytes_.data() + at_, sizeof record);
+        at_ += sizeof record;
+        return true;
+    }
+    template <typename T>
+    bool readAll(std::vector<T>& records) {
+        size_t size = records.size() * sizeof(T);
+        if (bytes_.size() - at_ < size) return false;
+        std::memcpy(records.data(), bytes_.data() + at_, size);
+        at_ += size;
+        return true;
+    }
+    void skip(size_t bytes) { at_ = std::min(bytes_.size(), at_ + bytes); }
+
+private:
+    std::string_view bytes_;
+    size_t at_ = 0;
+};
+
+// Writes at explicit offsets, so appending to a snapshot never moves the
+// bytes the current header points at
+class Output {
+public:
+    Output(int fd, std::string path, uint64_t at) : fd_(fd), path_(std::move(path)), at_(at) {}
+
+    uint64_t at() const { return at_; }
+
+    void write(std::string_view bytes) {
+        writeAt(at_, bytes.data(), bytes.size());
+        at_ += bytes.size();
+    }
+    void writeAt(uint64_t offset, const void* data, size_t size) {
+        const char* bytes = static_cast<const char*>(data);
+        while (size > 0) {
+            ssize_t n = ::pwrite(fd_, bytes, size, static_cast<off_t>(offset));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) throw systemError("cannot write", path_);
+            bytes += n;
+            offset += static_cast<uint64_t>(n);
+            size -= static_cast<size_t>(n);
+        }
+    }
+    void sync() {
+        if (::fsync(fd_) != 0) throw systemError("cannot sync", path_);
+    }
+
+private:
+    int fd_;
+    std::string path_;
+    uint64_t at_;
+};
+
+}  // namespace
+
+SnapshotFile::SnapshotFile(const std::string& path) : path_(path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw systemError("cannot open snapshot", path);
+    struct stat info;
+    if (::fstat(fd, &info) != 0) {
+        std::runtime_error error = systemError("cannot stat snapshot", path);
+        ::close(fd);
+        throw error;
+    }
+    size_ = static_cast<size_t>(info.st_size);
+    if (size_ < sizeof(FileHeader)) {
+        ::close(fd);
+        throw std::runtime_error("not a snapshot: " + path);
+    }
+    void* mapping = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+        std::runtime_error error = systemError("cannot map snapshot", path);
+        ::close(fd);
+        throw error;
+    }
+    ::close(fd);
+    data_ = static_cast<const char*>(mapping);
+
+    auto fail = [&](const std::string& why) {
+        ::munmap(mapping, size_);
+        throw std::runtime_error(why + ": " + path);
+    };
+    FileHeader header;
+    std::memcpy(&header, data_, sizeof header);
+    if (std::memcmp(header.magic, kMagic, sizeof kMagic) != 0) fail("not a snapshot");
+    if (header.byteOrder != kByteOrder) fail("snapshot written with another byte order");
+    if (header.version != kSnapshotVersion)
+        fail("snapshot format version " + std::to_string(header.version) + ", expected " + std::to_string(kSnapshotVersion));
+    if (header.indexOffset > size_ || header.indexBytes > size_ - header.indexOffset ||
+        header.channels > header.indexBytes / sizeof(IndexRecord))
+        fail("truncated snapshot");
+    std::string_view index(data_ + header.indexOffset, header.indexBytes);
+    if (checksum(index) != header.indexChecksum) fail("damaged snapshot index");
+
+    std::string_view names = index.substr(header.channels * sizeof(IndexRecord));
+    index_.reserve(header.channels);
+    for (uint64_t i = 0; i < header.channels; i++) {
+        IndexRecord record;
+        std::memcpy(&record, index.data() + i * sizeof record, sizeof record);
+        if (uint64_t(record.nameOffset) + record.nameLength > names.size() || record.offset > header.indexOffset ||
+            record.bytes > header.indexOffset - record.offset)
+            fail("damaged snapshot index");
+        index_[names.substr(record.nameOffset, record.nameLength)] = {record.offset, record.bytes, record.checksum};
+    }
+    fileBytes_ = header.indexOffset + header.indexBytes;
+    liveBytes_ = header.liveBytes;
+}
+
+SnapshotFile::~SnapshotFile() { ::munmap(const_cast<char*>(data_), size_); }
+
+const SnapshotSection* SnapshotFile::find(std::string_view channel) const {
+    auto found = index_.find(channel);
+    return found == index_.end() ? nullptr : &found->second;
+}
+
+std::string_view SnapshotFile::bytes(const SnapshotSection& section) const {
+    return std::string_view(data_ + section.offset, section.bytes);
+}
+
+namespace {
+
+bool decodeSketch(std::string_view bytes, FilterSketch& sketch) {
+    Reader reader(bytes);
+    SketchRecord record{};
+    if (!reader.read(record)) return false;
+    if (record.depth == 0 || record.depth > kSketchMaxRows || record.width == 0 || record.width > kSketchMaxWidth ||
+        record.bits == 0 || record.bits > kDedupMaxBits || record.hashes == 0 || record.hashes > kSketchMaxRows ||
+        record.sliceMs <= 0)
+        return false;
+    CountMinSketch& counts = sketch.counts;
+    DedupFilter& seen = sketch.seen;
+    counts.depth = record.depth;
+    counts.width = record.width;
+    counts.newestSlot = record.newestSlot;
+    counts.live = record.live;
+    seen.sliceMs = record.sliceMs;
+    seen.bits = record.bits;
+    seen.hashes = record.hashes;
+    seen.hasSlice = record.hasSlice != 0;
+    seen.newestSlice = record.newestSlice;
+    sketch.topK = record.topK;
+    sketch.nextOrder = record.nextOrder;
+
+    counts.cells.resize(size_t(kBucketCount) * counts.depth * counts.width);
+    seen.words.resize(kDedupSlices * ((seen.bits + 63) / 64));
+    uint64_t need = sizeof(counts.tags) + sizeof(seen.tags) + alignUp(counts.cells.size() * sizeof(uint32_t)) +
+                    seen.words.size() * sizeof(uint64_t) + uint64_t(record.heavy) * sizeof(HeavyRecord) +
+                    uint64_t(record.sightings) * sizeof(SightingRecord);
+    if (need > bytes.size() - sizeof record) return false;
+    reader.read(counts.tags);
+    reader.read(seen.tags);
+    reader.readAll(counts.cells);
+    reader.skip(alignUp(counts.cells.size() * sizeof(uint32_t)) - counts.cells.size() * sizeof(uint32_t));
+    reader.readAll(seen.words);
+    bool inserted;
+    for (uint32_t i = 0; i < record.heavy; i++) {
+        HeavyRecord hitter{};
+        reader.read(hitter);
+        sketch.heavy.insert(hitter.key, inserted) = HeavyHitter{hitter.count, hitter.error, hitter.order};
+    }
+    for (uint32_t i = 0; i < record.sightings; i++) {
+        SightingRecord sighting{};
+        reader.read(sighting);
+        counts.sightings.push_back({sighting.at, sighting.key, sighting.slot});
+    }
+    return true;
+}
+
+}  // namespace
+
+bool decodeShard(std::string_view bytes, uint64_t expected, ChannelShard& shard) {
+    if (checksum(bytes) != expected) return false;
+    Reader reader(bytes);
+    ShardHeader header;
+    if (!reader.read(header)) return false;
+    uint64_t records = uint64_t(header.entries) * sizeof(EntryRecord) + uint64_t(header.windows) * sizeof(WindowRecord) +
+                       uint64_t(header.cells) * sizeof(CellRecord) +
+                       uint64_t(header.sightings) * sizeof(SightingRecord) + uint64_t(header.posts) * sizeof(PostRecord) +
+                       uint64_t(header.queued) * sizeof(QueuedRecord) + uint64_t(header.clusters) * sizeof(ClusterRecord) +
+                       uint64_t(header.cached) * sizeof(CachedRecord);
+    if (sizeof header + records + header.stringBytes > bytes.size()) return false;
+    if (header.timestampFormat > static_cast<uint8_t>(TimestampFormat::Epoch)) return false;
+    std::string_view strings = bytes.substr(sizeof header + records, header.stringBytes);
+    auto text = [&](StringRef ref, std::string_view& out) {
+        if (uint64_t(ref.offset) + ref.length > strings.size()) return false;
+        out = strings.substr(ref.offset, ref.length);
+        return true;
+    };
+
+    shard.nextOrder = header.nextOrder;
+    shard.lastSweep = header.lastSweep;
+    shard.evictedExpired = header.evictedExpired;
+    shard.evictedLru = header.evictedLru;
+    shard.dropped = header.dropped;
+    shard.hasMetrics = header.hasMetrics != 0;
+    shard.hasBucket = header.hasBucket != 0;
+    shard.timestampFormat = static_cast<TimestampFormat>(header.timestampFormat);
+
+    bool inserted;
+    for (uint32_t i = 0; i < header.entries; i++) {
+        EntryRecord record{};
+        reader.read(record);
+        shard.entries.insert(record.key, inserted) = FilterEntry{record.lastSeen, record.lastAccess, record.score, record.order};
+    }
+    // A second reader walks the cells, which follow the last window record
+    Reader cells(bytes.substr(sizeof header + uint64_t(header.entries) * sizeof(EntryRecord) +
+                              uint64_t(header.windows) * sizeof(WindowRecord)));
+    uint64_t cellTotal = 0;
+    for (uint32_t i = 0; i < header.windows; i++) {
+        WindowRecord record{};
+        reader.read(record);
+        if ((cellTotal += record.cells) > header.cells) return false;
+        WindowCounter& counter = shard.windows.insert(record.key, inserted);
+        counter.lastSlot = record.lastSlot;
+        counter.live = record.live;
+        std::fill(std::begin(counter.tags), std::end(counter.tags), INT64_MIN);
+        std::fill(std::begin(counter.counts), std::end(counter.counts), 0u);
+        for (uint32_t c = 0; c < record.cells; c++) {
+            CellRecord cell{};
+            cells.read(cell);
+            if (cell.index >= kRingSize) return false;
+            counter.tags[cell.index] = cell.tag;
+            counter.counts[cell.index] = cell.count;
+        }
+    }
+    reader.skip(uint64_t(header.cells) * sizeof(CellRecord));
+    for (uint32_t i = 0; i < header.sightings; i++) {
+        SightingRecord record{};
+        reader.read(record);
+        shard.sightings.push_back({record.at, record.key, record.slot});
+    }
+    for (uint32_t i = 0; i < header.posts; i++) {
+        PostRecord record{};
+        reader.read(record);
+        shard.posts.push_back({record.time, record.n});
+    }
+    std::string_view message;
+    for (uint32_t i = 0; i < header.queued; i++) {
+        QueuedRecord record{};
+        reader.read(record);
+        if (!text(record.message, message) || record.action > static_cast<uint8_t>(Action::Suppress) ||
+            record.reason > static_cast<uint8_t>(Reason::FilterOff))
+            return false;
+        shard.queue.push_back({static_cast<Action>(record.action), static_cast<Reason>(record.reason), std::string(message),
+                               record.score, record.timestamp});
+    }
+    std::string_view group, joined;
+    for (uint32_t i = 0; i < header.clusters; i++) {
+        ClusterRecord record{};
+        reader.read(record);
+        if (!text(record.group, group) || !text(record.tokens, joined)) return false;
+        std::vector<std::string> tokens;
+        tokens.reserve(record.tokenCount);
+        for (size_t start = 0;;) {
+            size_t space = joined.find(' ', start);
+            tokens.emplace_back(joined.substr(start, space == std::string_view::npos ? std::string_view::npos : space - start));
+            if (space == std::string_view::npos) break;
+            start = space + 1;
+        }
+        if (tokens.size() != record.tokenCount) return false;
+        shard.templates.restoreCluster(group, record.id, std::move(tokens));
+    }
+    std::string_view shape;
+    for (uint32_t i = 0; i < header.cached; i++) {
+        CachedRecord record{};
+        reader.read(record);
+        if (!text(record.shape, shape)) return false;
+        shard.templates.restoreCached(record.hash, shape, record.id);
+    }
+    if (header.hasSketch == 0) return true;
+    uint64_t sketchAt = alignUp(sizeof header + records + header.stringBytes);
+    if (sketchAt > bytes.size()) return false;
+    shard.sketch = std::make_unique<FilterSketch>();
+    return decodeSketch(bytes.substr(sketchAt), *shard.sketch);
+}
+
+SnapshotStats writeSnapshot(const std::string& path, const SnapshotFile* base,
+                            const std::vector<std::pair<std::string_view, const ChannelShard*>>& changed,
+                            const std::vector<std::string_view>& dropped) {
+    std::unordered_set<std::string_view> changedNames(dropped.begin(), dropped.end());
+    for (const auto& [channel, shard] : changed) changedNames.insert(channel);
+    std::vector<std::pair<std::string_view, SnapshotSection>> kept;
+    uint64_t superseded = 0;
+    if (base != nullptr) {
+        base->forEach([&](std::string_view channel, const SnapshotSection& section) {
+            if (changedNames.count(channel) == 0) kept.emplace_back(channel, section);
+            else superseded += section.bytes;
+        });
+    }
+    // Append while the dead bytes (old indexes and superseded sections) stay
+    // below the live ones
+    bool appendTo = base != nullptr && base->path() == path &&
+                    base->fileBytes() - sizeof(FileHeader) - base->liveBytes() + superseded <= base->liveBytes();
+
+    std::string target = appendTo ? path : path + ".tmp";
+    int fd = appendTo ? ::open(target.c_str(), O_RDWR) : ::open(target.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) throw systemError("cannot open snapshot", target);
+    SnapshotStats stats;
+    try {
+        Output out(fd, target, appendTo ? alignUp(base->fileBytes()) : sizeof(FileHeader));
+        if (!appendTo) {
+            FileHeader blank{};
+            out.writeAt(0, &blank, sizeof blank);
+        }
+
+        std::vector<IndexRecord> records;
+        std::string names;
+        uint64_t live = 0;
+        auto addRecord = [&](std::string_view channel, const SnapshotSection& section) {
+            records.push_back({section.offset, section.bytes, section.checksum, static_cast<uint32_t>(names.size()),
+                               static_cast<uint32_t>(channel.size())});
+            names += channel;
+            live += section.bytes;
+        };
+        for (const auto& [channel, section] : kept) {
+            if (appendTo) {
+                addRecord(channel, section);
+                continue;
+            }
+            SnapshotSection moved = section;
+            moved.offset = out.at();
+            out.write(base->bytes(section));
+            addRecord(channel, moved);
+        }
+        std::string encoded;
+        for (const auto& [channel, shard] : changed) {
+            encodeShard(*shard, encoded);
+            SnapshotSection section{out.at(), encoded.size(), checksum(encoded)};
+            out.write(encoded);
+            addRecord(channel, section);
+        }
+
+        std::string index(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(IndexRecord));
+        index += names;
+        FileHeader header{};
+        std::memcpy(header.magic, kMagic, sizeof kMagic);
+        header.version = kSnapshotVersion;
+        header.byteOrder = kByteOrder;
+        header.indexOffset = out.at();
+        header.indexBytes = index.size();
+        header.liveBytes = live;
+        header.channels = records.size();
+        header.indexChecksum = checksum(index);
+        out.write(index);
+        if (::ftruncate(fd, static_cast<off_t>(out.at())) != 0) throw systemError("cannot truncate", target);
+        // The header goes last, once everything it points at is on disk
+        out.sync();
+        out.writeAt(0, &header, sizeof header);
+        out.sync();
+
+        stats.channels = records.size();
+        stats.written = changed.size();
+        stats.bytes = out.at();
+        stats.compacted = !appendTo;
+    } catch (...) {
+        ::close(fd);
+        if (!appendTo) std::remove(target.c_str());
+        throw;
+    }
+    ::close(fd);
+    if (!appendTo && std::rename(target.c_str(), path.c_str()) != 0) {
+        std::runtime_error error = systemError("cannot rename snapshot to", path);
+        std::remove(target.c_str());
+        throw error;
+    }
+    return stats;
+}
+
+}  // namespace neurafilter
@@ -0,0 +1,88 @@
+// Binary snapshots of channel state (Engine::saveSnapshot / loadSnapshot)
+//
+// Host byte order, every part 8-byte aligned:
+//   header    magic "NFSNAP", format version, byte-order mark, and where the
+//             current index is
+//   sections  one per channel: a ShardHeader, then fixed-width records for
+//             its filter entries (template fingerprint -> last seen, last
+//             access, score, insertion order), window counters and their
+//             occupied ring cells, sightings, posts, queued lines, template
+//             clusters and cached shapes, then the strings those records
+//             point at, then the approximate-mode sketch if the channel has
+//             one
+//   index     one record per channel (section offset, size and checksum,
+//             name), then the names
+//
+// A save appends the sections of the channels that changed, then a new
+// index, and only then rewrites the header to point at it, so a save cut
+// short leaves the previous snapshot readable. Superseded sections are dead
+// bytes; once they would outweigh the live ones the file is rewritten whole
+// (to path.tmp, renamed over path).
+//
+// Loading maps the file and reads the index only. Sections are decoded when
+// their channel is first used, so a warm start costs the same however much
+// state the file holds.
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "stages.h"
+
+namespace neurafilter {
+
+constexpr uint32_t kSnapshotVersion = 1;
+
+struct SnapshotSection {
+    uint64_t offset;
+    uint64_t bytes;
+    uint64_t checksum;
+};
+
+class SnapshotFile {
+public:
+    // Throws std::runtime_error for a missing, truncated or foreign file, or
+    // one written by another format version
+    explicit SnapshotFile(const std::string& path);
+    ~SnapshotFile();
+    SnapshotFile(const SnapshotFile&) = delete;
+    SnapshotFile& operator=(const SnapshotFile&) = delete;
+
+    const std::string& path() const { return path_; }
+    size_t channels() const { return index_.size(); }
+    uint64_t fileBytes() const { return fileBytes_; }   // end of the index
+    uint64_t liveBytes() const { return liveBytes_; }   // sections the index refers to
+
+    const SnapshotSection* find(std::string_view channel) const;
+    std::string_view bytes(const SnapshotSection& section) const;
+
+    template <typename Fn>
+    void forEach(Fn&& fn) const {
+        for (const auto& [channel, section] : index_) fn(channel, section);
+    }
+
+private:
+    std::string path_;
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    uint64_t fileBytes_ = 0;
+    uint64_t liveBytes_ = 0;
+    std::unordered_map<std::string_view, SnapshotSection> index_;   // names point into the mapping
+};
+
+// false, leaving shard partly filled, if bytes is not a section of this
+// format or fails its checksum
+bool decodeShard(std::string_view bytes, uint64_t checksum, ChannelShard& shard);
+
+// Writes the changed shards and keeps base's sections for every other
+// channel it has but the dropped ones: appended to base's file when path is
+// that file and the dead bytes allow, otherwise as a new file
+SnapshotStats writeSnapshot(const std::string& path, const SnapshotFile* base,
+                            const std::vector<std::pair<std::string_view, const ChannelShard*>>& changed,
+                            const std::vector<std::string_view>& dropped);
+
+}  // namespace neurafilter
@@ -0,0 +1,323 @@
+// Internal pipeline stages and per-channel state of libneurafilter
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "arena.h"
+#include "byteScan.h"
+#include "flatTable.h"
+#include "maskAutomaton.h"
+#include "neurafilter/neurafilter.h"
+
+namespace neurafilter {
+
+// maskSensitive.cpp: a config's mask_rules compiled once, as
+// compiledMaskRules() in utils/maskSensitive.deluge: every pattern in one
+// pre-check (a MaskAutomaton, or a std::regex alternation for patterns it
+// cannot take), then a replacement per rule. Patterns std::regex rejects
+// are left out.
+class MaskRuleSet {
+public:
+    explicit MaskRuleSet(const FilterConfig& config);
+
+    bool compiledFrom(const FilterConfig& config) const {
+        return config.version == version_ && config.maskRules == source_;
+    }
+
+    // false, leaving out alone, when no rule matches log
+    bool apply(std::string_view log, std::string& out) const;
+
+private:
+    int64_t version_;
+    std::vector<MaskRule> source_;
+    std::optional<MaskAutomaton> automaton_;
+    std::regex trigger_;   // without an automaton
+    std::vector<std::pair<std::regex, std::string>> rules_;   // pattern, replacement
+};
+
+constexpr size_t kMaskRuleSets = 64;   // compiled rule sets an engine keeps
+
+// maskSensitive.cpp. Returns log itself when nothing needs masking,
+// otherwise the masked copy in arena. rules (may be null) run first.
+std::string_view maskSensitive(std::string_view log, Arena& arena, const MaskRuleSet* rules = nullptr);
+
+// logTemplate.cpp: template clusters and the shape -> id cache of a channel
+class TemplateIndex {
+public:
+    // Template id of a masked line (see templateOf() in services/logTemplate.deluge);
+    // levels are the scoring level tokens (Scorer::levelTokens())
+    uint64_t templateOf(std::string_view message, const std::vector<std::string>& levels);
+
+    // templateOf() in two steps: the normalized shape (no state, so batch
+    // workers compute it ahead), and its id from this index
+    static uint64_t shapeOf(std::string_view message, std::string& shape);
+    uint64_t templateOfShape(std::string_view shape, uint64_t hash, const std::vector<std::string>& levels);
+
+    size_t cacheSize() const { return cache_.size(); }
+    size_t templateCount() const;
+
+    // Snapshots (snapshot.cpp): fn(groupKey, id, tokens) for every cluster,
+    // each group's in match order, and fn(hash, shape, id) for the cache
+    template <typename Fn>
+    void forEachCluster(Fn&& fn) const {
+        for (const auto& [key, group] : groups_)
+            for (const Cluster& cluster : group) fn(key, cluster.id, cluster.tokens);
+    }
+    template <typename Fn>
+    void forEachCached(Fn&& fn) const {
+        cache_.forEach([&](uint64_t hash, const CachedShape& cached) { fn(hash, cached.shape, cached.id); });
+    }
+    // Appends to the end of its group
+    void restoreCluster(std::string_view groupKey, uint64_t id, std::vector<std::string> tokens);
+    void restoreCached(uint64_t hash, std::string_view shape, uint64_t id);
+
+private:
+    struct Cluster {
+        uint64_t id;
+        std::vector<std::string> tokens;
+    };
+    struct CachedShape {
+        std::string shape;
+        uint64_t id;
+    };
+
+    std::unordered_map<std::string, std::vector<Cluster>> groups_;
+    FlatTable<CachedShape> cache_;
+    std::string shape_, groupKey_;
+    std::vector<size_t> tokenEnds_;
+};
+
+// logTimestamp.cpp
+enum class TimestampFormat : uint8_t { None, Iso, Date, Epoch };
+
+bool parseTimestamp(std::string_view value, TimestampFormat format, int64_t now, int64_t& timestamp);
+// Event time of a line; hint is the channel's last detected format and is
+// updated on a hit
+bool extractTimestamp(std::string_view message, TimestampFormat& hint, int64_t now, int64_t& timestamp);
+
+// extractTimestamp() in two steps, for parsing ahead of the channel's hint:
+// every format's result, then the one the hint order would pick
+struct TimestampCandidates {
+    bool parsed[3];      // by format - 1: Iso, Date, Epoch
+    int64_t value[3];
+};
+void parseTimestampCandidates(std::string_view message, int64_t now, TimestampCandidates& out);
+bool pickTimestamp(const TimestampCandidates& candidates, TimestampFormat& hint, int64_t& timestamp);
+
+// The level and keyword part of a line's score, as matchLine() in
+// utils/scoringRules.deluge
+struct LineMatch {
+    double score = 0;
+    std::string_view level;   // the scoring level token found, empty for none
+    bool keyword = false;
+};
+
+// scoringRules.cpp: the rules compiled into one Aho-Corasick automaton,
+// like compileScoringRules() in the harness
+class Scorer {
+public:
+    explicit Scorer(const ScoringRules& rules);
+    double score(std::string_view message, int64_t ageMs, const FilterConfig& config) const;
+    // score() in two steps: the level and keyword part, which does not
+    // depend on the event time, then the recency boost
+    LineMatch match(std::string_view message, const FilterConfig& config) const;
+    double matchScore(std::string_view message, const FilterConfig& config) const {
+        return match(message, config).score;
+    }
+    double withRecency(double matched, int64_t ageMs, const FilterConfig& config) const;
+    const std::vector<std::string>& levelTokens() const { return levelTokens_; }
+
+private:
+    struct Pattern {
+        std::string token;   // original text, for the case-sensitive level check
+        bool level;
+        size_t order;
+        double weight;
+    };
+    std::vector<Pattern> patterns_;
+    std::vector<int32_t> next_;              // 256 transitions per node
+    std::vector<std::vector<uint16_t>> out_; // pattern indices ending at a node
+    void addPrefix(std::string_view token, unsigned bucket);
+
+    PairSet prefixes_;                       // first two bytes of patterns, both cases
+    bool skipAtRoot_ = true;                 // false if an empty pattern matches at the root
+    double recencyBoost_;
+    std::vector<std::string> levelTokens_;
+};
+
+// Fixed limits of services/logFilter.deluge
+constexpr int64_t kAnomalyWindow = 300000;
+constexpr int64_t kBucketCount = 10;
+constexpr int64_t kBucketSize = kAnomalyWindow / kBucketCount;
+constexpr int64_t kEntryTtl = 300000;
+constexpr int64_t kCounterEpochMs = 10000;   // shared counters expire per epoch
+constexpr int64_t kSweepInterval = 60000;
+constexpr size_t kMaxEntries = 5000;
+// Engine: channels held at once; past it the least recently used go first
+constexpr size_t kMaxShards = 65536;
+// utils/rateLimiter.deluge
+constexpr size_t kMaxQueue = 50;
+// Approximate mode (services/logFilter.deluge, utils/filterConfig.deluge)
+constexpr int64_t kDedupSlices = 4;
+constexpr uint32_t kSketchMaxRows = 16;
+constexpr uint32_t kSketchMaxWidth = 1048576;
+constexpr uint32_t kDedupMaxBits = 16777216;
+
+struct FilterEntry {
+    int64_t lastSeen;
+    int64_t lastAccess;
+    double score;
+    uint64_t order;   // insertion order, which evictLru() breaks ties by
+};
+
+// Live sightings of one template: the shared counters of
+// utils/sharedCounters.deluge for a sequential replay. Slots are bucket
+// epochs; a ring of 16 tagged cells covers the 10-bucket window, and a
+// cell is reused only once its old slot has left every possible window.
+constexpr size_t kRingSize = 16;
+
+struct WindowCounter {
+    int64_t lastSlot;
+    uint32_t live;                 // unexpired sightings
+    int64_t tags[kRingSize];
+    uint32_t counts[kRingSize];
+};
+
+struct Sighting {
+    int64_t at;     // ingest time of the line that recorded it
+    uint64_t key;
+    int64_t slot;
+};
+
+struct PostCount {
+    int64_t time;
+    uint32_t n;
+};
+
+// Approximate mode state of a channel (filterSketched() in
+// services/logFilter.deluge), sized by the config alone.
+//
+// The Count-Min sketch keeps one depth x width slice of counts per bucket
+// epoch in a ring of kBucketCount. Sightings land in the channel's newest
+// bucket or a later one, so a slice is only reused once its epoch has left
+// every window still asked about; sightings expire from the counts as the
+// shared counters' deltas would.
+struct CountMinSketch {
+    uint32_t depth = 0, width = 0;
+    int64_t newestSlot = 0;           // meaningful while live > 0
+    uint64_t live = 0;                // unexpired sightings
+    int64_t tags[kBucketCount];       // epoch held by each slice
+    std::vector<uint32_t> cells;      // slice-major, then row-major
+    std::deque<Sighting> sightings;   // key is the template id
+};
+
+// Time-sliced Bloom filter: kDedupSlices slices of the dedup window, in a
+// ring tagged by slice epoch like the sketch's
+struct DedupFilter {
+    int64_t sliceMs = 0;
+    uint32_t bits = 0, hashes = 0;
+    bool hasSlice = false;
+    int64_t newestSlice = 0;
+    int64_t tags[kDedupSlices];
+    std::vector<uint64_t> words;      // slice-major
+};
+
+// Space-Saving counter; order is when the template took its place
+struct HeavyHitter {
+    uint64_t count;
+    uint64_t error;
+    uint64_t order;
+};
+
+struct FilterSketch {
+    CountMinSketch counts;
+    DedupFilter seen;
+    uint32_t topK = 0;
+    FlatTable<HeavyHitter> heavy;
+    uint64_t nextOrder = 0;
+};
+
+// adaptiveSampler.cpp: utils/adaptiveSampler.deluge. elapsedMs is a kept
+// line's mask + filter time.
+constexpr double kSamplerSmoothing = 0.2;
+constexpr double kSamplerExitRatio = 0.5;
+
+struct AdaptiveSampler {
+    double ewma = 0;
+    bool active = false;
+    double rate = 1;
+    double credit = 0;
+    uint64_t sampled = 0;   // since the last report
+};
+
+bool samplerKeeps(AdaptiveSampler& sampler, const LineMatch& match, const FilterConfig& config);
+void recordLineLatency(AdaptiveSampler& sampler, double elapsedMs, const FilterConfig& config);
+
+// Mirrors one "channel:<id>" shard of utils/channelState.deluge, with its
+// counts:<id>:* deltas folded in as running totals
+struct ChannelShard {
+    TemplateIndex templates;
+    FlatTable<FilterEntry> entries;
+    uint64_t nextOrder = 0;
+    bool hasMetrics = false;
+    int64_t lastSweep = 0;
+    uint64_t evictedExpired = 0;
+    uint64_t evictedLru = 0;
+    TimestampFormat timestampFormat = TimestampFormat::None;
+    std::unique_ptr<FilterSketch> sketch;   // approximate mode, once used
+
+    FlatTable<WindowCounter> windows;
+    std::deque<Sighting> sightings;
+    std::deque<PostCount> posts;
+
+    bool hasBucket = false;
+    std::vector<QueuedResult> queue;
+    uint64_t dropped = 0;
+
+    AdaptiveSampler sampler;   // not in snapshots
+
+    // Engine bookkeeping, not in snapshots: the shard is dropped once no line
+    // has used it for longer than idleAfter (its counter horizon)
+    int64_t lastSeen = 0;
+    int64_t idleAfter = kEntryTtl;
+
+    bool dirty = true;   // used since the last snapshot was saved or loaded
+};
+
+// logFilter.cpp
+int64_t counterHorizon(const FilterConfig& config);
+// Expire sightings and posts whose counter epoch ended more than horizon ms before now
+void openCounters(ChannelShard& shard, int64_t now, int64_t horizon);
+Result filterLogWith(ChannelShard& shard, std::string_view message, int64_t now, const FilterConfig& config,
+                     const Scorer& scorer);
+
+// filterLogWith() split for Engine::runParallel(): prepareLine() is the part
+// that reads no channel state and runs on any worker, filterPrepared() the
+// rest, on the thread that owns the channel at the time
+struct PreparedLine {
+    std::string_view message;   // masked
+    std::string_view shape;     // TemplateIndex::shapeOf(), in the worker's arena
+    uint64_t shapeHash;
+    TimestampCandidates timestamps;
+    LineMatch match;            // Scorer::match()
+    double elapsedMs;           // masking and the above, with sampling on
+};
+void prepareLine(std::string_view message, int64_t now, const FilterConfig& config, const Scorer& scorer,
+                 Arena& arena, PreparedLine& out);
+Result filterPrepared(ChannelShard& shard, const PreparedLine& line, int64_t now, const FilterConfig& config,
+                      const Scorer& scorer);
+
+// rateLimiter.cpp
+bool checkRateLimit(ChannelShard& shard, const FilterConfig& config, int64_t now);
+bool queueOverflow(ChannelShard& shard, const Result& result);
+std::vector<QueuedResult> drainOverflow(ChannelShard& shard);
+
+}  // namespace neurafilter
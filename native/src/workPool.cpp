@@ -0,0 +1,97 @@
+#include "workPool.h"
+
+#include <algorithm>
+
+namespace neurafilter {
+
+WorkPool::WorkPool(unsigned threads) {
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned i = 0; i < threads; i++) queues_.push_back(std::make_unique<Queue>());
+    for (unsigned i = 1; i < threads; i++) helpers_.emplace_back([this, i] { helper(i); });
+}
+
+WorkPool::~WorkPool() {
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    for (std::thread& thread : helpers_) thread.join();
+}
+
+void WorkPool::run(size_t count, const std::function<void(size_t, unsigned)>& body) {
+    unsigned workers = size();
+    for (unsigned w = 0; w < workers; w++) {
+        Queue& queue = *queues_[w];
+        queue.tasks.clear();
+        for (size_t task = w; task < count; task += workers) queue.tasks.push_back(task);
+        queue.head = 0;
+        queue.tail = queue.tasks.size();
+    }
+    body_ = &body;
+    if (!helpers_.empty()) {
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            generation_++;
+            finished_ = 0;
+        }
+        wake_.notify_all();
+    }
+
+    work(0);
+
+    // Every helper takes part in every run, so none can still be inside
+    // body (or about to look at the queues) once all have checked in
+    if (!helpers_.empty()) {
+        std::unique_lock<std::mutex> guard(lock_);
+        done_.wait(guard, [&] { return finished_ == helpers_.size(); });
+    }
+    body_ = nullptr;
+}
+
+void WorkPool::work(unsigned worker) {
+    size_t task;
+    while (take(worker, task)) (*body_)(task, worker);
+}
+
+bool WorkPool::take(unsigned worker, size_t& task) {
+    {
+        Queue& own = *queues_[worker];
+        std::lock_guard<std::mutex> guard(own.lock);
+        if (own.head < own.tail) {
+            task = own.tasks[own.head++];
+            return true;
+        }
+    }
+    // Tasks are never added during a run, so one empty pass means done
+    unsigned workers = size();
+    for (unsigned offset = 1; offset < workers; offset++) {
+        Queue& victim = *queues_[(worker + offset) % workers];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (victim.head < victim.tail) {
+            task = victim.tasks[--victim.tail];
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkPool::helper(unsigned worker) {
+    uint64_t seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> guard(lock_);
+            wake_.wait(guard, [&] { return stopping_ || generation_ != seen; });
+            if (stopping_) return;
+            seen = generation_;
+        }
+        work(worker);
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            finished_++;
+        }
+        done_.notify_one();
+    }
+}
+
+}  // namespace neurafilter
@@ -0,0 +1,58 @@
+// Work-stealing thread pool for Engine::runParallel()
+//
+// run() hands task indices out round-robin to one deque per worker. Each
+// worker takes its own tasks lowest first and, once its deque is empty,
+// steals the highest task of another. So work moves to whichever threads
+// are free, and tasks still start roughly in index order. The calling
+// thread is worker 0, so a pool of one runs everything inline.
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace neurafilter {
+
+class WorkPool {
+public:
+    // threads = 0: one per hardware thread
+    explicit WorkPool(unsigned threads);
+    ~WorkPool();
+    WorkPool(const WorkPool&) = delete;
+    WorkPool& operator=(const WorkPool&) = delete;
+
+    unsigned size() const { return static_cast<unsigned>(queues_.size()); }
+
+    // body(task, worker) for every task in [0, count); returns once all have
+    // run. Not reentrant: one run() at a time, and not from inside a body.
+    void run(size_t count, const std::function<void(size_t, unsigned)>& body);
+
+private:
+    struct Queue {
+        std::mutex lock;
+        std::vector<size_t> tasks;
+        size_t head = 0;   // next own task
+        size_t tail = 0;   // one past the next task to steal
+    };
+
+    void work(unsigned worker);
+    bool take(unsigned worker, size_t& task);
+    void helper(unsigned worker);
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> helpers_;
+    const std::function<void(size_t, unsigned)>* body_ = nullptr;
+
+    std::mutex lock_;
+    std::condition_variable wake_, done_;
+    uint64_t generation_ = 0;
+    unsigned finished_ = 0;
+    bool stopping_ = false;
+};
+
+}  // namespace neurafilter
@@ -0,0 +1,312 @@
+// Replay benchmark for the local harness pipeline (test/runLocalTest.js)
+//
+// Usage:
+//   node test/benchmark.js [--file logs.txt] [--lines 1000000] [--dup-ratio 0.5]
+//                          [--cardinality 1000] [--sensitive 0.2] [--seed 1]
+//                          [--interval-ms 5] [--enforce-rate-limit] [--approximate]
+//                          [--baseline test/benchBaseline.json] [--update-baseline]
+//                          [--native native/_build/neurafilter.node] [--threads 8]
+//
+// Streams --file line by line (test/lineReader.js), or generates --lines synthetic lines with the
+// given duplicate ratio, number of distinct messages and share of lines
+// carrying sensitive tokens. Reports lines/sec, time per stage, peak memory
+// and final map sizes, and compares throughput with the stored baseline for
+// the same scenario.
+//
+// By default, rate-limit decisions are counted but lines are not dropped,
+// so every stage sees every line. Pass --enforce-rate-limit to replay the
+// limiter's drops as well. --approximate runs the filter on its fixed-size
+// sketches (the default sizes of utils/filterConfig.deluge) instead of
+// per-template entries.
+//
+// --native replays through the native engine's runBatch() instead, in
+// batches of 4096 lines (no per-stage times; the scenario key gets ",native");
+// a --file is read from a memory map by the addon's replayFile().
+// --threads runs each batch on the engine's worker pool (0: all cores).
+
+const fs = require("fs");
+const path = require("path");
+const harness = require("./runLocalTest");
+const { readLines } = require("./lineReader");
+
+function parseArgs(argv) {
+  const args = {
+    file: null,
+    lines: 1000000,
+    dupRatio: 0.5,
+    cardinality: 1000,
+    sensitive: 0.2,
+    seed: 1,
+    intervalMs: 5,
+    enforceRateLimit: false,
+    baseline: path.join(__dirname, "benchBaseline.json"),
+    updateBaseline: false,
+    native: null,
+    threads: null,
+    approximate: false,
+  };
+  for (let i = 2; i < argv.length; i++) {
+    const flag = argv[i];
+    const value = argv[i + 1];
+    if (flag === "--file") (args.file = value), i++;
+    else if (flag === "--lines") (args.lines = Number(value)), i++;
+    else if (flag === "--dup-ratio") (args.dupRatio = Number(value)), i++;
+    else if (flag === "--cardinality") (args.cardinality = Number(value)), i++;
+    else if (flag === "--sensitive") (args.sensitive = Number(value)), i++;
+    else if (flag === "--seed") (args.seed = Number(value)), i++;
+    else if (flag === "--interval-ms") (args.intervalMs = Number(value)), i++;
+    else if (flag === "--baseline") (args.baseline = value), i++;
+    else if (flag === "--native") (args.native = value), i++;
+    else if (flag === "--threads") (args.threads = Number(value)), i++;
+    else if (flag === "--enforce-rate-limit") args.enforceRateLimit = true;
+    else if (flag === "--approximate") args.approximate = true;
+    else if (flag === "--update-baseline") args.updateBaseline = true;
+    else throw new Error(`Unknown flag ${flag}`);
+  }
+  return args;
+}
+
+function scenarioKey(args) {
+  const threads = args.native && args.threads !== null ? `,threads=${args.threads}` : "";
+  const limiter = `${args.enforceRateLimit ? ",enforce" : ""}${args.approximate ? ",approx" : ""}${args.native ? ",native" : ""}${threads}`;
+  if (args.file) return `file:${path.basename(args.file)}${limiter}`;
+  return (
+    `synthetic:lines=${args.lines},dup=${args.dupRatio},card=${args.cardinality},` +
+    `sens=${args.sensitive},seed=${args.seed}${limiter}`
+  );
+}
+
+// Deterministic PRNG so a scenario always replays the same corpus
+function mulberry32(seed) {
+  return function () {
+    seed |= 0;
+    seed = (seed + 0x6d2b79f5) | 0;
+    let t = Math.imul(seed ^ (seed >>> 15), 1 | seed);
+    t = (t + Math.imul(t ^ (t >>> 7), 61 | t)) ^ t;
+    return ((t ^ (t >>> 14)) >>> 0) / 4294967296;
+  };
+}
+
+function messageWord(k) {
+  let word = "";
+  do {
+    word += String.fromCharCode(97 + (k % 26));
+    k = Math.floor(k / 26);
+  } while (k > 0);
+  return word;
+}
+
+// Distinct message k gets a three-word, letters-only phrase, so template
+// extraction (which generalizes single differing tokens) keeps them apart
+function messagePhrase(k) {
+  return `${messageWord(k)} ${messageWord(k * 7 + 3)} ${messageWord(k * 13 + 5)}`;
+}
+
+const SHAPES = [
+  (w, r) => `ERROR Database connection to ${w} failed after ${Math.floor(r() * 500)}ms`,
+  (w, r) => `WARN Timeout while calling ${w} attempt ${Math.floor(r() * 5)}`,
+  (w, r) => `INFO Request ${Math.floor(r() * 1e6).toString(16)}abcd handled by ${w}`,
+  (w) => `INFO User login successful on ${w}`,
+  (w) => `DEBUG Cache refresh finished for ${w}`,
+];
+
+const SENSITIVE = [
+  (r) => `user${Math.floor(r() * 1000)}@example.com`,
+  (r) => `10.${Math.floor(r() * 255)}.${Math.floor(r() * 255)}.${Math.floor(r() * 255)}`,
+  (r) => `https://api.example.com/v1/items/${Math.floor(r() * 1000)}`,
+  (r) => `Bearer ${Math.floor(r() * 1e9).toString(36)}`,
+  () => `/var/log/app/service.log`,
+];
+
+function* syntheticLines(args) {
+  const random = mulberry32(args.seed);
+  let previous = null;
+  let time = args.start ?? Date.now() - args.lines * args.intervalMs;
+  for (let i = 0; i < args.lines; i++) {
+    time += args.intervalMs;
+    if (previous !== null && random() < args.dupRatio) {
+      yield { line: previous, now: time };
+      continue;
+    }
+    const k = Math.floor(random() * args.cardinality);
+    let line = SHAPES[k % SHAPES.length](messagePhrase(k), random);
+    if (random() < args.sensitive) line += ` ${SENSITIVE[Math.floor(random() * SENSITIVE.length)](random)}`;
+    line = `${line.slice(0, line.indexOf(" "))} ${new Date(time).toISOString()}${line.slice(line.indexOf(" "))}`;
+    previous = line;
+    yield { line, now: time };
+  }
+}
+
+function createClock() {
+  const totals = {};
+  let last = 0n;
+  return {
+    totals,
+    start() {
+      last = process.hrtime.bigint();
+    },
+    lap(stage) {
+      const now = process.hrtime.bigint();
+      totals[stage] = (totals[stage] || 0n) + (now - last);
+      last = now;
+    },
+  };
+}
+
+function benchConfig(args) {
+  return { ...harness.defaultConfig, approximate: args.approximate };
+}
+
+function createRun(args) {
+  const config = benchConfig(args);
+  const clock = createClock();
+  const actions = {};
+  let lines = 0;
+  let rateLimited = 0;
+  let peakHeap = 0;
+
+  return {
+    clock,
+    feed(line, now) {
+      clock.start();
+      const result = harness.runLine(line, { clock, now, config, enforceRateLimit: args.enforceRateLimit });
+      actions[result.action] = (actions[result.action] || 0) + 1;
+      if (result.rateLimited) rateLimited++;
+      if (++lines % 10000 === 0) peakHeap = Math.max(peakHeap, process.memoryUsage().heapUsed);
+    },
+    finish(elapsedNs) {
+      peakHeap = Math.max(peakHeap, process.memoryUsage().heapUsed);
+      const stages = {};
+      for (const [stage, total] of Object.entries(clock.totals)) stages[stage] = Number(total) / Math.max(lines, 1);
+      return {
+        lines,
+        seconds: Number(elapsedNs) / 1e9,
+        linesPerSec: lines / (Number(elapsedNs) / 1e9),
+        stagesNsPerLine: stages,
+        peakHeapMb: peakHeap / 1048576,
+        peakRssMb: process.resourceUsage().maxRSS / 1024,
+        actions,
+        rateLimited,
+        maps: harness.stateSizes(),
+      };
+    },
+  };
+}
+
+// Same interface as createRun(), feeding the addon in batches
+function createNativeRun(args) {
+  const addon = require(path.resolve(args.native));
+  const engine = new addon.Engine({ rules: harness.scoringRules, config: benchConfig(args) });
+  const batchSize = 4096;
+  const actions = {};
+  let lines = [];
+  let nows = [];
+  let total = 0;
+  let rateLimited = 0;
+
+  function flush() {
+    if (lines.length === 0) return;
+    const options = { enforceRateLimit: args.enforceRateLimit, summary: true };
+    if (args.threads !== null) options.threads = args.threads;
+    const summary = engine.runBatch(lines, nows, options);
+    for (const [action, n] of Object.entries(summary.actions)) actions[action] = (actions[action] || 0) + n;
+    rateLimited += summary.rateLimited;
+    total += lines.length;
+    lines = [];
+    nows = [];
+  }
+
+  return {
+    // A file goes through replayFile(), read from a memory map in the addon
+    replay(file) {
+      const options = { enforceRateLimit: args.enforceRateLimit, now: Date.now(), batchLines: batchSize };
+      if (args.threads !== null) options.threads = args.threads;
+      const summary = engine.replayFile(file, options);
+      for (const [action, n] of Object.entries(summary.actions)) actions[action] = (actions[action] || 0) + n;
+      rateLimited += summary.rateLimited;
+      total += summary.lines;
+    },
+    feed(line, now) {
+      lines.push(line);
+      nows.push(now);
+      if (lines.length === batchSize) flush();
+    },
+    finish(elapsedNs) {
+      flush();
+      return {
+        lines: total,
+        seconds: Number(elapsedNs) / 1e9,
+        linesPerSec: total / (Number(elapsedNs) / 1e9),
+        stagesNsPerLine: {},
+        peakHeapMb: process.memoryUsage().heapUsed / 1048576,
+        peakRssMb: process.resourceUsage().maxRSS / 1024,
+        actions,
+        rateLimited,
+        maps: engine.stateSizes(),
+      };
+    },
+  };
+}
+
+function runFile(args, run) {
+  if (run.replay) return run.replay(args.file);
+  for (const line of readLines(args.file)) run.feed(line, Date.now());
+}
+
+function runSynthetic(args, run) {
+  for (const { line, now } of syntheticLines(args)) run.feed(line, now);
+}
+
+function pct(now, before) {
+  const delta = ((now - before) / before) * 100;
+  return `${delta >= 0 ? "+" : ""}${delta.toFixed(1)}%`;
+}
+
+function report(key, stats, baseline) {
+  const previous = baseline[key];
+  console.log(`Scenario: ${key}`);
+  console.log(
+    `Lines: ${stats.lines} in ${stats.seconds.toFixed(2)}s = ${Math.round(stats.linesPerSec)} lines/sec` +
+      (previous ? ` (baseline ${Math.round(previous.linesPerSec)}, ${pct(stats.linesPerSec, previous.linesPerSec)})` : "")
+  );
+  console.log("Stage time (ns/line):");
+  for (const [stage, ns] of Object.entries(stats.stagesNsPerLine)) {
+    const before = previous && previous.stagesNsPerLine[stage];
+    console.log(`  ${stage.padEnd(10)} ${ns.toFixed(0).padStart(8)}${before ? `  (baseline ${before.toFixed(0)}, ${pct(ns, before)})` : ""}`);
+  }
+  console.log(`Peak memory: heap ${stats.peakHeapMb.toFixed(1)} MB, rss ${stats.peakRssMb.toFixed(1)} MB`);
+  console.log(`Maps: ${Object.entries(stats.maps).map(([name, size]) => `${name}=${size}`).join(", ")}`);
+  console.log(
+    `Actions: ${Object.entries(stats.actions).map(([action, n]) => `${action}=${n}`).join(", ")}; limiter denied ${stats.rateLimited}`
+  );
+}
+
+async function main() {
+  const args = parseArgs(process.argv);
+  const key = scenarioKey(args);
+  const baseline = fs.existsSync(args.baseline) ? JSON.parse(fs.readFileSync(args.baseline, "utf-8")) : {};
+
+  harness.resetState();
+  const run = args.native ? createNativeRun(args) : createRun(args);
+  const started = process.hrtime.bigint();
+  if (args.file) runFile(args, run);
+  else runSynthetic(args, run);
+  const stats = run.finish(process.hrtime.bigint() - started);
+
+  report(key, stats, baseline);
+
+  if (args.updateBaseline) {
+    baseline[key] = { linesPerSec: stats.linesPerSec, stagesNsPerLine: stats.stagesNsPerLine };
+    fs.writeFileSync(args.baseline, `${JSON.stringify(baseline, null, 2)}\n`);
+    console.log(`Baseline updated: ${args.baseline}`);
+  }
+}
+
+module.exports = { syntheticLines, mulberry32, messagePhrase };
+
+if (require.main === module) {
+  main().catch((error) => {
+    console.error(error);
+    process.exit(1);
+  });
+}
@@ -0,0 +1,742 @@
+// Minimal interpreter for the Deluge subset used by this extension, so the
+// real .deluge services can be driven from Node (see test/parityTest.js).
+//
+// Covers what the repo's scripts use: assignments, (args) => { } lambdas,
+// if / else if / else, for each, try / catch, return, info, postToChannel,
+// invokeurl, map and list literals, and the string/map/list/number methods
+// the services call. invokeurl calls runtime.invokeUrl({url, type, parameters, headers}),
+// which the caller supplies and which returns the parsed response. All
+// utils/ and services/ files share one global scope with a persistent
+// `state` map, and zoho.currenttime reads a virtual clock set by the caller.
+
+const fs = require("fs");
+const path = require("path");
+const crypto = require("crypto");
+
+// ---------------------------------------------------------------- tokenizer
+
+const PUNCT = ["=>", "==", "!=", "<=", ">=", "&&", "||", "(", ")", "{", "}", "[", "]", ",", ":", ";", ".", "=", "+", "-", "*", "/", "%", "<", ">", "!"];
+
+function tokenize(source, file) {
+  const tokens = [];
+  let i = 0;
+  let line = 1;
+  while (i < source.length) {
+    const ch = source[i];
+    if (ch === "\n") {
+      line++;
+      i++;
+    } else if (/\s/.test(ch)) {
+      i++;
+    } else if (source.startsWith("//", i)) {
+      while (i < source.length && source[i] !== "\n") i++;
+    } else if (ch === '"') {
+      let value = "";
+      i++;
+      while (source[i] !== '"') {
+        if (i >= source.length) throw new Error(`${file}:${line}: unterminated string`);
+        if (source[i] === "\\") {
+          const next = source[i + 1];
+          value += next === "n" ? "\n" : next === "t" ? "\t" : next;
+          i += 2;
+        } else {
+          if (source[i] === "\n") line++;
+          value += source[i++];
+        }
+      }
+      i++;
+      tokens.push({ type: "string", value, line });
+    } else if (/[0-9]/.test(ch)) {
+      const match = source.slice(i).match(/^\d+(\.\d+)?/);
+      tokens.push({ type: "number", value: Number(match[0]), line });
+      i += match[0].length;
+    } else if (/[A-Za-z_]/.test(ch)) {
+      const match = source.slice(i).match(/^[A-Za-z_][A-Za-z0-9_]*/);
+      tokens.push({ type: "name", value: match[0], line });
+      i += match[0].length;
+    } else {
+      const punct = PUNCT.find((p) => source.startsWith(p, i));
+      if (!punct) throw new Error(`${file}:${line}: unexpected character ${JSON.stringify(ch)}`);
+      tokens.push({ type: "punct", value: punct, line });
+      i += punct.length;
+    }
+  }
+  tokens.push({ type: "eof", value: null, line });
+  return tokens;
+}
+
+// ------------------------------------------------------------------- parser
+
+function parse(source, file) {
+  const tokens = tokenize(source, file);
+  let pos = 0;
+
+  const peek = (offset = 0) => tokens[pos + offset];
+  const is = (value, offset = 0) => peek(offset).type === "punct" && peek(offset).value === value;
+  const isName = (value, offset = 0) => peek(offset).type === "name" && peek(offset).value === value;
+  const fail = (message) => {
+    throw new Error(`${file}:${peek().line}: ${message} (got ${JSON.stringify(peek().value)})`);
+  };
+  const expect = (value) => {
+    if (!is(value)) fail(`expected ${value}`);
+    return tokens[pos++];
+  };
+  const optional = (value) => (is(value) ? (pos++, true) : false);
+
+  function block() {
+    expect("{");
+    const body = [];
+    while (!is("}")) body.push(statement());
+    expect("}");
+    return body;
+  }
+
+  function bodyOrStatement() {
+    return is("{") ? block() : [statement()];
+  }
+
+  function statement() {
+    if (isName("if")) {
+      pos++;
+      expect("(");
+      const test = expression();
+      expect(")");
+      const then = bodyOrStatement();
+      let otherwise = null;
+      if (isName("else")) {
+        pos++;
+        otherwise = isName("if") ? [statement()] : bodyOrStatement();
+      }
+      return { kind: "if", test, then, otherwise };
+    }
+    if (isName("for") && isName("each", 1)) {
+      pos += 2;
+      const name = tokens[pos++].value;
+      if (!isName("in")) fail("expected in");
+      pos++;
+      const iterable = expression();
+      return { kind: "for", name, iterable, body: block() };
+    }
+    if (isName("return")) {
+      const line = tokens[pos++].line;
+      if (optional(";")) return { kind: "return", value: null };
+      const value = peek().line === line || !is("}") ? expression() : null;
+      optional(";");
+      return { kind: "return", value };
+    }
+    if (isName("break")) {
+      pos++;
+      optional(";");
+      return { kind: "break" };
+    }
+    if (isName("try")) {
+      pos++;
+      const body = block();
+      if (!isName("catch")) fail("expected catch");
+      pos++;
+      expect("(");
+      const name = tokens[pos++].value;
+      expect(")");
+      return { kind: "try", body, name, handler: block() };
+    }
+    if (isName("info")) {
+      pos++;
+      const value = expression();
+      optional(";");
+      return { kind: "info", value };
+    }
+    if (isName("postToChannel") && is("[", 1)) {
+      pos += 2;
+      const fields = {};
+      while (!is("]")) {
+        const key = tokens[pos++].value;
+        expect(":");
+        fields[key] = expression();
+      }
+      expect("]");
+      optional(";");
+      return { kind: "post", fields };
+    }
+    if (peek().type === "name" && is("=", 1)) {
+      const name = tokens[pos].value;
+      pos += 2;
+      const value = expression();
+      optional(";");
+      return { kind: "assign", name, value };
+    }
+    const value = expression();
+    optional(";");
+    return { kind: "expr", value };
+  }
+
+  const BINARY = [["||"], ["&&"], ["==", "!="], ["<", "<=", ">", ">="], ["+", "-"], ["*", "/", "%"]];
+
+  function expression(level = 0) {
+    if (level === BINARY.length) return unary();
+    let left = expression(level + 1);
+    while (peek().type === "punct" && BINARY[level].includes(peek().value)) {
+      const op = tokens[pos++].value;
+      left = { kind: "binary", op, left, right: expression(level + 1) };
+    }
+    return left;
+  }
+
+  function unary() {
+    if (optional("!")) return { kind: "not", value: unary() };
+    if (optional("-")) return { kind: "neg", value: unary() };
+    return postfix(primary());
+  }
+
+  function args() {
+    expect("(");
+    const list = [];
+    while (!is(")")) {
+      list.push(expression());
+      optional(",");
+    }
+    expect(")");
+    return list;
+  }
+
+  function postfix(node) {
+    for (;;) {
+      if (optional(".")) {
+        const name = tokens[pos++].value;
+        node = is("(") ? { kind: "call", target: node, name, args: args() } : { kind: "member", target: node, name };
+      } else if (is("(") && node.kind === "name") {
+        node = { kind: "fcall", name: node.name, args: args() };
+      } else {
+        return node;
+      }
+    }
+  }
+
+  function isLambda() {
+    if (!is("(")) return false;
+    let depth = 0;
+    for (let i = pos; i < tokens.length; i++) {
+      if (tokens[i].type === "punct" && tokens[i].value === "(") depth++;
+      if (tokens[i].type === "punct" && tokens[i].value === ")" && --depth === 0)
+        return tokens[i + 1].type === "punct" && tokens[i + 1].value === "=>";
+    }
+    return false;
+  }
+
+  function primary() {
+    const token = peek();
+    if (isLambda()) {
+      expect("(");
+      const params = [];
+      while (!is(")")) {
+        params.push(tokens[pos++].value);
+        optional(",");
+      }
+      expect(")");
+      expect("=>");
+      return { kind: "lambda", params, body: block() };
+    }
+    if (optional("(")) {
+      const value = expression();
+      expect(")");
+      return value;
+    }
+    if (optional("{")) {
+      const entries = [];
+      while (!is("}")) {
+        const key = expression();
+        expect(":");
+        entries.push([key, expression()]);
+        optional(",");
+      }
+      expect("}");
+      return { kind: "map", entries };
+    }
+    if (optional("[")) {
+      const items = [];
+      while (!is("]")) {
+        items.push(expression());
+        optional(",");
+      }
+      expect("]");
+      return { kind: "list", items };
+    }
+    if (isName("invokeurl") && is("[", 1)) {
+      pos += 2;
+      const fields = {};
+      while (!is("]")) {
+        const key = tokens[pos++].value;
+        expect(":");
+        // type: GET / POST is a bare word
+        fields[key] = key === "type" ? { kind: "literal", value: tokens[pos++].value } : expression();
+      }
+      expect("]");
+      return { kind: "invokeurl", fields };
+    }
+    pos++;
+    if (token.type === "string" || token.type === "number") return { kind: "literal", value: token.value };
+    if (token.type === "name") {
+      if (token.value === "true") return { kind: "literal", value: true };
+      if (token.value === "false") return { kind: "literal", value: false };
+      if (token.value === "null") return { kind: "literal", value: null };
+      return { kind: "name", name: token.value };
+    }
+    pos--;
+    fail("unexpected token");
+  }
+
+  const program = [];
+  while (peek().type !== "eof") program.push(statement());
+  return program;
+}
+
+// ------------------------------------------------------------------ runtime
+
+class DateTime {
+  constructor(ms) {
+    this.ms = ms;
+  }
+}
+
+class Lambda {
+  constructor(params, body) {
+    this.params = params;
+    this.body = body;
+  }
+}
+
+class Return {
+  constructor(value) {
+    this.value = value;
+  }
+}
+
+const BREAK = Symbol("break");
+
+const regexCache = new Map();
+
+// Java regex -> JS: leading inline flags become RegExp flags
+function javaRegex(pattern, anchored, global) {
+  const key = `${anchored}:${global}:${pattern}`;
+  if (regexCache.has(key)) return regexCache.get(key);
+  let flags = global ? "g" : "";
+  const inline = pattern.match(/^\(\?([is]+)\)/);
+  if (inline) {
+    flags += inline[1];
+    pattern = pattern.slice(inline[0].length);
+  }
+  const regex = new RegExp(anchored ? `^(?:${pattern})$` : pattern, flags);
+  regexCache.set(key, regex);
+  return regex;
+}
+
+function pad(n, width = 2) {
+  return String(n).padStart(width, "0");
+}
+
+function parseDateTime(text, pattern) {
+  if (pattern === "yyyy-MM-dd") {
+    const [y, m, d] = text.split("-").map(Number);
+    return new DateTime(new Date(y, m - 1, d).getTime());
+  }
+  if (pattern === "yyyy-MM-dd'T'HH:mm:ss") {
+    const [date, time] = text.split("T");
+    const [y, m, d] = date.split("-").map(Number);
+    const [hh, mm, ss] = time.split(":").map(Number);
+    return new DateTime(new Date(y, m - 1, d, hh, mm, ss).getTime());
+  }
+  if (pattern === "yyyy-MM-dd'T'HH:mm:ssXXX") {
+    return new DateTime(new Date(text).getTime());
+  }
+  throw new Error(`Unsupported date pattern ${pattern}`);
+}
+
+function formatDateTime(ms, pattern) {
+  const d = new Date(ms);
+  if (pattern === "yyyy-MM-dd") return `${d.getFullYear()}-${pad(d.getMonth() + 1)}-${pad(d.getDate())}`;
+  return `${d.getFullYear()}-${pad(d.getMonth() + 1)}-${pad(d.getDate())} ${pad(d.getHours())}:${pad(d.getMinutes())}:${pad(d.getSeconds())}`;
+}
+
+function display(value) {
+  if (value === null || value === undefined) return "";
+  if (value instanceof DateTime) return formatDateTime(value.ms);
+  if (value instanceof Map) return JSON.stringify(toPlain(value));
+  if (Array.isArray(value)) return value.map(display).join(",");
+  return String(value);
+}
+
+function toPlain(value) {
+  if (value instanceof Map) return Object.fromEntries([...value].map(([k, v]) => [k, toPlain(v)]));
+  if (Array.isArray(value)) return value.map(toPlain);
+  if (value instanceof DateTime) return value.ms;
+  return value;
+}
+
+function fromPlain(value) {
+  if (Array.isArray(value)) return value.map(fromPlain);
+  if (value && typeof value === "object") return new Map(Object.entries(value).map(([k, v]) => [k, fromPlain(v)]));
+  return value;
+}
+
+function compare(a, b) {
+  if (a === b) return 0;
+  if (a === null) return -1;
+  if (b === null) return 1;
+  return a < b ? -1 : 1;
+}
+
+function callMethod(target, name, args) {
+  if (target instanceof DateTime) {
+    if (name === "toLong") return target.ms;
+    if (name === "toString") return formatDateTime(target.ms, args[0]);
+  } else if (typeof target === "string") {
+    switch (name) {
+      case "contains":
+        return target.includes(args[0]);
+      case "containsIgnoreCase":
+        return target.toLowerCase().includes(args[0].toLowerCase());
+      case "matches":
+        return javaRegex(args[0], true, false).test(target);
+      case "replaceAll":
+        return target.replace(javaRegex(args[0], false, true), args[1]);
+      case "toList":
+      case "split":
+        return target.split(args[0]);
+      case "toLowerCase":
+        return target.toLowerCase();
+      case "toLong":
+        return Math.trunc(Number(target));
+      case "toDecimal":
+        return Number(target);
+      case "subString":
+        return target.substring(args[0], args.length > 1 ? args[1] : undefined);
+      case "startsWith":
+        return target.startsWith(args[0]);
+      case "lastIndexOf":
+        return target.lastIndexOf(args[0]);
+      case "getPrefix":
+        return target.includes(args[0]) ? target.slice(0, target.indexOf(args[0])) : null;
+      case "getSuffix":
+        return target.includes(args[0]) ? target.slice(target.indexOf(args[0]) + args[0].length) : null;
+      case "trim":
+        return target.trim();
+      case "isText":
+        return true;
+      case "toMap":
+        return fromPlain(JSON.parse(target));
+      case "toTime":
+        return parseDateTime(target, args[0]);
+      case "toDate":
+        return parseDateTime(target, args[0]);
+      case "toString":
+        return target;
+      case "length":
+        return target.length;
+      case "isEmpty":
+        return target.length === 0;
+    }
+  } else if (typeof target === "number") {
+    switch (name) {
+      case "toLong":
+        return Math.trunc(target);
+      case "toString":
+        return String(target);
+      case "round":
+        return Number(target.toFixed(args[0]));
+      case "toTime":
+        return new DateTime(target);
+      case "isText":
+        return false;
+    }
+  } else if (typeof target === "boolean") {
+    if (name === "toString") return String(target);
+    if (name === "isText") return false;
+  } else if (target instanceof Map) {
+    switch (name) {
+      case "get":
+        return target.has(args[0]) ? target.get(args[0]) : args.length > 1 ? args[1] : null;
+      case "put":
+        target.set(args[0], args[1]);
+        return null;
+      case "containsKey":
+        return target.has(args[0]);
+      case "remove":
+        target.delete(args[0]);
+        return null;
+      case "keys":
+        return [...target.keys()];
+      case "size":
+        return target.size;
+      case "isEmpty":
+        return target.size === 0;
+      case "clear":
+        target.clear();
+        return null;
+      case "isText":
+        return false;
+      case "toString":
+        return display(target);
+    }
+  } else if (Array.isArray(target)) {
+    switch (name) {
+      case "add":
+        target.push(args[0]);
+        return null;
+      case "get":
+        return target[args[0]];
+      case "set":
+        target[args[0]] = args[1];
+        return null;
+      case "size":
+        return target.length;
+      case "isEmpty":
+        return target.length === 0;
+      case "remove":
+        target.splice(args[0], 1);
+        return null;
+      case "contains":
+        return target.includes(args[0]);
+      case "subList":
+        return target.slice(args[0], args[1]);
+      case "toString":
+        return target.map(display).join(args.length > 0 ? args[0] : ",");
+      case "sort":
+        return [...target].sort((a, b) => (args[0] === false ? compare(b, a) : compare(a, b)));
+      case "sortDescending":
+        return [...target].sort((a, b) => compare(b.get(args[0]), a.get(args[0])));
+      case "isText":
+        return false;
+    }
+  }
+  throw new Error(`Unsupported method ${name} on ${target === null ? "null" : typeof target}`);
+}
+
+function binary(op, a, b) {
+  switch (op) {
+    case "+":
+      if (typeof a === "string" || typeof b === "string" || a instanceof DateTime || b instanceof DateTime)
+        return display(a) + display(b);
+      return a + b;
+    case "-":
+      return a - b;
+    case "*":
+      return a * b;
+    case "/":
+      return a / b;
+    case "%":
+      return a % b;
+    case "==":
+      return a === b || (a === undefined && b === null);
+    case "!=":
+      return !(a === b || (a === undefined && b === null));
+    case "<":
+      return a < b;
+    case "<=":
+      return a <= b;
+    case ">":
+      return a > b;
+    case ">=":
+      return a >= b;
+  }
+  throw new Error(`Unsupported operator ${op}`);
+}
+
+class Scope {
+  constructor(parent = null) {
+    this.vars = new Map();
+    this.parent = parent;
+  }
+  lookup(name) {
+    for (let scope = this; scope; scope = scope.parent) if (scope.vars.has(name)) return scope.vars.get(name);
+    throw new Error(`Undefined variable ${name}`);
+  }
+}
+
+class DelugeRuntime {
+  constructor() {
+    this.now = Date.now();
+    this.state = new Map();
+    this.posts = [];
+    this.infos = [];
+    this.invokeUrl = () => {
+      throw new Error("invokeurl called without runtime.invokeUrl");
+    };
+    this.global = new Scope();
+    this.global.vars.set("state", this.state);
+    this.installBuiltins();
+  }
+
+  installBuiltins() {
+    const runtime = this;
+    this.zoho = {
+      get currenttime() {
+        return new DateTime(runtime.now);
+      },
+      get currentdate() {
+        const d = new Date(runtime.now);
+        return new DateTime(new Date(d.getFullYear(), d.getMonth(), d.getDate()).getTime());
+      },
+      encryption: { md5: (text) => crypto.createHash("md5").update(display(text)).digest("hex") },
+    };
+    this.functions = {
+      map: () => new Map(),
+      list: () => [],
+      max: (a, b) => Math.max(a, b),
+      min: (a, b) => Math.min(a, b),
+      ceil: (a) => Math.ceil(a),
+      log: (a) => Math.log(a),
+      randomNumber: (low, high) => low + Math.floor(Math.random() * (high - low)),
+    };
+  }
+
+  // Point `state` at another map, e.g. one invocation's snapshot
+  useState(stateMap) {
+    this.state = stateMap;
+    this.global.vars.set("state", stateMap);
+  }
+
+  // Run Deluge source text as a top-level script
+  runSource(source, input = {}) {
+    const scope = new Scope(this.global);
+    scope.vars.set("input", fromPlain(input));
+    const result = this.exec(parse(source, "<source>"), scope);
+    return result instanceof Return ? result.value : null;
+  }
+
+  // Load a library file (utils/ or services/) into the shared global scope
+  load(file) {
+    this.exec(parse(fs.readFileSync(file, "utf-8"), path.basename(file)), this.global);
+  }
+
+  // Run a top-level script (bot or command) with `input` bound
+  runScript(file, input) {
+    const scope = new Scope(this.global);
+    scope.vars.set("input", fromPlain(input));
+    const result = this.exec(parse(fs.readFileSync(file, "utf-8"), path.basename(file)), scope);
+    return result instanceof Return ? result.value : null;
+  }
+
+  call(name, ...args) {
+    return this.invoke(this.global.lookup(name), args);
+  }
+
+  invoke(fn, args) {
+    if (typeof fn === "function") return fn(...args);
+    const scope = new Scope(this.global);
+    fn.params.forEach((param, i) => scope.vars.set(param, args[i] === undefined ? null : args[i]));
+    const result = this.exec(fn.body, scope);
+    return result instanceof Return ? result.value : null;
+  }
+
+  exec(statements, scope) {
+    for (const statement of statements) {
+      const result = this.statement(statement, scope);
+      if (result !== undefined) return result;
+    }
+    return undefined;
+  }
+
+  statement(node, scope) {
+    switch (node.kind) {
+      case "assign":
+        scope.vars.set(node.name, this.eval(node.value, scope));
+        return undefined;
+      case "expr":
+        this.eval(node.value, scope);
+        return undefined;
+      case "if":
+        if (this.eval(node.test, scope)) return this.exec(node.then, scope);
+        if (node.otherwise) return this.exec(node.otherwise, scope);
+        return undefined;
+      case "for": {
+        const items = this.eval(node.iterable, scope);
+        for (const item of [...items]) {
+          scope.vars.set(node.name, item);
+          const result = this.exec(node.body, scope);
+          if (result === BREAK) break;
+          if (result !== undefined) return result;
+        }
+        return undefined;
+      }
+      case "return":
+        return new Return(node.value ? this.eval(node.value, scope) : null);
+      case "break":
+        return BREAK;
+      case "try":
+        try {
+          return this.exec(node.body, scope);
+        } catch (error) {
+          scope.vars.set(node.name, error.message);
+          return this.exec(node.handler, scope);
+        }
+      case "info":
+        this.infos.push(display(this.eval(node.value, scope)));
+        return undefined;
+      case "post":
+        this.posts.push({
+          channel: this.eval(node.fields.channel, scope),
+          message: this.eval(node.fields.message, scope),
+        });
+        return undefined;
+    }
+    throw new Error(`Unknown statement ${node.kind}`);
+  }
+
+  eval(node, scope) {
+    switch (node.kind) {
+      case "literal":
+        return node.value;
+      case "name":
+        if (node.name === "zoho") return this.zoho;
+        return scope.lookup(node.name);
+      case "lambda":
+        return new Lambda(node.params, node.body);
+      case "invokeurl": {
+        const request = {};
+        for (const [key, value] of Object.entries(node.fields)) request[key] = toPlain(this.eval(value, scope));
+        return fromPlain(this.invokeUrl(request));
+      }
+      case "map":
+        return new Map(node.entries.map(([k, v]) => [this.eval(k, scope), this.eval(v, scope)]));
+      case "list":
+        return node.items.map((item) => this.eval(item, scope));
+      case "not":
+        return !this.eval(node.value, scope);
+      case "neg":
+        return -this.eval(node.value, scope);
+      case "binary":
+        if (node.op === "&&") return this.eval(node.left, scope) && this.eval(node.right, scope);
+        if (node.op === "||") return this.eval(node.left, scope) || this.eval(node.right, scope);
+        return binary(node.op, this.eval(node.left, scope), this.eval(node.right, scope));
+      case "member": {
+        const target = this.eval(node.target, scope);
+        if (target instanceof Map) return target.has(node.name) ? target.get(node.name) : null;
+        return target[node.name];
+      }
+      case "fcall": {
+        const args = node.args.map((arg) => this.eval(arg, scope));
+        if (this.functions[node.name] && !this.global.vars.has(node.name)) return this.functions[node.name](...args);
+        return this.invoke(scope.lookup(node.name), args);
+      }
+      case "call": {
+        const target = this.eval(node.target, scope);
+        const args = node.args.map((arg) => this.eval(arg, scope));
+        if (target === this.zoho.encryption) return target[node.name](...args);
+        // Host objects (e.g. a webhook context) expose callbacks as map values
+        if (target instanceof Map && typeof target.get(node.name) === "function") return target.get(node.name)(...args);
+        if (target === null || target === undefined) throw new Error(`Method ${node.name} called on null`);
+        return callMethod(target, node.name, args);
+      }
+    }
+    throw new Error(`Unknown expression ${node.kind}`);
+  }
+}
+
+// Runtime with every utils/ and services/ file from the manifest loaded
+function loadExtension(root = path.join(__dirname, "..")) {
+  const manifest = JSON.parse(fs.readFileSync(path.join(root, "manifest.json"), "utf-8"));
+  const runtime = new DelugeRuntime();
+  for (const file of [...manifest.utils, ...manifest.services]) runtime.load(path.join(root, file));
+  return runtime;
+}
+
+module.exports = { DelugeRuntime, loadExtension, toPlain, fromPlain, parse };
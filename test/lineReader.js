@@ -0,0 +1,64 @@
+// Streaming line reader for log archives
+//
+// Reads the file in fixed-size chunks into one reused Buffer and yields each
+// line as a view into it, so nothing is copied per line and memory stays at
+// one chunk plus the longest line however large the file is. A view is only
+// valid until the next line is requested; toString() it to keep it. Lines
+// end at "\n", a trailing "\r" is dropped, and a final "\n" does not start an
+// empty last line, as MappedLines in the native core (native/include/
+// neurafilter/mappedLines.h).
+
+const fs = require("fs");
+
+const NEWLINE = 0x0a;
+const RETURN = 0x0d;
+
+function withoutReturn(view) {
+  return view.length > 0 && view[view.length - 1] === RETURN ? view.subarray(0, view.length - 1) : view;
+}
+
+function* lineBuffers(file, chunkBytes = 1 << 20) {
+  const fd = fs.openSync(file, "r");
+  let buffer = Buffer.allocUnsafe(chunkBytes);
+  let start = 0; // first byte of the current line
+  let end = 0; // end of the bytes read so far
+  let scan = 0; // bytes before this hold no newline
+  try {
+    for (;;) {
+      const newline = buffer.subarray(scan, end).indexOf(NEWLINE);
+      if (newline >= 0) {
+        yield withoutReturn(buffer.subarray(start, scan + newline));
+        start = scan = scan + newline + 1;
+        continue;
+      }
+      // Move the partial line to the front, growing the buffer only for a
+      // line longer than it, and read the next chunk behind it
+      if (start > 0) {
+        buffer.copy(buffer, 0, start, end);
+        end -= start;
+        start = 0;
+      }
+      if (end === buffer.length) {
+        const grown = Buffer.allocUnsafe(buffer.length * 2);
+        buffer.copy(grown, 0, 0, end);
+        buffer = grown;
+      }
+      scan = end;
+      const read = fs.readSync(fd, buffer, end, buffer.length - end, null);
+      if (read === 0) {
+        if (end > start) yield withoutReturn(buffer.subarray(start, end));
+        return;
+      }
+      end += read;
+    }
+  } finally {
+    fs.closeSync(fd);
+  }
+}
+
+// The same lines as strings, for callers that need to keep them
+function* readLines(file, chunkBytes) {
+  for (const view of lineBuffers(file, chunkBytes)) yield view.toString("utf-8");
+}
+
+module.exports = { lineBuffers, readLines };
@@ -0,0 +1,592 @@
+// Golden-output parity between the Deluge services and the local harness
+//
+// Usage:
+//   node test/parityTest.js [--update-golden]
+//   node test/parityTest.js --native native/_build/neurafilter.node
+//
+// Drives the same inputs, on the same virtual clock, through
+// runPipeline() in services/logPipeline.deluge (executed by
+// test/delugeRunner.js) and through runLine() in test/runLocalTest.js, and
+// diffs action, reason, masked message, score, event time, queueing and
+// digest line by line. Each scenario's Deluge output is also checked
+// against test/parityGolden.json, so a change to either side that alters
+// behaviour shows up here until the golden file is regenerated on purpose.
+// With --native, the native engine (native/, built by CMake or node-gyp)
+// takes the Deluge side's place against the harness and the golden file,
+// both line by line and through its parallel batch path, and its single
+// stages are fuzzed against the harness's. A file replay through
+// test/lineReader.js and the addon's replayFile(), and restarts from
+// snapshots, and channel churn, are checked as well; without it, the
+// adaptive samplers of both sides are fed one latency profile, the
+// Deluge masking scanner is fuzzed against the harness's regexes, and
+// batches in digest mode are checked to report every line they buffer.
+// Digest mode is Deluge-side only (the native engine leaves posting to its
+// caller), so those scenarios are skipped with --native.
+// Exits non-zero on any difference.
+
+process.env.TZ = "UTC";
+
+const fs = require("fs");
+const path = require("path");
+const crypto = require("crypto");
+const { loadExtension, toPlain, fromPlain } = require("./delugeRunner");
+const harness = require("./runLocalTest");
+const { syntheticLines, mulberry32 } = require("./benchmark");
+const { readLines } = require("./lineReader");
+
+const GOLDEN = path.join(__dirname, "parityGolden.json");
+const START = Date.UTC(2025, 10, 16, 9, 0, 0);
+
+function sampleLines(intervalMs) {
+  return fs
+    .readFileSync(path.join(__dirname, "sampleLogs.txt"), "utf-8")
+    .split("\n")
+    .map((line, i) => ({ line, now: START + i * intervalMs }));
+}
+
+function synthetic(options) {
+  const lines = [];
+  const args = { lines: 2000, dupRatio: 0.5, cardinality: 50, sensitive: 0.3, seed: 7, intervalMs: 250, start: START, ...options };
+  for (const { line, now } of syntheticLines(args)) lines.push({ line, now });
+  return lines;
+}
+
+// Same ingest times, but line content reversed within each run of n lines,
+// so event times arrive late and out of order
+function outOfOrder(lines, n) {
+  return lines.map(({ now }, i) => {
+    const runStart = i - (i % n);
+    const mirror = Math.min(runStart + n, lines.length) - 1 - (i - runStart);
+    return { line: lines[mirror].line, now };
+  });
+}
+
+// Lines that once went wrong, each run twice, a second and then two
+// minutes later (ingest time)
+const REGRESSIONS = [
+  // A leading timestamp must not let INFO and ERROR share a template
+  "2024-01-15T10:00:00Z INFO Database connection failed at host-a",
+  "2024-01-15T10:00:01Z ERROR Database connection failed at host-a",
+  // A date without a time of day must not pin every repeat to one instant
+  "2024-01-15 WARN Disk usage high on volume data",
+];
+
+function regressionLines() {
+  return [0, 1000, 121000].flatMap((offset) => REGRESSIONS.map((line, i) => ({ line, now: START + offset + i })));
+}
+
+// Secrets the channel masking rules below cover, one appended to every
+// third line
+const SECRETS = [
+  (i) => `key=AKIA${String(i).padStart(16, "0")}`,
+  (i) => `session eyJhbGciOiJIUzI1NiJ9.eyJzdWIiOiI${i}In0.sig_${i % 7}-x`,
+  (i) => `card 4111 1111 1111 ${String(i % 10000).padStart(4, "0")} approved`,
+  (i) => `card 5${String(i).padStart(15, "0")}`,
+  (i) => `upstream db-${i % 5}.eu.corp.internal:5432`,
+  (i) => `from cache.svc.local (order ORD-${String(i).padStart(6, "0")})`,
+];
+
+function withSecrets(lines) {
+  return lines.map(({ line, now }, i) => ({ line: i % 3 === 0 ? `${line} ${SECRETS[(i / 3) % SECRETS.length](i)}` : line, now }));
+}
+
+// What /configFilter mask=aws,jwt,card maskHost=corp.internal,svc.local
+// maskRule=ORDER:ORD-\d{6} resolves to
+function channelMaskRules() {
+  const runtime = loadExtension();
+  const presets = toPlain(runtime.call("maskPresets"));
+  const hosts = toPlain(runtime.call("maskHostRule", ["corp.internal", "svc.local"]));
+  return [presets.aws, presets.jwt, presets.card, hosts, { label: "ORDER", pattern: "ORD-\\d{6}" }];
+}
+
+// Each scenario: input lines with ingest times, channels they alternate
+// over, an optional channel config override, and whether the native engine
+// runs it
+const SCENARIOS = [
+  { name: "sampleLogs", lines: () => sampleLines(1000), channels: ["local"], full: true },
+  { name: "sampleLogs-burst", lines: () => sampleLines(0), channels: ["local"], full: true },
+  { name: "synthetic-default", lines: () => synthetic({}), channels: ["a", "b"] },
+  {
+    name: "synthetic-tight",
+    lines: () => synthetic({ seed: 11, cardinality: 200, intervalMs: 100 }),
+    channels: ["a"],
+    config: { dedup_window_ms: 5000, anomaly_threshold: 3, rate_limit: 1, rate_burst: 2 },
+  },
+  {
+    name: "synthetic-approx",
+    lines: () => synthetic({ seed: 5, dupRatio: 0.6, cardinality: 400, intervalMs: 100 }),
+    channels: ["a", "b"],
+    // Sketches small enough for collisions, false positives and evictions
+    config: {
+      dedup_window_ms: 5000,
+      anomaly_threshold: 3,
+      rate_limit: 600,
+      rate_burst: 600,
+      approximate: true,
+      sketch_width: 64,
+      sketch_depth: 3,
+      dedup_bits: 512,
+      dedup_hashes: 3,
+      top_k: 8,
+    },
+  },
+  {
+    name: "synthetic-digest",
+    lines: () => synthetic({ seed: 13, cardinality: 30, intervalMs: 500 }),
+    channels: ["a", "b"],
+    // Digests that go out on size and on age, some of them rate limited
+    config: { digest_mode: true, digest_interval_ms: 20000, digest_size: 25, rate_limit: 2, rate_burst: 2 },
+    native: false,
+  },
+  {
+    name: "synthetic-masked",
+    lines: () => withSecrets(synthetic({ seed: 17, cardinality: 40 })),
+    channels: ["a", "b"],
+    config: { mask_rules: channelMaskRules() },
+  },
+  {
+    name: "synthetic-sampled",
+    lines: () => synthetic({ seed: 19, cardinality: 100, intervalMs: 100 }),
+    channels: ["a", "b"],
+    // Sampling reports on posts, held over while rate limited
+    config: { sample_mode: "on", sample_min_rate: 0.3, rate_limit: 10, rate_burst: 5 },
+  },
+  {
+    name: "synthetic-sampled-strict",
+    lines: () => synthetic({ seed: 23, cardinality: 100, intervalMs: 100 }),
+    channels: ["a"],
+    // No line reaches sampleMinScore and keywords add nothing, so only the
+    // level and keyword exemptions keep ERROR, WARN and keyword lines
+    config: { sample_mode: "on", sample_min_rate: 0.2, sample_min_score: 5, keyword_boost: 0, rate_limit: 600, rate_burst: 600 },
+  },
+  { name: "regressions", lines: regressionLines, channels: ["local"] },
+  {
+    name: "synthetic-late",
+    lines: () => outOfOrder(synthetic({ seed: 3, dupRatio: 0.8, cardinality: 20, intervalMs: 5000 }), 10),
+    channels: ["a"],
+  },
+];
+
+// The fields both sides must agree on; overflow digests compare by message,
+// post digests by their text
+function project(result) {
+  const record = {
+    action: result.action,
+    reason: result.reason,
+    message: result.message,
+    score: result.score,
+  };
+  if (result.timestamp !== undefined) record.timestamp = result.timestamp;
+  if (result.queued !== undefined) record.queued = result.queued;
+  if (result.digest !== undefined) record.digest = result.digest.map((queued) => queued.message);
+  if (result.buffered !== undefined) record.buffered = result.buffered;
+  if (result.summary !== undefined) record.summary = result.summary;
+  if (result.sampling !== undefined) record.sampling = result.sampling;
+  return record;
+}
+
+function runDeluge(scenario, lines) {
+  const runtime = loadExtension();
+  runtime.now = START;
+  const config = toPlain(runtime.call("defaultFilterConfig"));
+  Object.assign(config, scenario.config || {});
+  // One resolved config map for the run, as getChannelConfig() returns, so
+  // compiled masking rules are cached in it
+  const resolved = fromPlain(config);
+  return lines.map(({ line, now }, i) => {
+    runtime.now = now;
+    const channel = scenario.channels[i % scenario.channels.length];
+    return project(toPlain(runtime.call("runPipeline", line, channel, resolved)));
+  });
+}
+
+function runHarness(scenario, lines) {
+  harness.resetState();
+  const config = { ...harness.defaultConfig, ...(scenario.config || {}) };
+  return lines.map(({ line, now }, i) => {
+    const channel = scenario.channels[i % scenario.channels.length];
+    return project(harness.runLine(line, { now, channel, config }));
+  });
+}
+
+function runNative(addon, scenario, lines) {
+  const engine = new addon.Engine({ rules: harness.scoringRules, config: harness.defaultConfig });
+  const config = { ...harness.defaultConfig, ...(scenario.config || {}) };
+  return lines.map(({ line, now }, i) => {
+    const channel = scenario.channels[i % scenario.channels.length];
+    return project(engine.runLine(line, { now, channel, config }));
+  });
+}
+
+// The same lines in one runBatch() call on the engine's worker pool, with
+// small chunks so every channel's lines are spread over several tasks
+function runNativeParallel(addon, scenario, lines) {
+  const engine = new addon.Engine({ rules: harness.scoringRules, config: harness.defaultConfig });
+  const config = { ...harness.defaultConfig, ...(scenario.config || {}) };
+  const channels = lines.map((_, i) => scenario.channels[i % scenario.channels.length]);
+  const results = engine.runBatch(
+    lines.map(({ line }) => line),
+    lines.map(({ now }) => now),
+    { config, channels, threads: 4, chunkLines: 64 }
+  );
+  return results.map(project);
+}
+
+// A scenario written out with CRLF endings, read back by test/lineReader.js
+// in chunks far shorter than a line and replayed by the addon's
+// replayFile() from a memory map; both must reproduce the harness
+function checkReplay(addon) {
+  const scenario = SCENARIOS.find(({ name }) => name === "synthetic-tight");
+  const lines = scenario.lines();
+  const config = { ...harness.defaultConfig, ...scenario.config };
+  const file = path.join(require("os").tmpdir(), `neurafilter-replay-${process.pid}.log`);
+  fs.writeFileSync(file, lines.map(({ line }) => `${line}\r\n`).join(""));
+  const failures = [];
+  try {
+    const read = [...readLines(file, 64)];
+    if (read.length !== lines.length || read.some((line, i) => line !== lines[i].line))
+      failures.push(`  lineReader: ${read.length} lines read back, ${lines.length} written`);
+
+    harness.resetState();
+    const reasons = {};
+    const expected = [];
+    lines.forEach(({ line, now }, i) => {
+      const result = harness.runLine(line, { now, channel: "a", config });
+      reasons[result.reason] = (reasons[result.reason] || 0) + 1;
+      if (result.action === "suppress") return;
+      const record = { line: i + 1, action: result.action, reason: result.reason, message: result.message, score: result.score };
+      if (result.timestamp !== undefined) record.timestamp = result.timestamp;
+      if (result.digest && result.digest.length > 0) record.digest = result.digest.length;
+      expected.push(JSON.stringify(record));
+    });
+
+    const output = `${file}.ndjson`;
+    const engine = new addon.Engine({ rules: harness.scoringRules, config: harness.defaultConfig });
+    const interval = lines[1].now - lines[0].now;
+    const summary = engine.replayFile(file, { now: lines[0].now, intervalMs: interval, channel: "a", config, batchLines: 300, output });
+    const records = fs.readFileSync(output, "utf-8").split("\n").filter(Boolean);
+    fs.unlinkSync(output);
+    if (JSON.stringify(summary.reasons) !== JSON.stringify(Object.fromEntries(Object.entries(reasons).sort())))
+      failures.push(`  replayFile reasons: ${JSON.stringify(summary.reasons)}, harness ${JSON.stringify(reasons)}`);
+    const first = expected.findIndex((record, i) => record !== records[i]);
+    if (first >= 0 || records.length !== expected.length)
+      failures.push(`  replayFile output: ${records.length} records, harness ${expected.length}, first difference at ${first}`);
+  } finally {
+    fs.unlinkSync(file);
+  }
+  console.log(`${failures.length === 0 ? "ok  " : "FAIL"} file replay: ${lines.length} lines (lineReader and replayFile)`);
+  if (failures.length > 0) console.log(failures.join("\n"));
+  return failures.length;
+}
+
+// Restarts from snapshots: a full save after the first third, a restart
+// that only uses channel "a" and saves again (appending "a" while "b" keeps
+// its section), and a second restart that runs the rest over both channels.
+// Together they must match one uninterrupted harness run. Run with the
+// default config and with the synthetic-approx scenario's sketches.
+function checkSnapshot(addon, mode, config) {
+  const lines = synthetic({ seed: 5 });
+  const third = Math.floor(lines.length / 3);
+  const channelOf = (i) => (i >= third && i < 2 * third ? "a" : ["a", "b"][i % 2]);
+  const file = path.join(require("os").tmpdir(), `neurafilter-snapshot-${process.pid}.bin`);
+  const failures = [];
+  const newEngine = () => new addon.Engine({ rules: harness.scoringRules, config });
+  const runRange = (engine, begin, end) =>
+    lines.slice(begin, end).map(({ line, now }, k) => project(engine.runLine(line, { now, channel: channelOf(begin + k), config })));
+  try {
+    let engine = newEngine();
+    const records = runRange(engine, 0, third);
+    const first = engine.saveSnapshot(file);
+    if (first.channels !== 2 || first.written !== 2 || !first.compacted) failures.push(`  first save: ${JSON.stringify(first)}`);
+
+    engine = newEngine();
+    if (engine.loadSnapshot(file) !== 2) failures.push("  snapshot did not load 2 channels");
+    records.push(...runRange(engine, third, 2 * third));
+    const second = engine.saveSnapshot(file);
+    if (second.channels !== 2 || second.written !== 1 || second.compacted) failures.push(`  second save: ${JSON.stringify(second)}`);
+
+    engine = newEngine();
+    engine.loadSnapshot(file);
+    records.push(...runRange(engine, 2 * third, lines.length));
+
+    harness.resetState();
+    lines.forEach(({ line, now }, i) => {
+      const expected = JSON.stringify(project(harness.runLine(line, { now, channel: channelOf(i), config })));
+      if (expected !== JSON.stringify(records[i])) failures.push(`  line ${i + 1}\n    restarted: ${JSON.stringify(records[i])}\n    harness:   ${expected}`);
+    });
+
+    fs.writeFileSync(file, "not a snapshot");
+    try {
+      newEngine().loadSnapshot(file);
+      failures.push("  a foreign file loaded as a snapshot");
+    } catch (error) {
+      if (!/not a snapshot/.test(error.message)) failures.push(`  foreign file: ${error.message}`);
+    }
+  } finally {
+    fs.rmSync(file, { force: true });
+  }
+  console.log(`${failures.length === 0 ? "ok  " : "FAIL"} snapshot restarts (${mode}): ${lines.length} lines, 2 restarts`);
+  if (failures.length > 0) console.log(failures.slice(0, 5).join("\n"));
+  return failures.length;
+}
+
+// Channels come and go: shards over the cap or idle past their horizon are
+// dropped, and a dropped channel starts over rather than from the snapshot
+function checkChannelChurn(addon) {
+  const config = harness.defaultConfig;
+  const engine = new addon.Engine({ rules: harness.scoringRules, config });
+  const file = path.join(require("os").tmpdir(), `neurafilter-churn-${process.pid}.bin`);
+  const failures = [];
+  const start = 1700000000000;
+  const line = "2024-01-01T00:00:00Z ERROR payment 42 failed";
+  try {
+    for (let i = 0; i < 80000; i++) engine.runLine(`${line} ${i}`, { now: start, channel: `c${i}`, config });
+    const held = engine.stateSizes().shards;
+    if (held > 65536) failures.push(`  ${held} shards held after 80000 channels`);
+
+    engine.reset();
+    engine.runLine(line, { now: start, channel: "old", config });
+    engine.saveSnapshot(file);
+    const later = start + 3600000;
+    engine.runLine(line, { now: later, channel: "new", config });
+    if (engine.stateSizes().shards !== 1) failures.push(`  idle shard kept: ${JSON.stringify(engine.stateSizes())}`);
+    const saved = engine.saveSnapshot(file);
+    if (saved.channels !== 1) failures.push(`  idle channel still saved: ${JSON.stringify(saved)}`);
+    const again = JSON.stringify(project(engine.runLine(line, { now: later, channel: "old", config })));
+    const fresh = JSON.stringify(project(new addon.Engine({ rules: harness.scoringRules, config }).runLine(line, { now: later, channel: "old", config })));
+    if (again !== fresh) failures.push(`  dropped channel came back\n    got:   ${again}\n    fresh: ${fresh}`);
+  } finally {
+    fs.rmSync(file, { force: true });
+  }
+  console.log(`${failures.length === 0 ? "ok  " : "FAIL"} channel churn: 80000 channels, then one idle past its horizon`);
+  if (failures.length > 0) console.log(failures.join("\n"));
+  return failures.length;
+}
+
+// Stage-by-stage comparison on a corpus with every token shape the regexes
+// care about, including near misses
+function fuzzStages(addon) {
+  const engine = new addon.Engine({ rules: harness.scoringRules, config: harness.defaultConfig });
+  let seed = 99;
+  const random = () => {
+    seed = (seed * 1103515245 + 12345) & 0x7fffffff;
+    return seed / 0x7fffffff;
+  };
+  const pick = (items) => items[Math.floor(random() * items.length)];
+  const words = [
+    "ERROR", "WARN", "INFO", "DEBUG", "error", "Timeout", "failed", "user", "id=42", "0x1f", "deadbeef", "cafe12",
+    "a.b@c.io", "x@y", "first.last+tag@mail.example.com", "10.0.0.1", "256.1.1.1", "1.2.3", "http://a.b/c?d=1",
+    "https://x.io", "/var/log/app.log", "C:\\temp\\x", "2025-11-16T09:00:00Z", "2025-11-16", "2025-02-30",
+    "2025-11-16T09:00:00+05:30", "2025-11-16T24:00:00", "09:30:15.250", "1763283600000", "1763283600", "12/31/2025",
+    "3.14", "v2.0.1", "550e8400-e29b-41d4-a716-446655440000", "token=abcdef123456", "Bearer", "", "  ", "#!", "αβγ",
+  ];
+  const failures = [];
+  for (let i = 0; i < 4000; i++) {
+    // Up to 24 words, so lines span several 16- and 32-byte scan blocks
+    const line = Array.from({ length: 1 + Math.floor(random() * 24) }, () => pick(words)).join(random() < 0.1 ? "  " : " ");
+    const now = START + i * 1000;
+    const channel = pick(["a", "b"]);
+    const checks = [
+      ["mask", harness.maskSensitive(line), engine.maskSensitive(line)],
+      ["template", harness.templateOf(line, channel), engine.templateOf(line, channel)],
+      ["timestamp", harness.extractTimestamp(line, channel, now), engine.extractTimestamp(line, channel, now)],
+      ["score", harness.scoreLog(line, i % 400000), engine.scoreLog(line, i % 400000)],
+    ];
+    for (const [stage, expected, actual] of checks)
+      if (JSON.stringify(expected) !== JSON.stringify(actual))
+        failures.push(`  ${stage} ${JSON.stringify(line)}\n    harness: ${JSON.stringify(expected)}\n    native:  ${JSON.stringify(actual)}`);
+  }
+  console.log(`${failures.length === 0 ? "ok  " : "FAIL"} stage fuzz: 4000 lines (${addon.simdKernel} scan kernel)`);
+  if (failures.length > 0) console.log(failures.slice(0, 5).join("\n"));
+  return failures.length;
+}
+
+// sample_mode "auto" follows the measured latency, which neither side can
+// reproduce, so the sampler is fed one latency profile directly: quiet,
+// a ramp well past sample_latency_ms, then quiet again. Low-score and
+// high-score lines alternate; only lines the sampler keeps feed it.
+function checkSamplerLoad() {
+  const runtime = loadExtension();
+  const config = { ...toPlain(runtime.call("defaultFilterConfig")), sample_mode: "auto" };
+  const resolved = fromPlain(config);
+  const sampler = runtime.call("openSampler", "load");
+  harness.resetState();
+  const local = harness.openSampler("load");
+  const latency = (i) => (i < 100 ? 5 : i < 300 ? 5 + (i - 100) * 0.6 : i < 500 ? 125 : 5);
+
+  const failures = [];
+  let sampled = 0;
+  let active = 0;
+  for (let i = 0; i < 800; i++) {
+    const match = i % 3 === 0 ? { score: 3, level: "ERROR", keyword: false } : { score: 1, level: "INFO", keyword: false };
+    const kept = runtime.call("samplerKeeps", sampler, fromPlain(match), resolved);
+    const localKept = harness.samplerKeeps(local, match, config);
+    if (kept) runtime.call("recordLineLatency", sampler, latency(i), resolved);
+    if (localKept) harness.recordLineLatency(local, latency(i), config);
+    const expected = JSON.stringify({ kept: localKept, ...local });
+    const actual = JSON.stringify({ kept, ...toPlain(sampler) });
+    if (expected !== actual) failures.push(`  line ${i + 1}\n    deluge:  ${actual}\n    harness: ${expected}`);
+    if (!kept) sampled++;
+    if (local.active) active++;
+  }
+  if (sampled === 0 || active === 0 || local.active) failures.push(`  sampled ${sampled}, active on ${active} lines, active at the end: ${local.active}`);
+  console.log(`${failures.length === 0 ? "ok  " : "FAIL"} sampler under load: 800 lines (sampled=${sampled}, active=${active})`);
+  if (failures.length > 0) console.log(failures.slice(0, 5).join("\n"));
+  return failures.length;
+}
+
+// utils/maskSensitive.deluge's character scanner against the harness's
+// replaceAll() passes, on lines built from pieces of every built-in pattern
+// and the characters that end or join them
+function checkMaskScanner() {
+  const runtime = loadExtension();
+  const config = runtime.call("defaultFilterConfig");
+  const random = mulberry32(21);
+  const pieces = ["a", "Z", "1", "12", "255", "1234", ".", "..", "@", "/", "//", "://", "http", "https://", "Bearer",
+                  "token ", " ", "\t", "-", "_", "%", ":", "[", "]", "com", "x.io", "é"];
+  const failures = [];
+  for (let i = 0; i < 3000; i++) {
+    const line = Array.from({ length: 1 + Math.floor(random() * 20) }, () => pieces[Math.floor(random() * pieces.length)]).join("");
+    const expected = harness.maskSensitive(line);
+    const actual = runtime.call("maskSensitive", line, config);
+    if (expected !== actual) failures.push(`  ${JSON.stringify(line)}\n    harness: ${JSON.stringify(expected)}\n    deluge:  ${JSON.stringify(actual)}`);
+  }
+  console.log(`${failures.length === 0 ? "ok  " : "FAIL"} mask scanner: 3000 lines (Deluge)`);
+  if (failures.length > 0) console.log(failures.slice(0, 5).join("\n"));
+  return failures.length;
+}
+
+// runPipelineBatch() with digest_mode buffers its passing lines and
+// duplicates into the post digest and takes the digest once it is due, so
+// every buffered line is reported by exactly one summary
+function checkBatchDigest() {
+  const runtime = loadExtension();
+  const config = { ...toPlain(runtime.call("defaultFilterConfig")), ...SCENARIOS.find(({ name }) => name === "synthetic-digest").config };
+  const resolved = fromPlain(config);
+  const lines = synthetic({ seed: 13, cardinality: 30, intervalMs: 500 });
+  const batches = [];
+  for (let i = 0; i < lines.length; i += 10) batches.push(lines.slice(i, i + 10));
+  // A last, empty batch once everything has settled takes the remainder
+  const end = lines[lines.length - 1].now + config.digest_interval_ms * 2;
+  batches.push([{ line: null, now: end }]);
+
+  const failures = [];
+  let buffered = 0;
+  let reported = 0;
+  let summaries = 0;
+  for (const chunk of batches) {
+    runtime.now = chunk[chunk.length - 1].now;
+    const messages = chunk.filter(({ line }) => line !== null).map(({ line }) => line);
+    const batch = toPlain(runtime.call("runPipelineBatch", fromPlain(messages), "batch", resolved));
+    const held = batch.results.filter((result) => result.buffered === true);
+    buffered += held.length;
+    if (batch.buffered !== held.length) failures.push(`  batch at ${runtime.now}: buffered=${batch.buffered}, ${held.length} results`);
+    if (held.some((result) => batch.passed.includes(result.message))) failures.push(`  batch at ${runtime.now}: a buffered line also passed`);
+    if (batch.summary !== null) {
+      summaries++;
+      reported += Number(/Digest of (\d+) logs/.exec(batch.summary)[1]);
+    }
+  }
+  if (summaries < 2 || reported !== buffered) failures.push(`  ${summaries} summaries reporting ${reported} of ${buffered} buffered lines`);
+  console.log(`${failures.length === 0 ? "ok  " : "FAIL"} batch digest: ${lines.length} lines in ${batches.length} batches (summaries=${summaries}, buffered=${buffered})`);
+  if (failures.length > 0) console.log(failures.slice(0, 5).join("\n"));
+  return failures.length;
+}
+
+// /configFilter turns down a maskRule that does not compile and keeps the
+// channel's config; the native engine, handed one anyway, masks with the
+// rest
+function checkInvalidMaskRule(addon) {
+  const args = "maskRule=ORDER:ORD-\\d{6} maskRule=BROKEN:(ORD-[0-9";
+  const line = "ERROR Payment failed for ORD-123456";
+  const failures = [];
+  if (addon) {
+    const engine = new addon.Engine({ rules: harness.scoringRules, config: harness.defaultConfig });
+    const mask_rules = [{ label: "ORDER", pattern: "ORD-\\d{6}" }, { label: "BROKEN", pattern: "(ORD-[0-9" }];
+    try {
+      const result = engine.runLine(line, { now: 1000, channel: "mask", config: { ...harness.defaultConfig, mask_rules } });
+      if (!result.message.includes("[REDACTED_ORDER]")) failures.push(`  masked as ${JSON.stringify(result.message)}`);
+    } catch (error) {
+      failures.push(`  runLine threw: ${error.message}`);
+    }
+  } else {
+    const runtime = loadExtension();
+    const script = path.join(__dirname, "..", "commands", "configFilter.deluge");
+    const before = JSON.stringify(toPlain(runtime.call("channelShard", "mask")).filterConfig);
+    const reply = toPlain(runtime.runScript(script, { channel_id: "mask", args }));
+    const after = JSON.stringify(toPlain(runtime.call("channelShard", "mask")).filterConfig);
+    if (!reply.message.includes("BROKEN")) failures.push(`  reply: ${JSON.stringify(reply.message)}`);
+    if (before !== after) failures.push(`  config changed: ${after}`);
+  }
+  console.log(`${failures.length === 0 ? "ok  " : "FAIL"} invalid maskRule: ${addon ? "native engine" : "/configFilter"}`);
+  if (failures.length > 0) console.log(failures.join("\n"));
+  return failures.length;
+}
+
+function hash(records) {
+  return crypto.createHash("sha256").update(JSON.stringify(records)).digest("hex");
+}
+
+function main() {
+  const update = process.argv.includes("--update-golden");
+  const nativeIndex = process.argv.indexOf("--native");
+  const addon = nativeIndex > 0 ? require(path.resolve(process.argv[nativeIndex + 1])) : null;
+  const side = addon ? "native" : "deluge";
+  const golden = fs.existsSync(GOLDEN) ? JSON.parse(fs.readFileSync(GOLDEN, "utf-8")) : {};
+  let failures = 0;
+
+  for (const scenario of SCENARIOS) {
+    if (addon && scenario.native === false) continue;
+    const lines = scenario.lines();
+    const deluge = addon ? runNative(addon, scenario, lines) : runDeluge(scenario, lines);
+    const local = runHarness(scenario, lines);
+
+    const diffs = [];
+    const compare = (records, name) =>
+      records.forEach((record, i) => {
+        const expected = JSON.stringify(record);
+        const actual = JSON.stringify(local[i]);
+        if (expected !== actual) diffs.push(`  line ${i + 1}: ${JSON.stringify(lines[i].line)}\n    ${name}:  ${expected}\n    harness: ${actual}`);
+      });
+    compare(deluge, side);
+    if (addon) compare(runNativeParallel(addon, scenario, lines), "native parallel");
+
+    const summary = { lines: lines.length, sha256: hash(deluge) };
+    if (scenario.full) summary.records = deluge;
+    const stored = golden[scenario.name];
+    let goldenDrift = false;
+    if (update && !addon) golden[scenario.name] = summary;
+    else goldenDrift = !stored || stored.sha256 !== summary.sha256;
+
+    const counts = {};
+    for (const record of deluge) counts[record.reason] = (counts[record.reason] || 0) + 1;
+    const status = diffs.length === 0 && !goldenDrift ? "ok" : "FAIL";
+    console.log(`${status.padEnd(4)} ${scenario.name}: ${lines.length} lines (${Object.entries(counts).map(([reason, n]) => `${reason}=${n}`).join(", ")})`);
+
+    if (diffs.length > 0) {
+      failures++;
+      console.log(`  ${diffs.length} lines differ between ${side} and harness:`);
+      console.log(diffs.slice(0, 5).join("\n"));
+    }
+    if (goldenDrift) {
+      failures++;
+      const first = stored && stored.records ? stored.records.findIndex((r, i) => JSON.stringify(r) !== JSON.stringify(deluge[i])) : -1;
+      console.log(`  ${side} output no longer matches the golden file${first >= 0 ? ` (first change at line ${first + 1})` : ""}`);
+    }
+  }
+
+  if (addon) {
+    const approximate = { ...harness.defaultConfig, ...SCENARIOS.find(({ name }) => name === "synthetic-approx").config };
+    failures += fuzzStages(addon) + checkReplay(addon) + checkChannelChurn(addon);
+    failures += checkSnapshot(addon, "exact", harness.defaultConfig) + checkSnapshot(addon, "approximate", approximate);
+  }
+  if (!addon) failures += checkSamplerLoad() + checkMaskScanner() + checkBatchDigest();
+  failures += checkInvalidMaskRule(addon);
+  if (update && !addon) {
+    fs.writeFileSync(GOLDEN, `${JSON.stringify(golden, null, 2)}\n`);
+    console.log(`Golden output updated: ${GOLDEN}`);
+  }
+  process.exit(failures > 0 ? 1 : 0);
+}
+
+main();
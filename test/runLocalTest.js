@@ -1,83 +1,922 @@
 const fs = require("fs");
+const crypto = require("crypto");
+const path = require("path");
+const v8 = require("v8");
 
-let dedupMap = new Map();
-let freqMap = new Map();
-let rateLimiter = { count: 0, windowStart: Date.now() };
+// Mirrors utils/channelState.deluge: every channel's filter, template,
+// timestamp and rate-limit state lives in its own shard
+let shards = new Map();
+
+function channelShard(channel) {
+  let shard = shards.get(channel);
+  if (!shard) {
+    shard = {
+      templateGroups: new Map(),
+      templateCache: new Map(),
+      entryMap: new Map(),
+      filterMetrics: null,
+      filterSketch: null,
+      postDigest: null,
+      sampler: null,
+      timestampFormat: null,
+      bucket: null,
+      counters: { deltas: [], head: 0, merged: new Map(), posts: [], postsHead: 0 },
+    };
+    shards.set(channel, shard);
+  }
+  return shard;
+}
+
+// Mirrors compiledMaskRules() in utils/maskSensitive.deluge: the config's
+// rules as one pre-check plus a replacement per rule, compiled once per
+// config object and version
+const compiledMasks = new WeakMap();
+
+function compiledMaskRules(config) {
+  const rules = config.mask_rules;
+  if (!rules || rules.length === 0) return null;
+  const cached = compiledMasks.get(config);
+  if (cached && cached.version === config.version) return cached;
+  const compiled = {
+    version: config.version,
+    trigger: new RegExp(rules.map(({ pattern }) => `(?:${pattern})`).join("|")),
+    rules: rules.map(({ label, pattern }) => ({ pattern: new RegExp(pattern, "g"), text: `[REDACTED_${label}]` })),
+  };
+  compiledMasks.set(config, compiled);
+  return compiled;
+}
+
+// Mirrors utils/maskSensitive.deluge: channel rules, then the trigger
+// pre-check, then the built-in patterns as the replaceAll() passes its
+// character scan is equivalent to
+function maskSensitive(log, config = defaultConfig) {
+  const compiled = compiledMaskRules(config);
+  if (compiled && compiled.trigger.test(log)) {
+    for (const { pattern, text } of compiled.rules) log = log.replace(pattern, text);
+  }
+
+  const hasAt = log.includes("@");
+  const hasSlash = log.includes("/");
+  const hasDigitDot = /\d\.\d/.test(log);
+  const lower = log.toLowerCase();
+  const hasToken = lower.includes("bearer") || lower.includes("token");
+
+  if (!hasAt && !hasSlash && !hasDigitDot && !hasToken) return log;
+
+  if (hasToken) log = log.replace(/(Bearer|Token)\s+[A-Za-z0-9\-\._]+/gi, "[REDACTED_TOKEN]");
+  if (!hasAt && !hasSlash && !hasDigitDot) return log;
 
-function maskSensitive(log) {
   return log
-    .replace(/(Bearer|Token)\s+[A-Za-z0-9\-\._]+/gi, "[REDACTED_TOKEN]")
-    .replace(/[A-Za-z0-9._%+-]+@[A-Za-z0-9.-]+\.[A-Za-z]{2,}/g, "[REDACTED_EMAIL]")
-    .replace(/\b(?:\d{1,3}\.){3}\d{1,3}\b/g, "[REDACTED_IP]")
-    .replace(/https?:\/\/[^\s]+/g, "[REDACTED_URL]")
-    .replace(/(\/[\w\-.]+)+/g, "[REDACTED_PATH]");
+    .split(" ")
+    .map((word) => {
+      if (word.includes("@")) word = word.replace(/[A-Za-z0-9._%+-]+@[A-Za-z0-9.-]+\.[A-Za-z]{2,}/g, "[REDACTED_EMAIL]");
+      if (word.includes(".")) word = word.replace(/\b(?:\d{1,3}\.){3}\d{1,3}\b/g, "[REDACTED_IP]");
+      if (word.includes("://")) word = word.replace(/https?:\/\/[^\s]+/g, "[REDACTED_URL]");
+      if (word.includes("/")) word = word.replace(/(\/[\w\-.]+)+/g, "[REDACTED_PATH]");
+      return word;
+    })
+    .join(" ");
+}
+
+// Map literal returned by a zero-argument Deluge function, e.g.
+// scoringRules() or defaultFilterConfig()
+function readDelugeLiteral(file, name) {
+  const source = fs.readFileSync(path.join(__dirname, "..", file), "utf-8");
+  const literal = source.match(new RegExp(`${name} = \\(\\) =>\\s*\\{\\s*return (\\{[\\s\\S]*?\\});\\s*\\};`))[1];
+  return JSON.parse(literal);
+}
+
+// The rule set is read straight from utils/scoringRules.deluge so the
+// harness and the Deluge services can never score differently
+function loadScoringRules() {
+  return readDelugeLiteral("utils/scoringRules.deluge", "scoringRules");
+}
+
+// Compile every level token and keyword into one Aho-Corasick automaton over
+// ASCII-lowercased text. Keywords match case-insensitively; level tokens are
+// case-sensitive and are verified against the original text on a hit.
+function compileScoringRules(rules) {
+  const patterns = [
+    ...rules.levels.map((level, order) => ({ text: level.token, level: true, order, weight: level.weight })),
+    ...rules.keywords.map((keyword) => ({ text: keyword.toLowerCase(), level: false })),
+  ];
+
+  const next = [new Map()];
+  const fail = [0];
+  const out = [[]];
+  patterns.forEach((pattern, index) => {
+    let node = 0;
+    for (const ch of pattern.text.toLowerCase()) {
+      if (!next[node].has(ch)) {
+        next[node].set(ch, next.length);
+        next.push(new Map());
+        fail.push(0);
+        out.push([]);
+      }
+      node = next[node].get(ch);
+    }
+    out[node].push(index);
+  });
+
+  const queue = [...next[0].values()];
+  while (queue.length > 0) {
+    const node = queue.shift();
+    for (const [ch, child] of next[node]) {
+      let f = fail[node];
+      while (f !== 0 && !next[f].has(ch)) f = fail[f];
+      fail[child] = next[f].has(ch) && next[f].get(ch) !== child ? next[f].get(ch) : 0;
+      out[child] = out[child].concat(out[fail[child]]);
+      queue.push(child);
+    }
+  }
+
+  // One pass per line: returns the first-listed level present (its weight
+  // and token) and whether any keyword occurred
+  function scan(line) {
+    let node = 0;
+    let best = null;
+    let keyword = false;
+    for (let i = 0; i < line.length; i++) {
+      const ch = line[i] >= "A" && line[i] <= "Z" ? line[i].toLowerCase() : line[i];
+      while (node !== 0 && !next[node].has(ch)) node = fail[node];
+      node = next[node].get(ch) || 0;
+      for (const index of out[node]) {
+        const pattern = patterns[index];
+        if (!pattern.level) keyword = true;
+        else if ((best === null || pattern.order < best.order) && line.startsWith(pattern.text, i - pattern.text.length + 1))
+          best = pattern;
+      }
+    }
+    return { weight: best ? best.weight : 0, level: best ? best.text : null, keyword };
+  }
+
+  return { rules, scan };
+}
+
+const scoring = compileScoringRules(loadScoringRules());
+
+// Channel defaults come from utils/filterConfig.deluge the same way
+const defaultConfig = readDelugeLiteral("utils/filterConfig.deluge", "defaultFilterConfig");
+
+// Mirrors utils/logTimestamp.deluge; now is the ingest time
+const timestampFormats = ["iso", "date", "epoch"];
+
+function parseTimestamp(value, format, now) {
+  if (format === "iso") {
+    if (!/^\d{4}-\d{2}-\d{2}T\d{2}:\d{2}:\d{2}(\.\d+)?(Z|[+-]\d{2}:?\d{2})?$/.test(value)) return null;
+    // Whole seconds, as toTime() does in the Deluge version
+    return new Date(value.replace(/\.\d+/, "")).getTime();
+  }
+  // No time of day: the ingest time
+  if (format === "date") return /^\d{4}-\d{2}-\d{2}$/.test(value) ? now : null;
+  if (format === "epoch") {
+    if (/^\d{13}$/.test(value)) return Number(value);
+    if (/^\d{10}$/.test(value)) return Number(value) * 1000;
+  }
+  return null;
+}
+
+// Parsed event time of the line, remembering the channel's format
+function extractTimestamp(message, channel = "local", now = Date.now()) {
+  const candidates = message.split(" ", 2);
+  const shard = channelShard(channel);
+  const hint = shard.timestampFormat;
+  const formats = hint ? [hint, ...timestampFormats.filter((f) => f !== hint)] : timestampFormats;
+  for (const format of formats) {
+    for (const word of candidates) {
+      const timestamp = parseTimestamp(word, format, now);
+      if (timestamp !== null) {
+        shard.timestampFormat = format;
+        return timestamp;
+      }
+    }
+  }
+  return null;
+}
+
+// Mirrors matchLine(), matchScore() and scoreMessage() in
+// utils/scoringRules.deluge
+function matchLine(log, config = defaultConfig) {
+  const { weight, level, keyword } = scoring.scan(log);
+  return { score: keyword ? weight + config.keyword_boost : weight, level, keyword };
 }
 
-function scoreLog(log) {
-  let score = 0;
-  if (log.includes("ERROR")) score += 3;
-  else if (log.includes("WARN")) score += 2;
-  else if (log.includes("INFO")) score += 1;
+function matchScore(log, config = defaultConfig) {
+  return matchLine(log, config).score;
+}
 
-  if (/exception|fail|timeout|crash/i.test(log)) score += 2;
+function scoreLog(log, ageMs, config = defaultConfig) {
+  let score = matchScore(log, config);
 
-  const ageMinutes = 0; // Simulate recent logs
-  if (ageMinutes < 5) score += 1;
+  if (ageMs < config.recency_window_ms) score += scoring.rules.recency_boost;
 
   return score;
 }
 
-function rateLimit() {
-  const now = Date.now();
-  if (now - rateLimiter.windowStart > 60000) {
-    rateLimiter.windowStart = now;
-    rateLimiter.count = 1;
+// Mirrors utils/sharedCounters.deluge for a sequential replay: each
+// runLine() is one invocation whose increments become one delta, folded
+// straight into its epoch's compacted delta, and the merged view is kept as
+// running totals. Epochs expire in the order they were written, so replays
+// must feed nondecreasing times. Rate-limit spends are kept apart, as
+// {time, n} records in time order (like the native engine's), so the
+// limiter can start its replay at the window instead of the horizon.
+const NO_SLOTS = new Map();
+const COUNTER_EPOCH_MS = 10000;
+
+function addSlot(view, name, slot, n) {
+  let slots = view.get(name);
+  if (!slots) view.set(name, (slots = new Map()));
+  const count = (slots.get(slot) || 0) + n;
+  if (count !== 0) slots.set(slot, count);
+  else if (slots.delete(slot) && slots.size === 0) view.delete(name);
+}
+
+function counterEpoch(time) {
+  return Math.floor(time / COUNTER_EPOCH_MS);
+}
+
+function counterExpired(epoch, now, horizon) {
+  return now - ((epoch + 1) * COUNTER_EPOCH_MS - 1) > horizon;
+}
+
+function openCounters(channel, now, horizon) {
+  const store = channelShard(channel).counters;
+  while (store.head < store.deltas.length && counterExpired(store.deltas[store.head].epoch, now, horizon)) {
+    for (const [name, slots] of store.deltas[store.head++].counts)
+      for (const [slot, n] of slots) addSlot(store.merged, name, slot, -n);
+  }
+  if (store.head > 64 && store.head * 2 > store.deltas.length) {
+    store.deltas = store.deltas.slice(store.head);
+    store.head = 0;
+  }
+  const { posts } = store;
+  while (store.postsHead < posts.length && counterExpired(counterEpoch(posts[store.postsHead].time), now, horizon))
+    store.postsHead++;
+  if (store.postsHead > 1024 && store.postsHead * 2 > posts.length) {
+    store.posts = posts.slice(store.postsHead);
+    store.postsHead = 0;
+  }
+  return { store, at: now, merged: store.merged, own: new Map() };
+}
+
+function addCount(counters, name, slot, n) {
+  addSlot(counters.merged, name, slot, n);
+  addSlot(counters.own, name, slot, n);
+}
+
+function countSlots(counters, name) {
+  return counters.merged.get(name) || NO_SLOTS;
+}
+
+function flushCounters(counters) {
+  if (counters.own.size === 0) return;
+  const { deltas, head } = counters.store;
+  const epoch = counterEpoch(counters.at);
+  const last = deltas.length > head ? deltas[deltas.length - 1] : null;
+  if (!last || last.epoch !== epoch) {
+    deltas.push({ epoch, counts: counters.own });
+    return;
+  }
+  for (const [name, slots] of counters.own) for (const [slot, n] of slots) addSlot(last.counts, name, slot, n);
+}
+
+// Mirrors utils/rateLimiter.deluge: per-channel token bucket replayed from
+// the shared post counts, plus a bounded overflow queue that drains as a
+// digest with the next post, or with the next unposted line once a token
+// is free
+const MAX_QUEUE = 50;
+
+function channelBucket(channel) {
+  const shard = channelShard(channel);
+  if (!shard.bucket) shard.bucket = { queue: [], dropped: 0 };
+  return shard.bucket;
+}
+
+function checkRateLimit(channel, config, now, counters) {
+  channelBucket(channel);
+  const rate = config.rate_limit;
+  const window = config.rate_window_ms;
+  const burst = config.rate_burst;
+  const { posts } = counters.store;
+
+  // Replay the window's posts, found by binary search
+  let lo = counters.store.postsHead;
+  let hi = posts.length;
+  while (lo < hi) {
+    const mid = (lo + hi) >>> 1;
+    if (posts[mid].time <= now - window) lo = mid + 1;
+    else hi = mid;
+  }
+  let tokens = burst;
+  let last = now - window;
+  for (let i = lo; i < posts.length; i++) {
+    tokens = Math.min(burst, tokens + ((posts[i].time - last) * rate) / window) - posts[i].n;
+    last = posts[i].time;
+  }
+  tokens = Math.min(burst, tokens + ((now - last) * rate) / window);
+  if (tokens < 1) return false;
+  const newest = posts[posts.length - 1];
+  if (posts.length > counters.store.postsHead && newest.time === now) newest.n++;
+  else posts.push({ time: now, n: 1 });
+  return true;
+}
+
+function queueOverflow(channel, result) {
+  const bucket = channelShard(channel).bucket;
+  if (bucket.queue.length < MAX_QUEUE) {
+    bucket.queue.push(result);
     return true;
-  } else {
-    if (rateLimiter.count >= 20) return false;
-    rateLimiter.count++;
+  }
+  let lowest = 0;
+  bucket.queue.forEach((queued, i) => {
+    if (queued.score < bucket.queue[lowest].score) lowest = i;
+  });
+  bucket.dropped++;
+  if (result.score > bucket.queue[lowest].score) {
+    bucket.queue[lowest] = result;
     return true;
   }
+  return false;
 }
 
-function logFilter(message) {
-  const now = Date.now();
+function drainOverflow(channel) {
+  const bucket = channelShard(channel).bucket;
+  const drained = [...bucket.queue].sort((a, b) => b.score - a.score);
+  bucket.queue = [];
+  return drained;
+}
 
-  // Frequency tracking first
-  const count = (freqMap.get(message) || 0) + 1;
-  freqMap.set(message, count);
+// Same 64-bit key as fingerprint() in services/logFilter.deluge
+function fingerprint(message) {
+  return crypto.createHash("md5").update(message).digest("hex").slice(0, 16);
+}
 
-  if (count >= 5) {
-    return { action: "highlight", reason: "anomaly", message };
+// Mirrors services/logTemplate.deluge; a template's level token is the
+// first token containing a scoring level
+const LEVEL_TOKENS = scoring.rules.levels.map((level) => level.token);
+
+function normalizeToken(word) {
+  if (!/\d/.test(word)) return word;
+  if (
+    /^\d{4}-\d{2}-\d{2}([T ]\d{2}:\d{2}(:\d{2}(\.\d+)?)?(Z|[+-]\d{2}:?\d{2})?)?$/.test(word) ||
+    /^\d{2}:\d{2}:\d{2}(\.\d+)?$/.test(word)
+  )
+    return "<TS>";
+  return word
+    .replace(/[0-9a-fA-F]{8}-[0-9a-fA-F]{4}-[0-9a-fA-F]{4}-[0-9a-fA-F]{4}-[0-9a-fA-F]{12}/g, "<UUID>")
+    .replace(/\b(0x[0-9a-fA-F]+|[0-9a-fA-F]{6,})\b/g, "<HEX>")
+    .replace(/\d+(\.\d+)?/g, "<NUM>");
+}
+
+function templateOf(message, channel = "local") {
+  const { templateGroups, templateCache } = channelShard(channel);
+  const tokens = message.split(" ").map(normalizeToken);
+  const shape = tokens.join(" ");
+
+  const cached = templateCache.get(shape);
+  if (cached) return cached;
+
+  const levelIndex = tokens.findIndex((token) => LEVEL_TOKENS.some((level) => token.includes(level)));
+  const level = levelIndex < 0 ? "" : tokens[levelIndex];
+  const leading = tokens[0].startsWith("<") ? "<*>" : tokens[0];
+  const groupKey = `${tokens.length}:${leading}:${level}`;
+  if (!templateGroups.has(groupKey)) templateGroups.set(groupKey, []);
+  const group = templateGroups.get(groupKey);
+
+  let match = group.find((candidate) => {
+    if (levelIndex >= 0 && candidate.tokens[levelIndex] !== level) return false;
+    const same = tokens.filter((token, i) => candidate.tokens[i] === token).length;
+    return same >= 0.7 * tokens.length;
+  });
+
+  if (!match) {
+    match = { id: fingerprint(shape), tokens };
+    group.push(match);
+    if (group.length > 20) group.shift();
+  } else {
+    match.tokens = match.tokens.map((token, i) => (token === tokens[i] ? token : "<*>"));
   }
 
-  // Deduplication second
-  if (dedupMap.has(message)) {
-    const lastSeen = dedupMap.get(message);
-    if (now - lastSeen < 60000) {
-      return { action: "suppress", reason: "duplicate", message };
+  if (templateCache.size >= 5000) templateCache.clear();
+  templateCache.set(shape, match.id);
+  return match.id;
+}
+
+// Mirrors services/logFilter.deluge: one bounded entryMap per channel keyed
+// by template id, dedup on event time, then a ring-buffer sliding window
+const ANOMALY_WINDOW = 300000;
+const BUCKET_COUNT = 10;
+const ENTRY_TTL = 300000;
+const SWEEP_INTERVAL = 60000;
+const MAX_ENTRIES = 5000;
+
+function sweepExpired(shard, now, ttl) {
+  const { entryMap, filterMetrics } = shard;
+  for (const [key, entry] of entryMap) {
+    if (now - entry.lastAccess > ttl) {
+      entryMap.delete(key);
+      filterMetrics.evictedExpired++;
     }
   }
-  dedupMap.set(message, now);
+  filterMetrics.lastSweep = now;
+}
 
-  // Default pass
-  return { action: "pass", reason: "new", message };
+function evictLru(shard) {
+  const { entryMap, filterMetrics } = shard;
+  const overflow = entryMap.size - Math.trunc(MAX_ENTRIES * 0.9);
+  const cutoff = [...entryMap.values()].map((entry) => entry.lastAccess).sort((a, b) => a - b)[overflow - 1];
+  let evicted = 0;
+  for (const [key, entry] of entryMap) {
+    if (evicted < overflow && entry.lastAccess <= cutoff) {
+      entryMap.delete(key);
+      evicted++;
+    }
+  }
+  filterMetrics.evictedLru += evicted;
 }
 
-// Run test
-const logs = fs.readFileSync("test/sampleLogs.txt", "utf-8").split("\n");
+function recordOccurrence(counters, key, time) {
+  let epoch = Math.trunc(time / (ANOMALY_WINDOW / BUCKET_COUNT));
+  for (const slot of countSlots(counters, key).keys()) if (slot > epoch) epoch = slot;
+  addCount(counters, key, epoch, 1);
+  let windowCount = 0;
+  for (const [slot, n] of countSlots(counters, key)) if (slot > epoch - BUCKET_COUNT) windowCount += n;
+  return windowCount;
+}
 
-logs.forEach((log) => {
-  const masked = maskSensitive(log);
-  const score = scoreLog(masked); // always calculate score
+// Approximate mode (approximate: true), as filterSketched() in
+// services/logFilter.deluge: time-sliced Bloom dedup, a Count-Min sketch
+// over the shared counters, and a Space-Saving heavy-hitter table
+const DEDUP_SLICES = 4;
 
-  const displayMessage = masked.length > 0 ? masked : "[EMPTY LOG AFTER MASKING]";
+function sketchHashes(key) {
+  return [parseInt(key.slice(0, 8), 16), parseInt(key.slice(8, 16), 16)];
+}
 
-  if (!rateLimit()) {
-    console.log(`[RATE LIMITED] | Score: ${score} | ${displayMessage}`);
-    return;
+function filterSketch(shard, config) {
+  const sliceMs = Math.max(1, Math.trunc(config.dedup_window_ms / DEDUP_SLICES));
+  let sketch = shard.filterSketch;
+  if (
+    !sketch ||
+    sketch.sliceMs !== sliceMs ||
+    sketch.bits !== config.dedup_bits ||
+    sketch.hashes !== config.dedup_hashes ||
+    sketch.topK !== config.top_k
+  ) {
+    sketch = { sliceMs, bits: config.dedup_bits, hashes: config.dedup_hashes, topK: config.top_k, newest: null, slices: new Map(), heavy: new Map() };
+    shard.filterSketch = sketch;
+  }
+  return sketch;
+}
+
+function recordSketchOccurrence(counters, [h1, h2], time, config) {
+  const prefix = `cm:${config.sketch_depth}x${config.sketch_width}:`;
+  let epoch = Math.trunc(time / (ANOMALY_WINDOW / BUCKET_COUNT));
+  for (const slot of countSlots(counters, `${prefix}all`).keys()) if (slot > epoch) epoch = slot;
+  addCount(counters, `${prefix}all`, epoch, 1);
+  let estimate = null;
+  for (let row = 0; row < config.sketch_depth; row++) {
+    const name = `${prefix}${row}:${(h1 + row * h2) % config.sketch_width}`;
+    addCount(counters, name, epoch, 1);
+    let rowCount = 0;
+    for (const [slot, n] of countSlots(counters, name)) if (slot > epoch - BUCKET_COUNT) rowCount += n;
+    if (estimate === null || rowCount < estimate) estimate = rowCount;
+  }
+  return estimate;
+}
+
+function trackHeavyHitter(heavy, key, topK) {
+  let hitter = heavy.get(key);
+  if (!hitter) {
+    let error = 0;
+    if (heavy.size >= topK) {
+      let minKey = null;
+      for (const [candidate, { count }] of heavy) if (minKey === null || count < heavy.get(minKey).count) minKey = candidate;
+      error = heavy.get(minKey).count;
+      heavy.delete(minKey);
+    }
+    hitter = { count: error, error };
+    heavy.set(key, hitter);
+  }
+  hitter.count++;
+  return hitter.count - hitter.error;
+}
+
+function filterSketched(message, key, eventTime, now, shard, counters, config, clock) {
+  const sketch = filterSketch(shard, config);
+  const hashes = sketchHashes(key);
+
+  let slice = Math.trunc(eventTime / sketch.sliceMs);
+  if (sketch.newest !== null && sketch.newest > slice) slice = sketch.newest;
+  if (sketch.newest === null || slice > sketch.newest) {
+    for (const old of sketch.slices.keys()) if (old <= slice - DEDUP_SLICES) sketch.slices.delete(old);
+    sketch.newest = slice;
+  }
+  const bits = [];
+  for (let i = 0; i < sketch.hashes; i++) bits.push((hashes[0] + i * hashes[1]) % sketch.bits);
+  let duplicate = false;
+  for (const seen of sketch.slices.values()) if ((duplicate = bits.every((bit) => seen.has(bit)))) break;
+
+  const windowCount = recordSketchOccurrence(counters, hashes, eventTime, config);
+  const guaranteed = trackHeavyHitter(sketch.heavy, key, sketch.topK);
+  if (clock) clock.lap("filter");
+
+  const score = scoreLog(message, now - eventTime, config);
+  if (clock) clock.lap("score");
+  if (duplicate) return { action: "suppress", reason: "duplicate", message, score, timestamp: eventTime, template: key };
+
+  if (!sketch.slices.has(slice)) sketch.slices.set(slice, new Set());
+  const seen = sketch.slices.get(slice);
+  for (const bit of bits) seen.add(bit);
+
+  const threshold = config.anomaly_threshold;
+  const action = windowCount >= threshold && guaranteed >= threshold ? "highlight" : "pass";
+  return { action, reason: action === "highlight" ? "anomaly" : "new", message, score, timestamp: eventTime, template: key };
+}
+
+function newEntry(time) {
+  return { lastSeen: time, lastAccess: time, score: 0 };
+}
+
+function counterHorizon(config) {
+  const horizon = Math.max(ENTRY_TTL, config.rate_window_ms);
+  return config.digest_mode ? Math.max(horizon, 2 * config.digest_interval_ms) : horizon;
+}
+
+// now is the ingest time; options.clock gets "timestamp", "filter" and
+// "score" laps. Without options.counters the call is its own invocation and
+// publishes its counts itself, like filterLog().
+function logFilter(message, channel = "local", now = Date.now(), options = {}) {
+  const { config = defaultConfig, clock = null } = options;
+  if (!options.counters) {
+    const counters = openCounters(channel, now, counterHorizon(config));
+    const result = logFilter(message, channel, now, { ...options, counters });
+    flushCounters(counters);
+    return result;
+  }
+  const { counters } = options;
+  const ttl = Math.max(ENTRY_TTL, config.dedup_window_ms);
+  const shard = channelShard(channel);
+  if (shard.filterMetrics === null) shard.filterMetrics = { lastSweep: now, evictedExpired: 0, evictedLru: 0 };
+  const { entryMap, filterMetrics } = shard;
+  if (now - filterMetrics.lastSweep > SWEEP_INTERVAL) sweepExpired(shard, now, ttl);
+
+  const parsed = extractTimestamp(message, channel, now);
+  const eventTime = parsed === null ? now : Math.min(parsed, now);
+  if (clock) clock.lap("timestamp");
+
+  const key = templateOf(message, channel);
+  if (config.approximate) return filterSketched(message, key, eventTime, now, shard, counters, config, clock);
+  let entry = entryMap.get(key);
+  if (entry && now - entry.lastAccess > ttl) {
+    entryMap.delete(key);
+    filterMetrics.evictedExpired++;
+    entry = undefined;
+  }
+
+  // Dedup first; the sighting still counts towards frequency
+  if (entry && eventTime - entry.lastSeen < config.dedup_window_ms) {
+    recordOccurrence(counters, key, eventTime);
+    entry.lastAccess = now;
+    if (clock) clock.lap("filter");
+    return { action: "suppress", reason: "duplicate", message, score: entry.score, timestamp: eventTime, template: key };
+  }
+
+  if (!entry) {
+    entry = newEntry(eventTime);
+    entry.lastAccess = now;
+    entryMap.set(key, entry);
+    if (entryMap.size > MAX_ENTRIES) {
+      evictLru(shard);
+      entryMap.set(key, entry);
+    }
+  } else {
+    entry.lastSeen = eventTime;
+    entry.lastAccess = now;
+  }
+  const windowCount = recordOccurrence(counters, key, eventTime);
+  if (clock) clock.lap("filter");
+
+  const score = scoreLog(message, now - eventTime, config);
+  entry.score = score;
+  if (clock) clock.lap("score");
+
+  const action = windowCount >= config.anomaly_threshold ? "highlight" : "pass";
+  return { action, reason: action === "highlight" ? "anomaly" : "new", message, score, timestamp: eventTime, template: key };
+}
+
+// Mirrors utils/postDigest.deluge and the formatting in
+// services/logPipeline.deluge: passing lines and duplicates counted per
+// template and ingest second in the shared counters until the digest is
+// due, then rendered as one post
+const DIGEST_MAX_TEMPLATES = 200;
+const DIGEST_SHOWN_TEMPLATES = 20;
+const DIGEST_SETTLE_MS = 2000;
+
+function openDigest(channel) {
+  const shard = channelShard(channel);
+  if (!shard.postDigest) shard.postDigest = { from: 0, messages: new Map() };
+  return shard.postDigest;
+}
+
+function bufferDigest(digest, counters, result, now) {
+  const second = Math.trunc(now / 1000);
+  addCount(counters, "digest:lines", second, 1);
+  if (result.action !== "suppress") addCount(counters, "digest:passed", second, 1);
+  if (!digest.messages.has(result.template)) {
+    if (digest.messages.size >= DIGEST_MAX_TEMPLATES) return;
+    digest.messages.set(result.template, result.message);
+  }
+  addCount(counters, `digest:t:${result.template}`, second, 1);
+}
+
+function digestCount(counters, name, from, until) {
+  let total = 0;
+  for (const [second, n] of countSlots(counters, name)) if (second >= from && second < until) total += n;
+  return total;
+}
+
+function digestRange(digest, counters, now) {
+  const { from } = digest;
+  const until = Math.trunc((now - DIGEST_SETTLE_MS) / 1000);
+  let opened = null;
+  for (const second of countSlots(counters, "digest:lines").keys())
+    if (second >= from && second < until && (opened === null || second < opened)) opened = second;
+  return {
+    from,
+    until,
+    opened,
+    lines: digestCount(counters, "digest:lines", from, until),
+    passed: digestCount(counters, "digest:passed", from, until),
+  };
+}
+
+function digestDue(digest, counters, config, now) {
+  const range = digestRange(digest, counters, now);
+  if (range.lines === 0) return false;
+  return now - range.opened * 1000 >= config.digest_interval_ms || range.passed >= config.digest_size;
+}
+
+function takeDigest(digest, counters, now) {
+  const { from, until, opened, lines, passed } = digestRange(digest, counters, now);
+  let summary = `🧾 Digest of ${lines} logs over ${Math.trunc((now - opened * 1000) / 1000)}s: ${passed} passed, ${lines - passed} duplicates`;
+  const kept = new Map();
+  const entries = [];
+  let rest = lines;
+  for (const [template, message] of digest.messages) {
+    const name = `digest:t:${template}`;
+    const count = digestCount(counters, name, from, until);
+    if (count > 0) {
+      entries.push({ message, count });
+      rest -= count;
+    }
+    for (const second of countSlots(counters, name).keys()) if (second >= until) kept.set(template, message);
   }
+  let restTemplates = 0;
+  entries
+    .sort((a, b) => b.count - a.count)
+    .forEach((entry, i) => {
+      if (i < DIGEST_SHOWN_TEMPLATES) summary += `\n×${entry.count} ${entry.message}`;
+      else {
+        rest += entry.count;
+        restTemplates++;
+      }
+    });
+  if (rest > 0) summary += `\n… and ${rest} more logs${restTemplates > 0 ? ` (${restTemplates} more templates)` : ""}`;
+  digest.from = until;
+  digest.messages = kept;
+  return summary;
+}
+
+// Mirrors utils/adaptiveSampler.deluge: low-score lines kept at the
+// sampler's rate while it is active (always, with sample_mode "on"), and
+// exempt levels and keyword lines always
+const SAMPLER_SMOOTHING = 0.2;
+const SAMPLER_EXIT_RATIO = 0.5;
+const SAMPLER_EXEMPT_LEVELS = ["ERROR", "WARN"];
+
+function openSampler(channel) {
+  const shard = channelShard(channel);
+  if (!shard.sampler) shard.sampler = { ewma: 0, active: false, rate: 1, credit: 0, sampled: 0 };
+  return shard.sampler;
+}
 
-  const result = logFilter(masked);
-  console.log(`[${result.action.toUpperCase()}] ${result.reason} | Score: ${score} | ${displayMessage}`);
-});
+function samplerKeeps(sampler, match, config) {
+  if (config.sample_mode === "on") sampler.rate = config.sample_min_rate;
+  else if (!sampler.active) return true;
+  if (match.keyword || SAMPLER_EXEMPT_LEVELS.includes(match.level)) return true;
+  if (match.score >= config.sample_min_score) return true;
+
+  const credit = sampler.credit + sampler.rate;
+  if (credit >= 1) {
+    sampler.credit = credit - 1;
+    return true;
+  }
+  sampler.credit = credit;
+  sampler.sampled++;
+  return false;
+}
+
+function recordLineLatency(sampler, elapsedMs, config) {
+  sampler.ewma += SAMPLER_SMOOTHING * (elapsedMs - sampler.ewma);
+  if (config.sample_mode !== "auto") return;
+
+  const threshold = config.sample_latency_ms;
+  if (!sampler.active && sampler.ewma > threshold) {
+    sampler.active = true;
+    sampler.credit = 0;
+  } else if (sampler.active && sampler.ewma < threshold * SAMPLER_EXIT_RATIO) {
+    sampler.active = false;
+  }
+  if (sampler.active) sampler.rate = Math.max(config.sample_min_rate, Math.min(1, (threshold * SAMPLER_EXIT_RATIO) / sampler.ewma));
+}
+
+function takeSampling(channel, config) {
+  if (config.sample_mode === "off") return null;
+  const sampler = openSampler(channel);
+  if (sampler.sampled === 0) return null;
+  const report = { sampled: sampler.sampled, rate: sampler.rate };
+  sampler.sampled = 0;
+  return report;
+}
+
+function formatSampling({ sampled, rate }) {
+  return `🎯 ${sampled} low-score logs sampled out under load (keeping ${Number((rate * 100).toFixed(0))}%)`;
+}
+
+function formatResultLine(result) {
+  return result.action === "highlight" ? `[ANOMALY] ${result.message}` : result.message;
+}
+
+function formatOverflowDigest(queued) {
+  return [`⏳ ${queued.length} logs held back by rate limiting:`, ...queued.map(formatResultLine)].join("\n");
+}
+
+// One line through the whole harness pipeline, in the order of
+// runPipeline() in services/logPipeline.deluge: mask, filter, then the
+// channel's token bucket for lines that would be posted.
+// options.clock gets a lap() after every stage (used by test/benchmark.js),
+// options.now replaces the wall clock for replays, options.channel and
+// options.config select the channel, and options.enforceRateLimit = false
+// still charges the limiter but lets denied lines through unqueued.
+// With config.digest_mode, passing lines and duplicates come back buffered
+// and the line that makes the digest due carries it as summary. A line that
+// is not posted carries the overflow queue as digest once a token is free. With
+// config.sample_mode, the sampler sees each line's mask + filter time in
+// wall-clock ms, and the next posting result carries its report.
+function runLine(log, options = {}) {
+  const { clock = null, now = Date.now(), channel = "local", config = defaultConfig, enforceRateLimit = true } = options;
+  const counters = openCounters(channel, now, counterHorizon(config));
+  const sampler = config.sample_mode === "off" ? null : openSampler(channel);
+  const started = sampler ? performance.now() : 0;
+
+  const masked = maskSensitive(log, config);
+  if (clock) clock.lap("mask");
+
+  const match = sampler ? matchLine(masked, config) : null;
+  let result;
+  if (sampler && !samplerKeeps(sampler, match, config)) {
+    result = { action: "suppress", reason: "sampled", message: masked, score: match.score, timestamp: now };
+  } else {
+    result = logFilter(masked, channel, now, { config, clock, counters });
+    if (sampler) recordLineLatency(sampler, performance.now() - started, config);
+  }
+  const digest = config.digest_mode ? openDigest(channel) : null;
+  let rateChecked = false;
+  if (digest && (result.reason === "new" || result.reason === "duplicate")) {
+    bufferDigest(digest, counters, result, now);
+    result = { ...result, buffered: true };
+  } else if (result.action !== "suppress") {
+    rateChecked = true;
+    const allowed = checkRateLimit(channel, config, now, counters);
+    if (clock) clock.lap("rate_limit");
+    if (allowed) {
+      result = { ...result, digest: drainOverflow(channel) };
+      const sampling = takeSampling(channel, config);
+      if (sampling) result.sampling = sampling;
+    }
+    else if (!enforceRateLimit) result = { ...result, digest: [], rateLimited: true };
+    else {
+      const queued = queueOverflow(channel, result);
+      result = { action: "suppress", reason: "rate_limited", message: masked, score: result.score, queued, rateLimited: true };
+    }
+  }
+  if (digest && digestDue(digest, counters, config, now)) {
+    rateChecked = true;
+    if (checkRateLimit(channel, config, now, counters)) {
+      const overflow = drainOverflow(channel);
+      let summary = takeDigest(digest, counters, now);
+      if (overflow.length > 0) summary += `\n\n${formatOverflowDigest(overflow)}`;
+      const sampling = takeSampling(channel, config);
+      if (sampling) summary += `\n${formatSampling(sampling)}`;
+      result = { ...result, summary };
+    }
+  }
+  // Not posted itself, the line still lets the queue out once the bucket has refilled
+  if (!rateChecked && channelBucket(channel).queue.length > 0 && checkRateLimit(channel, config, now, counters))
+    result = { ...result, digest: drainOverflow(channel) };
+
+  flushCounters(counters);
+  return result;
+}
+
+function resetState() {
+  shards.clear();
+}
+
+// Every shard in one file, for the CLI's --state: v8's structured-clone
+// encoding (Maps and shared objects included) after a versioned magic,
+// written to a temporary file and renamed over the old one. The native
+// engine has the incremental, lazily decoded format (Engine::saveSnapshot()).
+const STATE_MAGIC = Buffer.from("NFSTATE1");
+
+function saveState(file) {
+  fs.writeFileSync(`${file}.tmp`, Buffer.concat([STATE_MAGIC, v8.serialize(shards)]));
+  fs.renameSync(`${file}.tmp`, file);
+}
+
+function loadState(file) {
+  const bytes = fs.readFileSync(file);
+  if (!bytes.subarray(0, STATE_MAGIC.length).equals(STATE_MAGIC)) throw new Error(`not a harness state file: ${file}`);
+  shards = v8.deserialize(bytes.subarray(STATE_MAGIC.length));
+}
+
+function stateSizes() {
+  const sizes = { shards: shards.size, entryMap: 0, templateCache: 0, templates: 0, queued: 0, counterDeltas: 0, sketches: 0 };
+  for (const shard of shards.values()) {
+    if (shard.filterSketch) sizes.sketches++;
+    sizes.counterDeltas += shard.counters.deltas.length - shard.counters.head;
+    sizes.entryMap += shard.entryMap.size;
+    sizes.templateCache += shard.templateCache.size;
+    for (const group of shard.templateGroups.values()) sizes.templates += group.length;
+    if (shard.bucket) sizes.queued += shard.bucket.queue.length;
+  }
+  return sizes;
+}
+
+module.exports = {
+  maskSensitive,
+  matchLine,
+  matchScore,
+  scoreLog,
+  extractTimestamp,
+  templateOf,
+  logFilter,
+  checkRateLimit,
+  queueOverflow,
+  drainOverflow,
+  openSampler,
+  samplerKeeps,
+  recordLineLatency,
+  runLine,
+  defaultConfig,
+  scoringRules: scoring.rules,
+  resetState,
+  saveState,
+  loadState,
+  stateSizes,
+};
+
+// Run test
+//   node test/runLocalTest.js [logs.txt] [--config settings.json] [--interval-ms N] [--summary]
+//                             [--state state.bin]
+// Streams the file (test/sampleLogs.txt by default) through runLine(), so a
+// whole archive can be replayed against new settings (--config, merged over
+// defaultConfig). --interval-ms spaces the lines' ingest times from now
+// instead of using the wall clock; --summary prints only the counts.
+// --state starts from the state a previous run saved there, and saves it.
+if (require.main === module) {
+  const { readLines } = require("./lineReader");
+  const args = { file: "test/sampleLogs.txt", config: defaultConfig, intervalMs: null, summary: false, state: null };
+  for (let i = 2; i < process.argv.length; i++) {
+    const flag = process.argv[i];
+    if (flag === "--config") args.config = { ...defaultConfig, ...JSON.parse(fs.readFileSync(process.argv[++i], "utf-8")) };
+    else if (flag === "--interval-ms") args.intervalMs = Number(process.argv[++i]);
+    else if (flag === "--summary") args.summary = true;
+    else if (flag === "--state") args.state = process.argv[++i];
+    else args.file = flag;
+  }
+  if (args.state && fs.existsSync(args.state)) loadState(args.state);
+
+  const start = Date.now();
+  const counts = {};
+  let lines = 0;
+  for (const log of readLines(args.file)) {
+    const now = args.intervalMs === null ? Date.now() : start + lines * args.intervalMs;
+    const result = runLine(log, { now, config: args.config });
+    lines++;
+    counts[result.reason] = (counts[result.reason] || 0) + 1;
+    if (args.summary) continue;
+
+    const displayMessage = result.message.length > 0 ? result.message : "[EMPTY LOG AFTER MASKING]";
+    console.log(`[${result.action.toUpperCase()}] ${result.reason} | Score: ${result.score} | ${displayMessage}`);
+    if (result.digest && result.digest.length > 0) console.log(`  + digest of ${result.digest.length} held-back logs`);
+    if (result.sampling) console.log(`  + ${formatSampling(result.sampling)}`);
+    if (result.summary) console.log(result.summary.replace(/^/gm, "  | "));
+  }
+  if (args.state) saveState(args.state);
+  if (args.summary) {
+    console.log(`${lines} lines: ${Object.entries(counts).map(([reason, n]) => `${reason}=${n}`).join(", ")}`);
+    console.log(`Peak rss ${(process.resourceUsage().maxRSS / 1024).toFixed(1)} MB; ${Object.entries(stateSizes()).map(([name, size]) => `${name}=${size}`).join(", ")}`);
+  }
+}
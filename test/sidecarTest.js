@@ -0,0 +1,393 @@
+// End-to-end test for the native sidecar (native/sidecar)
+//
+// Usage:
+//   node test/sidecarTest.js --sidecar native/_build/neurafilter-sidecar
+//
+// Starts the sidecar on a free port and replays the same webhook payloads,
+// on the same virtual clock, through two copies of the Deluge extension:
+// one filtering in handleWebhook() as usual, one with sidecarUrl set so
+// invokeurl forwards each payload to the sidecar. The posted summaries and
+// the handler's responses must be identical, and so must a payload streamed
+// in chunks under a continuation token. /filter and /ingest + /outbox
+// are checked against the harness's runLine() as well, and floods into a
+// small ring under each overflow policy must account for every line,
+// /filter must carry on across a restart from a snapshot, and chunked
+// bodies and connections past the cap must be refused. Exits non-zero on
+// any difference.
+
+process.env.TZ = "UTC";
+
+const fs = require("fs");
+const net = require("net");
+const os = require("os");
+const path = require("path");
+const { spawn, execFileSync } = require("child_process");
+const { loadExtension, toPlain, fromPlain } = require("./delugeRunner");
+const harness = require("./runLocalTest");
+const { mulberry32, messagePhrase } = require("./benchmark");
+
+const START = Date.UTC(2025, 10, 16, 9, 0, 0);
+const LEVELS = ["ERROR", "WARN", "INFO", "DEBUG"];
+
+// invokeurl is synchronous, so requests go through a short-lived node process
+const POST_SCRIPT =
+  'let d="";process.stdin.on("data",(c)=>(d+=c)).on("end",async()=>{' +
+  'const r=await fetch(process.argv[1],{method:"POST",headers:{"Content-Type":"application/json"},body:d});' +
+  "process.stdout.write(await r.text());});";
+
+function postSync(url, body) {
+  return JSON.parse(execFileSync(process.execPath, ["-e", POST_SCRIPT, url], { input: body }).toString());
+}
+
+function startSidecar(binary, extraArgs = []) {
+  const args = ["--port", "0", "--rules", "utils/scoringRules.deluge", ...extraArgs];
+  const child = spawn(binary, args, { stdio: ["ignore", "pipe", "inherit"] });
+  return new Promise((resolve, reject) => {
+    let output = "";
+    child.stdout.on("data", (chunk) => {
+      output += chunk;
+      const match = output.match(/listening on (\d+)/);
+      if (match) resolve({ child, url: `http://127.0.0.1:${match[1]}` });
+    });
+    child.on("exit", (code) => reject(new Error(`sidecar exited with ${code}`)));
+  });
+}
+
+// Structured logs with repeats, sensitive tokens and event times; phrases
+// are drawn from [base, base + 40)
+function payloadLogs(random, count, now, base = 0) {
+  const logs = [];
+  for (let i = 0; i < count; i++) {
+    const k = base + Math.floor(random() * 40);
+    let message = `${messagePhrase(k)} request ${Math.floor(random() * 5)}`;
+    if (random() < 0.2) message += ` from user${k}@example.com at 10.0.${k}.7`;
+    const log = { level: LEVELS[k % LEVELS.length], message };
+    if (random() < 0.7) log.timestamp = new Date(now - Math.floor(random() * 120000)).toISOString();
+    logs.push(log);
+  }
+  return logs;
+}
+
+function payloads() {
+  const random = mulberry32(5);
+  const list = [];
+  for (let i = 0; i < 26; i++) {
+    // Payloads 8-23 arrive together on one channel, so the later ones are
+    // rate limited and queued; the last two drain the digest
+    const burst = i >= 8;
+    const now = START + (i < 8 ? i : i < 24 ? 8 : 14) * 20000;
+    const logs = payloadLogs(random, 50 + Math.floor(random() * 400), now, burst ? i * 40 : 0);
+    const body = { channel_id: burst ? "c" : ["a", "b"][i % 2] };
+    if (i % 4 === 1) body.ndjson = `${logs.map((log) => JSON.stringify(log)).join("\n")}\n\n`;
+    else body.logs = logs;
+    if (i % 5 === 2) body.top_k = 3;
+    if (i === 7) body.offset = 20;
+    list.push({ body, now });
+  }
+  return list;
+}
+
+function runWebhooks(runtime, cases) {
+  return cases.map(({ body, now }) => {
+    runtime.now = now;
+    const posts = [];
+    const context = new Map([
+      ["request_body", fromPlain(body)],
+      ["sendMessage", (message) => posts.push(message)],
+    ]);
+    return { response: toPlain(runtime.call("handleWebhook", context)), posts };
+  });
+}
+
+// One large payload streamed through handleWebhook() in small chunks, by
+// re-sending the body with next_offset (NDJSON) and by sending only the
+// remainder (logs), must post what the whole payload posts in one call;
+// a token the channel does not know is refused
+function checkStreaming() {
+  const random = mulberry32(13);
+  const logs = payloadLogs(random, 700, START);
+  const ndjson = `${logs.map((log) => JSON.stringify(log)).join("\n")}\n\n`;
+  const resend = (offset) => ({ channel_id: "s", ndjson, offset });
+  const remainder = (offset) => ({ channel_id: "s", logs: logs.slice(offset) });
+  const whole = runWebhooks(loadExtension(), [{ body: { channel_id: "s", logs }, now: START }])[0];
+
+  const failures = [];
+  for (const [name, next] of [["ndjson re-sent", resend], ["logs remainder", remainder]]) {
+    const runtime = loadExtension();
+    runtime.global.vars.set("webhookChunkSize", 64);
+    runtime.global.vars.set("ndjsonWindow", 4096);
+    let body = next(0);
+    let offset = 0;
+    let calls = 0;
+    let result;
+    for (; calls < 100; calls++) {
+      result = runWebhooks(runtime, [{ body, now: START }])[0];
+      if (result.response.status !== "partial") break;
+      offset += result.response.next_offset - (body.offset || 0);
+      body = { ...next(offset), continuation: result.response.continuation };
+      if (body.ndjson) body.offset = offset;
+    }
+    if (JSON.stringify(result) !== JSON.stringify(whole)) failures.push(`  ${name} after ${calls + 1} calls:\n    streamed: ${JSON.stringify(result)}\n    whole:    ${JSON.stringify(whole)}`);
+  }
+  const unknown = runWebhooks(loadExtension(), [{ body: { ...resend(64), continuation: "0123456789abcdef" }, now: START }])[0];
+  if (unknown.response.status !== "error" || unknown.posts.length > 0) failures.push(`  unknown continuation: ${JSON.stringify(unknown)}`);
+
+  console.log(`${failures.length === 0 ? "ok  " : "FAIL"} /webhook streaming: ${logs.length} logs in chunks of 64`);
+  if (failures.length > 0) console.log(failures.join("\n"));
+  return failures.length;
+}
+
+function project(result) {
+  const record = { action: result.action, reason: result.reason, message: result.message, score: result.score };
+  if (result.timestamp !== undefined) record.timestamp = result.timestamp;
+  if (result.queued !== undefined) record.queued = result.queued;
+  if (result.digest !== undefined) record.digest = result.digest.map((queued) => queued.message);
+  return record;
+}
+
+function checkFilter(url) {
+  const random = mulberry32(9);
+  const logs = payloadLogs(random, 300, START);
+  const lines = logs.map((log) => [log.level, log.timestamp, log.message].filter(Boolean).join(" "));
+  const { results } = postSync(`${url}/filter`, JSON.stringify({ channel_id: "f", lines, now: START, pipeline: true }));
+  harness.resetState();
+  let diffs = 0;
+  lines.forEach((line, i) => {
+    const expected = JSON.stringify(project(harness.runLine(line, { now: START, channel: "f" })));
+    const actual = JSON.stringify(project(results[i]));
+    if (expected !== actual && diffs++ < 5) console.log(`  line ${i + 1}: ${line}\n    harness: ${expected}\n    sidecar: ${actual}`);
+  });
+  console.log(`${diffs === 0 ? "ok  " : "FAIL"} /filter: ${lines.length} lines`);
+  return diffs;
+}
+
+// Sends raw bytes on a fresh connection; resolves with everything read
+// until the server closes it (or with what came within waitMs)
+function rawExchange(url, request, waitMs = 2000) {
+  const { hostname, port } = new URL(url);
+  return new Promise((resolve, reject) => {
+    const socket = net.connect(Number(port), hostname, () => socket.write(request));
+    let data = "";
+    const timer = setTimeout(() => socket.destroy(), waitMs);
+    socket.on("data", (chunk) => (data += chunk));
+    socket.on("close", () => {
+      clearTimeout(timer);
+      resolve(data);
+    });
+    socket.on("error", reject);
+  });
+}
+
+// Chunked bodies get a JSON 501 and a closed connection; connections past
+// the cap get a 503 while the held ones stay open, and are served once
+// those close
+async function checkProtocol(url) {
+  const failures = [];
+  const { port } = new URL(url);
+  const chunked = await rawExchange(
+    url,
+    "POST /filter HTTP/1.1\r\nHost: x\r\nTransfer-Encoding: chunked\r\n\r\n5\r\n{\"a\":\r\n0\r\n\r\n"
+  );
+  const [head, body] = chunked.split("\r\n\r\n");
+  if (!/^HTTP\/1\.1 501 /.test(head) || !/Connection: close/.test(head)) failures.push(`  chunked: ${head}`);
+  try {
+    if (typeof JSON.parse(body).error !== "string") failures.push(`  chunked body: ${body}`);
+  } catch (error) {
+    failures.push(`  chunked body is not JSON: ${body}`);
+  }
+
+  const held = [];
+  for (let i = 0; i < 256; i++) {
+    held.push(await new Promise((resolve) => {
+      const socket = net.connect(Number(port), "127.0.0.1", () => resolve(socket));
+    }));
+  }
+  const refused = await rawExchange(url, "POST /stats HTTP/1.1\r\nHost: x\r\nContent-Length: 2\r\n\r\n{}");
+  if (!/^HTTP\/1\.1 503 /.test(refused)) failures.push(`  connection past the cap: ${refused.split("\r\n")[0]}`);
+  held.forEach((socket) => socket.destroy());
+  await new Promise((resolve) => setTimeout(resolve, 200));
+  const served = await rawExchange(url, "POST /stats HTTP/1.1\r\nHost: x\r\nConnection: close\r\nContent-Length: 2\r\n\r\n{}");
+  if (!/^HTTP\/1\.1 200 /.test(served)) failures.push(`  after the held connections closed: ${served.split("\r\n")[0]}`);
+
+  console.log(`${failures.length === 0 ? "ok  " : "FAIL"} http: chunked body refused, 256 connections held`);
+  if (failures.length > 0) console.log(failures.join("\n"));
+  return failures.length;
+}
+
+// Wait until the background consumer has filtered n lines
+function waitProcessed(url, n) {
+  for (let attempt = 0; attempt < 200; attempt++) {
+    const { ingest } = postSync(`${url}/stats`, "{}");
+    if (ingest.processed >= n && ingest.ring_used === 0 && ingest.overflow_used === 0) return ingest;
+    execFileSync("sleep", ["0.05"]);
+  }
+  throw new Error(`ingest did not drain ${n} lines`);
+}
+
+// /ingest with room in the ring: the outbox holds exactly the results the
+// harness would post (or that carry its overflow digest), in order
+function checkIngest(url) {
+  const random = mulberry32(13);
+  const expected = [];
+  harness.resetState();
+  let sent = 0;
+  for (let p = 0; p < 4; p++) {
+    const now = START + p * 30000;
+    const logs = payloadLogs(random, 150, now);
+    const lines = logs.map((log) => [log.level, log.timestamp, log.message].filter(Boolean).join(" "));
+    postSync(`${url}/ingest`, JSON.stringify({ channel_id: "i", lines, now }));
+    for (const line of lines) {
+      const result = harness.runLine(line, { now, channel: "i" });
+      if (result.action !== "suppress" || (result.digest && result.digest.length > 0)) expected.push(JSON.stringify(project(result)));
+    }
+    sent += lines.length;
+  }
+  waitProcessed(url, sent);
+  const { results } = postSync(`${url}/outbox`, JSON.stringify({ channel_id: "i" }));
+  const actual = results.map((result) => JSON.stringify(project(result)));
+  let diffs = Math.abs(actual.length - expected.length);
+  expected.forEach((record, i) => {
+    if (record !== actual[i] && diffs++ < 5) console.log(`  outbox ${i + 1}:\n    harness: ${record}\n    sidecar: ${actual[i]}`);
+  });
+  console.log(`${diffs === 0 ? "ok  " : "FAIL"} /ingest: ${sent} lines, ${actual.length} in the outbox`);
+  return diffs;
+}
+
+// One flood into a 64-slot ring: every line is either filtered or counted
+// as dropped, and spill drops nothing
+async function checkOverflow(binary, policy) {
+  const { child, url } = await startSidecar(binary, ["--ring", "64", "--overflow", policy, "--overflow-capacity", "256", "--sample-every", "4"]);
+  try {
+    const random = mulberry32(17);
+    const lines = payloadLogs(random, 5000, START).map((log) => `${log.level} ${log.message}`);
+    const admission = postSync(`${url}/ingest`, JSON.stringify({ channel_id: "flood", lines, now: START }));
+    const kept = lines.length - admission.dropped;
+    const stats = waitProcessed(url, kept);
+    const ok =
+      admission.accepted + admission.overflowed === lines.length &&
+      admission.dropped <= admission.overflowed &&
+      stats.processed === kept &&
+      stats.ring_peak <= stats.ring_capacity &&
+      (policy !== "spill" || admission.dropped === 0);
+    console.log(
+      `${ok ? "ok  " : "FAIL"} overflow ${policy}: ${lines.length} lines, ${admission.accepted} ringed, ` +
+        `${admission.overflowed} overflowed, ${admission.dropped} dropped, peak ${stats.ring_peak}/${stats.ring_capacity}`
+    );
+    return (ok ? 0 : 1) + (policy === "spill" ? await checkSpilledConfigs(url, stats.processed) : 0);
+  } finally {
+    child.kill();
+  }
+}
+
+// Spilled lines keep the config of the request that brought them, even
+// when a later request on the channel, sent while they still wait, brings
+// another
+async function checkSpilledConfigs(url, processed) {
+  const lines = (tag, n) => Array.from({ length: n }, (_, i) => `INFO ${tag} job ${i} of ${messagePhrase(i)} finished`);
+  const open = { rate_limit: 1e9, rate_burst: 1e9 };
+  const ingest = async (body) =>
+    (await fetch(`${url}/ingest`, { method: "POST", headers: { "Content-Type": "application/json" }, body: JSON.stringify(body) })).json();
+  const off = await ingest({ channel_id: "mixed", lines: lines("off", 100000), now: START, config: { ...open, enabled: false } });
+  const on = await ingest({ channel_id: "mixed", lines: lines("on", 300), now: START, config: open });
+  waitProcessed(url, processed + 100300);
+  // The outbox keeps the newest 1000: the last 700 "off" lines and every "on" one
+  const { results } = postSync(`${url}/outbox`, JSON.stringify({ channel_id: "mixed" }));
+  const wrong = results.filter((result) => (result.reason === "filter_off") !== result.message.includes(" off job "));
+  const ok = results.length === 1000 && wrong.length === 0;
+  console.log(
+    `${ok ? "ok  " : "FAIL"} spilled configs: ${off.overflowed + on.overflowed} of 100300 lines spilled, ` +
+      `${wrong.length} of the newest ${results.length} filtered under the other request's config`
+  );
+  return ok ? 0 : 1;
+}
+
+// /filter through a restart: state saved by POST /snapshot and loaded by
+// the next sidecar carries on as if it never stopped
+async function checkSnapshot(binary) {
+  const file = path.join(os.tmpdir(), `neurafilter-sidecar-${process.pid}.bin`);
+  const random = mulberry32(21);
+  const batches = [0, 1].map((p) => {
+    const now = START + p * 20000;
+    const lines = payloadLogs(random, 200, now).map((log) => [log.level, log.timestamp, log.message].filter(Boolean).join(" "));
+    return { lines, now };
+  });
+  const results = [];
+  let saved = null;
+  try {
+    for (const [p, { lines, now }] of batches.entries()) {
+      const { child, url } = await startSidecar(binary, ["--snapshot", file, "--snapshot-every-ms", "0"]);
+      try {
+        results.push(...postSync(`${url}/filter`, JSON.stringify({ channel_id: "s", lines, now, pipeline: true })).results);
+        if (p === 0) saved = postSync(`${url}/snapshot`, "{}");
+      } finally {
+        child.kill();
+      }
+    }
+  } finally {
+    fs.rmSync(file, { force: true });
+  }
+  harness.resetState();
+  let diffs = 0;
+  let i = 0;
+  for (const { lines, now } of batches) {
+    for (const line of lines) {
+      const expected = JSON.stringify(project(harness.runLine(line, { now, channel: "s" })));
+      const actual = JSON.stringify(project(results[i++]));
+      if (expected !== actual && diffs++ < 5) console.log(`  line ${i}: ${line}\n    harness: ${expected}\n    sidecar: ${actual}`);
+    }
+  }
+  if (!saved || saved.channels !== 1) diffs++;
+  console.log(`${diffs === 0 ? "ok  " : "FAIL"} /snapshot: ${i} lines across a restart (${saved && saved.bytes} bytes saved)`);
+  return diffs;
+}
+
+async function main() {
+  const index = process.argv.indexOf("--sidecar");
+  if (index < 0) throw new Error("usage: node test/sidecarTest.js --sidecar <path>");
+  const { child, url } = await startSidecar(process.argv[index + 1]);
+  let failures = 0;
+  try {
+    const cases = payloads();
+    const local = runWebhooks(loadExtension(), cases);
+
+    const forwarding = loadExtension();
+    forwarding.global.vars.set("sidecarUrl", url);
+    let forwarded = 0;
+    forwarding.invokeUrl = ({ url: target, parameters }) => {
+      forwarded++;
+      return postSync(target, parameters);
+    };
+    const remote = runWebhooks(forwarding, cases);
+
+    cases.forEach((testCase, i) => {
+      const expected = JSON.stringify(local[i]);
+      const actual = JSON.stringify(remote[i]);
+      if (expected !== actual) {
+        failures++;
+        console.log(`  payload ${i + 1} (${testCase.body.channel_id}):\n    deluge:  ${expected}\n    sidecar: ${actual}`);
+      }
+    });
+    const statuses = {};
+    for (const { response } of local) statuses[response.status] = (statuses[response.status] || 0) + 1;
+    if (forwarded !== cases.length) failures++;
+    console.log(
+      `${failures === 0 ? "ok  " : "FAIL"} /webhook: ${cases.length} payloads, ${forwarded} forwarded ` +
+        `(${Object.entries(statuses).map(([status, n]) => `${status}=${n}`).join(", ")})`
+    );
+
+    failures += checkStreaming();
+    failures += checkFilter(url);
+    failures += checkIngest(url);
+    failures += await checkProtocol(url);
+  } finally {
+    child.kill();
+  }
+  for (const policy of ["drop-lowest", "sample", "spill"]) failures += await checkOverflow(process.argv[index + 1], policy);
+  failures += await checkSnapshot(process.argv[index + 1]);
+  process.exit(failures > 0 ? 1 : 0);
+}
+
+main().catch((error) => {
+  console.error(error);
+  process.exit(1);
+});
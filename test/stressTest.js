@@ -0,0 +1,201 @@
+// Concurrency stress test for the shared counters
+//
+// Usage:
+//   node test/stressTest.js [--parallel 50] [--waves 20] [--seed 1]
+//
+// Runs the Deluge services (through test/delugeRunner.js) as waves of
+// --parallel invocations that overlap completely: every invocation in a
+// wave reads state as it was when the wave started, and writes back the
+// keys it changed when it finishes, in shuffled order, the last write to a
+// key winning. Under that model it checks that:
+//   - a plain read-modify-write counter loses increments (the old layout),
+//   - every sighting of a hot template reaches the anomaly window counts,
+//   - sightings spread over several minutes survive the counters' epoch
+//     compaction, which keeps the channel's live delta keys bounded,
+//   - every post the limiter allowed is in the rate-limit spend counts, and
+//     the limiter allows no more than its budget plus one wave,
+//   - every line buffered for a post digest is reported once.
+// Exits non-zero if any shared count is off.
+
+process.env.TZ = "UTC";
+
+const { isDeepStrictEqual } = require("util");
+const { loadExtension, toPlain } = require("./delugeRunner");
+const { mulberry32, messagePhrase } = require("./benchmark");
+
+function parseArgs(argv) {
+  const args = { parallel: 50, waves: 20, seed: 1 };
+  for (let i = 2; i < argv.length; i++) {
+    const flag = argv[i];
+    const value = Number(argv[++i]);
+    if (flag === "--parallel") args.parallel = value;
+    else if (flag === "--waves") args.waves = value;
+    else if (flag === "--seed") args.seed = value;
+    else throw new Error(`Unknown flag ${flag}`);
+  }
+  return args;
+}
+
+// One wave of fully overlapping invocations against the shared state map
+function runWave(runtime, shared, invocations, random) {
+  const base = structuredClone(shared);
+  const finished = invocations.map((invoke) => {
+    const own = structuredClone(base);
+    runtime.useState(own);
+    return { own, value: invoke() };
+  });
+
+  for (let i = finished.length - 1; i > 0; i--) {
+    const j = Math.floor(random() * (i + 1));
+    [finished[i], finished[j]] = [finished[j], finished[i]];
+  }
+  for (const { own } of finished) {
+    for (const key of base.keys()) if (!own.has(key)) shared.delete(key);
+    for (const [key, value] of own) if (!isDeepStrictEqual(base.get(key), value)) shared.set(key, value);
+  }
+  runtime.useState(shared);
+  return finished.map(({ value }) => value);
+}
+
+// Merged counts of one channel as a fresh invocation would read them
+function mergedTotals(runtime, channel, now) {
+  const counters = toPlain(runtime.call("openCounters", channel, now, 300000));
+  const totals = { posts: 0, sightings: 0 };
+  for (const [name, slots] of Object.entries(counters.merged)) {
+    const sum = Object.values(slots).reduce((a, b) => a + b, 0);
+    if (name === "posts") totals.posts += sum;
+    else totals.sightings += sum;
+  }
+  return totals;
+}
+
+function main() {
+  const args = parseArgs(process.argv);
+  const random = mulberry32(args.seed);
+  const start = Date.UTC(2025, 10, 16, 9, 0, 0);
+  const total = args.parallel * args.waves;
+  let failures = 0;
+
+  const check = (label, got, expected) => {
+    const ok = got === expected;
+    if (!ok) failures++;
+    console.log(`${ok ? "ok  " : "FAIL"} ${label}: ${got} of ${expected}`);
+  };
+  const checkAtMost = (label, got, bound) => {
+    const ok = got <= bound;
+    if (!ok) failures++;
+    console.log(`${ok ? "ok  " : "FAIL"} ${label}: ${got} (at most ${bound})`);
+  };
+
+  // Old layout: one counter updated in place
+  const legacy = loadExtension();
+  const legacyState = legacy.state;
+  const increment = 'count = state.get("count"); if(count == null) { count = 0; } state.put("count", count + 1);';
+  for (let wave = 0; wave < args.waves; wave++) {
+    runWave(legacy, legacyState, Array.from({ length: args.parallel }, () => () => legacy.runSource(increment)), random);
+  }
+  console.log(`read-modify-write counter kept ${legacyState.get("count")} of ${total} increments`);
+
+  // One hot template: every sighting must land in the anomaly window
+  const hot = loadExtension();
+  const hotState = hot.state;
+  let duplicates = 0;
+  for (let wave = 0; wave < args.waves; wave++) {
+    hot.now = start + wave * 1000;
+    const config = hot.call("getChannelConfig", "hot");
+    const results = runWave(
+      hot,
+      hotState,
+      Array.from({ length: args.parallel }, () => () => toPlain(hot.call("runPipeline", "ERROR Payment gateway timeout", "hot", config))),
+      random
+    );
+    duplicates += results.filter((result) => result.reason === "duplicate").length;
+  }
+  check("anomaly window sightings", mergedTotals(hot, "hot", hot.now).sightings, total);
+  console.log(`  ${duplicates} of them suppressed as duplicates, all still counted`);
+
+  // The same template every 5 s: older epochs are folded into one key each
+  const spread = loadExtension();
+  const spreadState = spread.state;
+  const spacing = 5000;
+  for (let wave = 0; wave < args.waves; wave++) {
+    spread.now = start + wave * spacing;
+    const config = spread.call("getChannelConfig", "spread");
+    runWave(
+      spread,
+      spreadState,
+      Array.from({ length: args.parallel }, () => () => spread.call("runPipeline", "ERROR Payment gateway timeout", "spread", config)),
+      random
+    );
+  }
+  check("compacted window sightings", mergedTotals(spread, "spread", spread.now).sightings, total);
+  // Unfolded deltas span at most the settle time plus two epochs (30 s and
+  // 10 s in utils/sharedCounters.deluge), and each epoch of the horizon
+  // leaves one compacted key
+  const unfolded = Math.ceil((30000 + 2 * 10000) / spacing) * args.parallel;
+  const liveKeys = [...spreadState.keys()].filter((key) => key.startsWith("counts:spread:")).length;
+  checkAtMost("live counter keys", liveKeys, unfolded + 300000 / 10000 + 1);
+
+  // Distinct lines: every allowed post must be charged to the limiter
+  const flood = loadExtension();
+  const floodState = flood.state;
+  let allowed = 0;
+  let line = 0;
+  for (let wave = 0; wave < args.waves; wave++) {
+    flood.now = start + wave * 1000;
+    const config = flood.call("getChannelConfig", "flood");
+    const results = runWave(
+      flood,
+      floodState,
+      Array.from({ length: args.parallel }, () => {
+        const message = `ERROR Worker ${messagePhrase(line++)} crashed`;
+        return () => toPlain(flood.call("runPipeline", message, "flood", config));
+      }),
+      random
+    );
+    allowed += results.filter((result) => result.action !== "suppress").length;
+  }
+  const elapsed = (args.waves - 1) * 1000;
+  check("rate-limit spends", mergedTotals(flood, "flood", flood.now).posts, allowed);
+  // Default burst 10 and 20 posts a minute; checks that overlap can all
+  // take the last token, so a flood may overshoot by one wave, no more
+  const budget = Math.floor(10 + (elapsed * 20) / 60000);
+  checkAtMost("rate-limit posts", allowed, budget + args.parallel);
+  console.log(`  one invocation at a time allows at most ${budget} in ${elapsed / 1000}s`);
+
+  // Digest mode: every buffered line is in exactly one digest, or still
+  // waiting for the next one. Overlapping takers may post one digest more
+  // than once, so each wave's summaries count once per distinct text.
+  const digests = loadExtension();
+  const digestState = digests.state;
+  let buffered = 0;
+  let reported = 0;
+  for (let wave = 0; wave < args.waves; wave++) {
+    digests.now = start + wave * 1000;
+    const config = digests.call("getChannelConfig", "digest");
+    for (const [key, value] of Object.entries({ digest_mode: true, digest_size: 40, rate_limit: 6000, rate_burst: 6000 }))
+      config.set(key, value);
+    const results = runWave(
+      digests,
+      digestState,
+      Array.from({ length: args.parallel }, () => {
+        const message = `INFO Job ${messagePhrase(line++)} finished`;
+        return () => toPlain(digests.call("runPipeline", message, "digest", config));
+      }),
+      random
+    );
+    buffered += results.filter((result) => result.buffered).length;
+    for (const summary of new Set(results.map((result) => result.summary).filter(Boolean)))
+      reported += Number(/Digest of (\d+) logs/.exec(summary)[1]);
+  }
+  const later = digests.now + 60000;
+  const waiting = toPlain(
+    digests.call("digestRange", digests.call("openDigest", "digest"), digests.call("openCounters", "digest", later, 300000), later)
+  ).lines;
+  check("digest lines", reported + waiting, buffered);
+  console.log(`  ${reported} of them posted in digests, ${waiting} waiting`);
+
+  process.exit(failures > 0 ? 1 : 0);
+}
+
+main();